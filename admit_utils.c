@@ -0,0 +1,206 @@
+/*******************************************************************************
+*      Filename: admit_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Admission control for the daemons. A daemon may cap the
+*                connections it serves at once, across every process serving
+*                the port. Each admitted connection holds a slot in a table
+*                shared by those processes, which records the process serving
+*                it. A slot is given back when its connection closes; one whose
+*                process died without giving it back is found and reused once
+*                the table is full. A connection that finds no slot may be held
+*                for a while in the process that accepted it, and is otherwise
+*                turned away at once with a busy frame, so that an overloaded
+*                daemon sheds load in microseconds instead of queueing work it
+*                cannot finish and the client can back off.
+*
+*                A kept-alive connection gives its slot back at the end of
+*                each message and takes one again when the next message
+*                begins, so idle pooled connections do not hold the daemon's
+*                capacity.
+*******************************************************************************/
+
+#include "admit_utils.h"
+#include "msg_utils.h"
+#include "stats_utils.h"
+#include "time_utils.h"
+
+static pid_t *admitSlots = NULL;  /* The shared table, NULL if unlimited */
+static int admitLimit = 0;        /* The number of slots */
+
+/*******************************************************************************
+*      Function: admitInit()
+*   Description: Maps the shared slot table.
+*    Parameters: int limit - The most connections served at once.
+* Preconditions: No child process has been forked yet.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int admitInit(int limit) {
+    void *region;
+
+    region = mmap(NULL, limit * sizeof(pid_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("admitInit: mmap");
+        return -1;
+    }
+    /* Anonymous mappings are zero filled, and zero marks a free slot */
+    admitSlots = region;
+    admitLimit = limit;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: admitAcquire()
+*   Description: Takes a free slot for a new connection. The slot is reserved
+*                until admitAssign() names the process serving it.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The slot, ADMIT_FULL if every slot is taken, or ADMIT_ANY if
+*                the daemon is unlimited.
+*******************************************************************************/
+
+int admitAcquire(void) {
+    static uint64_t lastPrune = 0;
+    static int hint = 0;
+    uint64_t now;
+    pid_t owner;
+    int i, slot, prune;
+
+    if (!admitSlots) {
+        return ADMIT_ANY;
+    }
+
+    /* Free slots are taken first. Only a full table pays to ask the kernel
+     * whether the owners of taken slots still exist. */
+    for (prune = 0; prune < 2; prune++) {
+        for (i = 0; i < admitLimit; i++) {
+            slot = (hint + i) % admitLimit;
+            owner = __atomic_load_n(&admitSlots[slot], __ATOMIC_RELAXED);
+            if (owner != 0 &&
+                (!prune || owner <= 0 || kill(owner, 0) == 0 ||
+                 errno != ESRCH)) {
+                continue;
+            }
+            if (__atomic_compare_exchange_n(&admitSlots[slot], &owner,
+                                            ADMIT_RESERVED, 0,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED)) {
+                hint = slot + 1;
+                return slot;
+            }
+        }
+        now = timeNowNs() / TIME_NS_PER_MS;
+        if (now - lastPrune < ADMIT_PRUNE_MS) {
+            break;
+        }
+        lastPrune = now;
+    }
+    return ADMIT_FULL;
+}
+
+/*******************************************************************************
+*      Function: admitAssign()
+*   Description: Records the process serving a reserved slot's connection. The
+*                serving process assigns the slot itself, before it can
+*                release it, so a release never runs ahead of the assignment
+*                and leaves a finished process recorded.
+*    Parameters: int slot - The slot.
+*                pid_t owner - The process.
+* Preconditions: The slot was returned by admitAcquire() and is still
+*                reserved.
+*       Returns: None.
+*******************************************************************************/
+
+void admitAssign(int slot, pid_t owner) {
+    pid_t reserved = ADMIT_RESERVED;
+
+    if (slot >= 0) {
+        __atomic_compare_exchange_n(&admitSlots[slot], &reserved, owner, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    }
+}
+
+/*******************************************************************************
+*      Function: admitRelease()
+*   Description: Gives back a slot. A slot that has already been reused is left
+*                alone.
+*    Parameters: int slot - The slot.
+*                pid_t owner - The process recorded for the slot, or
+*                              ADMIT_RESERVED if none was.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void admitRelease(int slot, pid_t owner) {
+    if (slot >= 0) {
+        __atomic_compare_exchange_n(&admitSlots[slot], &owner, 0, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+    }
+}
+
+/*******************************************************************************
+*      Function: admitWait()
+*   Description: Takes a free slot, waiting for one to free if every slot is
+*                taken.
+*    Parameters: int queueMs - The longest wait in milliseconds.
+* Preconditions: None.
+*       Returns: The slot, ADMIT_FULL if none freed in time, or ADMIT_ANY if
+*                the daemon is unlimited.
+*******************************************************************************/
+
+int admitWait(int queueMs) {
+    uint64_t until = timeNowNs() / TIME_NS_PER_MS + queueMs;
+    int slot;
+
+    while ((slot = admitAcquire()) == ADMIT_FULL &&
+           timeNowNs() / TIME_NS_PER_MS < until) {
+        usleep(ADMIT_POLL_MS * 1000);
+    }
+    return slot;
+}
+
+/*******************************************************************************
+*      Function: admitBusy()
+*   Description: Answers a connection with a busy frame. The request received
+*                so far is read and discarded, so that closing the connection
+*                afterwards ends the stream in order rather than resetting it
+*                and losing the frame.
+*    Parameters: int sockfd - The connection.
+*                int mode - The cipher mode.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void admitBusy(int sockfd, int mode) {
+    struct otpFrameHeader header = {0};
+    char frame[OTP_FRAME_HEADER_BYTES];
+    char drain[ADMIT_DRAIN_BYTES];
+    int i;
+
+    header.mode = mode;
+    header.flags = OTP_FRAME_BUSY;
+    frameHeaderPack(&header, frame);
+    send(sockfd, frame, sizeof(frame), MSG_DONTWAIT | MSG_NOSIGNAL);
+    for (i = 0; i < ADMIT_DRAIN_READS; i++) {
+        if (recv(sockfd, drain, sizeof(drain), MSG_DONTWAIT) <= 0) {
+            break;
+        }
+    }
+    STATS_ADD(connRejected, 1);
+}
+
+/*******************************************************************************
+*      Function: admitReject()
+*   Description: Turns a connection away with a busy frame and closes it.
+*    Parameters: int sockfd - The connection.
+*                int mode - The cipher mode.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void admitReject(int sockfd, int mode) {
+    admitBusy(sockfd, mode);
+    close(sockfd);
+}
@@ -0,0 +1,48 @@
+/*******************************************************************************
+*      Filename: admit_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for admit_utils.c. Please see admit_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef ADMIT_UTILS_H
+#define ADMIT_UTILS_H
+
+/* accept4(), with which the daemons drain their backlogs, is a Linux
+ * extension */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define ADMIT_ANY          -2     /* The slot of an unlimited daemon */
+#define ADMIT_FULL         -1     /* No slot is free */
+#define ADMIT_RESERVED     -1     /* A slot taken before its owner is known */
+#define ADMIT_INFLIGHT_MAX 65536  /* The largest concurrency limit */
+#define ADMIT_QUEUE_MS_MAX 60000  /* The longest a connection may be held */
+#define ADMIT_QUEUE_MAX     1024  /* Connections a process may hold waiting */
+#define ADMIT_POLL_MS          5  /* How often held connections retry */
+#define ADMIT_PRUNE_MS       100  /* How often a full table looks for slots
+                                   * left by processes that died */
+#define ADMIT_DRAIN_BYTES   4096  /* Request bytes read per drain */
+#define ADMIT_DRAIN_READS     16  /* Drains before a rejected connection
+                                   * is closed */
+
+int admitInit(int);
+int admitAcquire(void);
+void admitAssign(int, pid_t);
+void admitRelease(int, pid_t);
+int admitWait(int);
+void admitBusy(int, int);
+void admitReject(int, int);
+
+#endif
@@ -0,0 +1,109 @@
+/*******************************************************************************
+*      Filename: affinity_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: CPU affinity for sharded daemons. A core list such as
+*                "0-3,8" names the cores that each get a shard. A shard pins
+*                itself to its core and switches to the local NUMA memory
+*                policy, so that the buffers it allocates and touches come from
+*                the memory node nearest that core.
+*******************************************************************************/
+
+#include "affinity_utils.h"
+
+/*******************************************************************************
+*      Function: parseCoreList()
+*   Description: Parses a comma separated list of cores and core ranges. Every
+*                core must be one this process may run on.
+*    Parameters: const char *spec - The core list, e.g. "0-3,8".
+*                int **cores - Set to a malloc'd array of the cores, in order.
+* Preconditions: None.
+*       Returns: The number of cores, or -1 on error.
+*******************************************************************************/
+
+int parseCoreList(const char *spec, int **cores) {
+    cpu_set_t allowed;
+    const char *p = spec;
+    char *end;
+    long first, last, core;
+    int count = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        perror("parseCoreList: sched_getaffinity");
+        return -1;
+    }
+    *cores = malloc(AFFINITY_MAX_CORES * sizeof(int));
+    if (!*cores) {
+        perror("parseCoreList: malloc");
+        return -1;
+    }
+
+    while (*p) {
+        first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            break;
+        }
+        for (core = first; core <= last; core++) {
+            if (!CPU_ISSET(core, &allowed)) {
+                fprintf(stderr, "parseCoreList: Core %ld is not available\n",
+                        core);
+                free(*cores);
+                return -1;
+            }
+            if (count == AFFINITY_MAX_CORES) {
+                break;
+            }
+            (*cores)[count++] = (int)core;
+        }
+        p = end;
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            break;
+        }
+    }
+    if (*p || count == 0) {
+        fprintf(stderr, "parseCoreList: Invalid core list %s\n", spec);
+        free(*cores);
+        return -1;
+    }
+    return count;
+}
+
+/*******************************************************************************
+*      Function: affinityPin()
+*   Description: Pins the calling process to a core and makes later
+*                allocations prefer the memory node of the core it runs on.
+*                Kernels without NUMA support keep the default policy.
+*    Parameters: int core - The core.
+* Preconditions: The core is available to the process.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int affinityPin(int core) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+        perror("affinityPin: sched_setaffinity");
+        return -1;
+    }
+    if (syscall(SYS_set_mempolicy, AFFINITY_MPOL_LOCAL, NULL, 0) < 0 &&
+        errno != ENOSYS && errno != EINVAL) {
+        perror("affinityPin: set_mempolicy");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*******************************************************************************
+*      Filename: affinity_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for affinity_utils.c. Please see
+*                affinity_utils.c for more details.
+*******************************************************************************/
+
+#ifndef AFFINITY_UTILS_H
+#define AFFINITY_UTILS_H
+
+/* sched_setaffinity() and the CPU_SET macros are Linux extensions */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define AFFINITY_MAX_CORES  CPU_SETSIZE  /* The most cores in a core list */
+#define AFFINITY_MPOL_LOCAL 4            /* MPOL_LOCAL from <numaif.h> */
+
+int parseCoreList(const char *, int **);
+int affinityPin(int);
+
+#endif
@@ -0,0 +1,530 @@
+/*******************************************************************************
+*      Filename: async_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: An asynchronous client for callers running their own event
+*                loop. Requests are sent to the daemon as binary header frames
+*                over non-blocking sockets, one connection per request, with at
+*                most inflightMax connections open at once. The caller waits
+*                for its epoll descriptor, otpAsyncFd(), to become readable and
+*                then calls otpAsyncProcess(), which advances every ready
+*                connection and runs the completion callbacks. Callbacks run in
+*                submission order: a request that finishes early is held until
+*                every request submitted before it has been delivered.
+*******************************************************************************/
+
+#include "async_utils.h"
+#include "cipher_utils.h"
+#include "msg_utils.h"
+#include "pack_utils.h"
+#include "socket_utils.h"
+
+/*******************************************************************************
+*      Function: asyncSetEvents()
+*   Description: Changes the events a request's socket is registered for.
+*    Parameters: struct otpAsync *a - The client.
+*                struct otpAsyncReq *r - The request.
+*                int events - The new epoll events.
+* Preconditions: The socket is registered.
+*       Returns: None.
+*******************************************************************************/
+
+void asyncSetEvents(struct otpAsync *a, struct otpAsyncReq *r, int events) {
+    struct epoll_event ev = {0};
+
+    if (r->events == events) {
+        return;
+    }
+    ev.events = events;
+    ev.data.ptr = r;
+    if (epoll_ctl(a->epfd, EPOLL_CTL_MOD, r->fd, &ev) < 0) {
+        perror("asyncSetEvents: epoll_ctl");
+    }
+    r->events = events;
+}
+
+/*******************************************************************************
+*      Function: asyncFinish()
+*   Description: Ends a request, closing its connection, and wakes the caller
+*                so that it is delivered.
+*    Parameters: struct otpAsync *a - The client.
+*                struct otpAsyncReq *r - The request.
+*                int status - 0 on success, OTP_BUSY if the daemon was busy,
+*                             -1 on failure.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void asyncFinish(struct otpAsync *a, struct otpAsyncReq *r, int status) {
+    uint64_t one = 1;
+
+    if (r->fd >= 0) {
+        close(r->fd);
+        r->fd = -1;
+        a->inflight--;
+    }
+    free(r->frame);
+    r->frame = NULL;
+    r->status = status;
+    r->state = ASYNC_DONE;
+    if (write(a->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        perror("asyncFinish: write");
+    }
+}
+
+/*******************************************************************************
+*      Function: asyncNextFrame()
+*   Description: Forms the request's next frame and prepares to send it.
+*    Parameters: struct otpAsync *a - The client.
+*                struct otpAsyncReq *r - The request.
+* Preconditions: Text remains to be sent.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int asyncNextFrame(struct otpAsync *a, struct otpAsyncReq *r) {
+    struct otpFrameHeader header = {0};
+
+    header.mode = a->mode;
+    header.cipher = a->cipher;
+    header.flags = a->flags;
+    header.seq = r->seq;
+    header.offset = r->pos;
+    r->segmentLen = formFrameBuffer(&r->text[r->pos], &r->key[r->pos],
+                                    r->len - r->pos, r->frame, r->frameLen,
+                                    &header);
+    if (r->segmentLen < 0) {
+        return -1;
+    }
+    r->ioLen = segmentToFrameLen(r->segmentLen, a->flags);
+    r->ioPos = 0;
+    r->state = ASYNC_SENDING;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: asyncStart()
+*   Description: Begins a non-blocking connect for a request.
+*    Parameters: struct otpAsync *a - The client.
+*                struct otpAsyncReq *r - The request.
+* Preconditions: A connection slot is free.
+*       Returns: None. A request that cannot start is finished as failed.
+*******************************************************************************/
+
+void asyncStart(struct otpAsync *a, struct otpAsyncReq *r) {
+    struct epoll_event ev = {0};
+    int segmentMax = r->len < OTP_FRAME_SEGMENT_DEFAULT ? r->len : 
+                     OTP_FRAME_SEGMENT_DEFAULT;
+
+    r->frameLen = segmentToFrameLen(segmentMax, a->flags);
+    r->frame = malloc(r->frameLen);
+    r->out = malloc(r->len);
+    if (!r->frame || !r->out) {
+        perror("asyncStart: malloc");
+        asyncFinish(a, r, -1);
+        return;
+    }
+
+    /* A non-blocking connect cannot fall back to later addresses, so the
+     * first, preferred one is used */
+    r->fd = socket(a->addrs.addr[0].ss_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (r->fd < 0) {
+        perror("asyncStart: socket");
+        asyncFinish(a, r, -1);
+        return;
+    }
+    a->inflight++;
+    r->state = ASYNC_CONNECTING;
+    if (connect(r->fd, (struct sockaddr *)&a->addrs.addr[0], 
+                a->addrs.len[0]) < 0 &&
+        errno != EINPROGRESS) {
+        perror("asyncStart: connect");
+        asyncFinish(a, r, -1);
+        return;
+    }
+
+    /* The connect completes, or fails, once the socket is writable */
+    ev.events = EPOLLOUT;
+    ev.data.ptr = r;
+    if (epoll_ctl(a->epfd, EPOLL_CTL_ADD, r->fd, &ev) < 0) {
+        perror("asyncStart: epoll_ctl");
+        asyncFinish(a, r, -1);
+        return;
+    }
+    r->events = EPOLLOUT;
+}
+
+/*******************************************************************************
+*      Function: asyncDrive()
+*   Description: Advances a request as far as its socket allows, sending frames
+*                and receiving replies until the socket would block.
+*    Parameters: struct otpAsync *a - The client.
+*                struct otpAsyncReq *r - The request.
+* Preconditions: The request is connecting or connected.
+*       Returns: None.
+*******************************************************************************/
+
+void asyncDrive(struct otpAsync *a, struct otpAsyncReq *r) {
+    struct otpFrameHeader header;
+    socklen_t errLen = sizeof(int);
+    char *dest;
+    int n, err = 0;
+
+    for (;;) {
+        switch (r->state) {
+        case ASYNC_CONNECTING:
+            if (getsockopt(r->fd, SOL_SOCKET, SO_ERROR, &err, &errLen) < 0 ||
+                err != 0) {
+                fprintf(stderr, "asyncDrive: connect: %s\n", strerror(err));
+                asyncFinish(a, r, -1);
+                return;
+            }
+            if (asyncNextFrame(a, r) < 0) {
+                asyncFinish(a, r, -1);
+                return;
+            }
+            break;
+
+        case ASYNC_SENDING:
+            n = send(r->fd, &r->frame[r->ioPos], r->ioLen - r->ioPos,
+                     MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    asyncSetEvents(a, r, EPOLLOUT);
+                    return;
+                }
+                perror("asyncDrive: send");
+                asyncFinish(a, r, -1);
+                return;
+            }
+            r->ioPos += n;
+            if (r->ioPos == r->ioLen) {
+                r->state = ASYNC_RECV_HEADER;
+                r->ioLen = OTP_FRAME_HEADER_BYTES;
+                r->ioPos = 0;
+            }
+            break;
+
+        case ASYNC_RECV_HEADER:
+        case ASYNC_RECV_SEGMENT:
+            /* An unpacked segment is received straight into the output; a
+             * packed one is unpacked from the frame buffer */
+            if (r->state == ASYNC_RECV_HEADER) {
+                dest = r->frame;
+            } else if (a->flags & OTP_FRAME_PACKED) {
+                dest = &r->frame[OTP_FRAME_HEADER_BYTES];
+            } else {
+                dest = &r->out[r->pos];
+            }
+            n = recv(r->fd, &dest[r->ioPos], r->ioLen - r->ioPos, 0);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    asyncSetEvents(a, r, EPOLLIN);
+                    return;
+                }
+                perror("asyncDrive: recv");
+                asyncFinish(a, r, -1);
+                return;
+            }
+            if (n == 0) {
+                fprintf(stderr, "asyncDrive: Connection closed\n");
+                asyncFinish(a, r, -1);
+                return;
+            }
+            r->ioPos += n;
+            if (r->ioPos < r->ioLen) {
+                break;
+            }
+
+            if (r->state == ASYNC_RECV_HEADER) {
+                /* A daemon at capacity answers with a lone busy header */
+                n = frameHeaderUnpack(r->frame, &header);
+                if (n == 0 && (header.flags & OTP_FRAME_BUSY)) {
+                    asyncFinish(a, r, OTP_BUSY);
+                    return;
+                }
+                if (n < 0 || header.len != r->segmentLen ||
+                    header.seq != r->seq || header.offset != (uint64_t)r->pos ||
+                    (header.flags & OTP_FRAME_PACKED) !=
+                    (a->flags & OTP_FRAME_PACKED)) {
+                    fprintf(stderr, "asyncDrive: Unexpected reply\n");
+                    asyncFinish(a, r, -1);
+                    return;
+                }
+                r->state = ASYNC_RECV_SEGMENT;
+                r->ioLen = frameSegmentBytes(r->segmentLen, a->flags);
+                r->ioPos = 0;
+                break;
+            }
+
+            if ((a->flags & OTP_FRAME_PACKED) &&
+                frameUnpackSymbols((unsigned char *)dest, r->segmentLen,
+                                   &r->out[r->pos]) < 0) {
+                fprintf(stderr, "asyncDrive: Invalid reply\n");
+                asyncFinish(a, r, -1);
+                return;
+            }
+            r->pos += r->segmentLen;
+            r->seq++;
+            if (r->pos == r->len) {
+                asyncFinish(a, r, 0);
+                return;
+            }
+            if (asyncNextFrame(a, r) < 0) {
+                asyncFinish(a, r, -1);
+                return;
+            }
+            break;
+
+        default:
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: asyncStartQueued()
+*   Description: Starts queued requests, in submission order, while connection
+*                slots are free.
+*    Parameters: struct otpAsync *a - The client.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void asyncStartQueued(struct otpAsync *a) {
+    struct otpAsyncReq *r;
+
+    while (a->queued && a->inflight < a->inflightMax) {
+        r = a->queued;
+        a->queued = r->next;
+        asyncStart(a, r);
+    }
+}
+
+/*******************************************************************************
+*      Function: otpAsyncCreate()
+*   Description: Creates an asynchronous client for the daemon on this host.
+*    Parameters: const char *port - The daemon's port string.
+*                int mode - OTP_ENCIPHER or OTP_DECIPHER.
+*                int cipher - OTP_CIPHER_TEXT or OTP_CIPHER_XOR.
+*                int flags - OTP_FRAME_PACKED for packed text cipher frames, or
+*                            0.
+*                int inflightMax - The connection limit, or 0 for
+*                                  ASYNC_INFLIGHT_MAX.
+* Preconditions: None.
+*       Returns: The client, or NULL on error.
+*******************************************************************************/
+
+struct otpAsync *otpAsyncCreate(const char *port, int mode, int cipher,
+                                int flags, int inflightMax) {
+    struct epoll_event ev = {0};
+    struct otpAsync *a;
+
+    if ((flags & OTP_FRAME_PACKED) && cipher != OTP_CIPHER_TEXT) {
+        fprintf(stderr, "otpAsyncCreate: Packing requires the text cipher\n");
+        return NULL;
+    }
+    a = calloc(1, sizeof(*a));
+    if (!a) {
+        perror("otpAsyncCreate: calloc");
+        return NULL;
+    }
+    a->mode = mode;
+    a->cipher = cipher;
+    a->flags = flags & OTP_FRAME_PACKED;
+    a->inflightMax = inflightMax > 0 ? inflightMax : ASYNC_INFLIGHT_MAX;
+    a->epfd = -1;
+    a->wakefd = -1;
+
+    if (clientResolve(port, &a->addrs) < 0) {
+        otpAsyncDestroy(a);
+        return NULL;
+    }
+    a->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (a->epfd < 0) {
+        perror("otpAsyncCreate: epoll_create1");
+        otpAsyncDestroy(a);
+        return NULL;
+    }
+    a->wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (a->wakefd < 0) {
+        perror("otpAsyncCreate: eventfd");
+        otpAsyncDestroy(a);
+        return NULL;
+    }
+    /* The wake descriptor's data pointer is NULL */
+    ev.events = EPOLLIN;
+    if (epoll_ctl(a->epfd, EPOLL_CTL_ADD, a->wakefd, &ev) < 0) {
+        perror("otpAsyncCreate: epoll_ctl");
+        otpAsyncDestroy(a);
+        return NULL;
+    }
+    return a;
+}
+
+/*******************************************************************************
+*      Function: otpAsyncFd()
+*   Description: Reports the descriptor the caller waits on. It becomes
+*                readable whenever otpAsyncProcess() has work to do.
+*    Parameters: const struct otpAsync *a - The client.
+* Preconditions: None.
+*       Returns: The descriptor.
+*******************************************************************************/
+
+int otpAsyncFd(const struct otpAsync *a) {
+    return a->epfd;
+}
+
+/*******************************************************************************
+*      Function: otpAsyncSubmit()
+*   Description: Submits a request. The connection is opened immediately if a
+*                slot is free.
+*    Parameters: struct otpAsync *a - The client.
+*                const char *text - The text.
+*                const char *key - The key, at least as long as the text.
+*                int len - The text length.
+*                otpAsyncCallback callback - The completion callback.
+*                void *arg - The callback argument.
+* Preconditions: The text and key stay valid and unchanged until the callback
+*                runs.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int otpAsyncSubmit(struct otpAsync *a, const char *text, const char *key,
+                   int len, otpAsyncCallback callback, void *arg) {
+    struct otpAsyncReq *r;
+
+    if (len <= 0 || !text || !key || !callback) {
+        fprintf(stderr, "otpAsyncSubmit: Error in arguments\n");
+        return -1;
+    }
+    r = calloc(1, sizeof(*r));
+    if (!r) {
+        perror("otpAsyncSubmit: calloc");
+        return -1;
+    }
+    r->text = text;
+    r->key = key;
+    r->len = len;
+    r->fd = -1;
+    r->state = ASYNC_QUEUED;
+    r->callback = callback;
+    r->arg = arg;
+
+    if (a->tail) {
+        a->tail->next = r;
+    } else {
+        a->head = r;
+    }
+    a->tail = r;
+    if (!a->queued) {
+        a->queued = r;
+    }
+    a->pending++;
+
+    asyncStartQueued(a);
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: otpAsyncProcess()
+*   Description: Advances every ready connection without blocking, starts
+*                queued requests as slots free up, and delivers finished
+*                requests in submission order.
+*    Parameters: struct otpAsync *a - The client.
+* Preconditions: Not called from a callback.
+*       Returns: The number of requests delivered, or -1 on error.
+*******************************************************************************/
+
+int otpAsyncProcess(struct otpAsync *a) {
+    struct epoll_event events[ASYNC_MAX_EVENTS];
+    struct otpAsyncReq *r;
+    uint64_t count;
+    int n, i, delivered = 0;
+
+    n = epoll_wait(a->epfd, events, ASYNC_MAX_EVENTS, 0);
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        perror("otpAsyncProcess: epoll_wait");
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        r = events[i].data.ptr;
+        if (!r) {
+            /* Reset the wake descriptor; everything finished is delivered
+             * below */
+            if (read(a->wakefd, &count, sizeof(count)) < 0 &&
+                errno != EAGAIN) {
+                perror("otpAsyncProcess: read");
+            }
+            continue;
+        }
+        if (r->state != ASYNC_DONE) {
+            asyncDrive(a, r);
+        }
+    }
+    asyncStartQueued(a);
+
+    /* Deliver in submission order. The request leaves the list before its
+     * callback runs, so the callback may submit more requests. */
+    while (a->head && a->head->state == ASYNC_DONE) {
+        r = a->head;
+        a->head = r->next;
+        if (!a->head) {
+            a->tail = NULL;
+        }
+        a->pending--;
+        r->callback(r->arg, r->status, r->status == 0 ? r->out : NULL,
+                    r->len);
+        free(r->out);
+        free(r);
+        delivered++;
+    }
+    return delivered;
+}
+
+/*******************************************************************************
+*      Function: otpAsyncPending()
+*   Description: Reports the number of requests not yet delivered.
+*    Parameters: const struct otpAsync *a - The client.
+* Preconditions: None.
+*       Returns: The number of requests.
+*******************************************************************************/
+
+int otpAsyncPending(const struct otpAsync *a) {
+    return a->pending;
+}
+
+/*******************************************************************************
+*      Function: otpAsyncDestroy()
+*   Description: Destroys a client. Requests not yet delivered are dropped
+*                without running their callbacks.
+*    Parameters: struct otpAsync *a - The client, or NULL.
+* Preconditions: Not called from a callback.
+*       Returns: None.
+*******************************************************************************/
+
+void otpAsyncDestroy(struct otpAsync *a) {
+    struct otpAsyncReq *r, *next;
+
+    if (!a) {
+        return;
+    }
+    for (r = a->head; r; r = next) {
+        next = r->next;
+        if (r->fd >= 0) {
+            close(r->fd);
+        }
+        free(r->frame);
+        free(r->out);
+        free(r);
+    }
+    if (a->wakefd >= 0) {
+        close(a->wakefd);
+    }
+    if (a->epfd >= 0) {
+        close(a->epfd);
+    }
+    free(a);
+}
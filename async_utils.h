@@ -0,0 +1,88 @@
+/*******************************************************************************
+*      Filename: async_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for async_utils.c. Please see async_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef ASYNC_UTILS_H
+#define ASYNC_UTILS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "socket_utils.h"
+
+#define ASYNC_MAX_EVENTS      64     /* Events handled per otpAsyncProcess() */
+#define ASYNC_INFLIGHT_MAX   256     /* The default connection limit */
+
+#define ASYNC_QUEUED           0     /* Waiting for a connection slot */
+#define ASYNC_CONNECTING       1     /* Non-blocking connect in progress */
+#define ASYNC_SENDING          2     /* Sending a frame */
+#define ASYNC_RECV_HEADER      3     /* Receiving a reply header */
+#define ASYNC_RECV_SEGMENT     4     /* Receiving a reply segment */
+#define ASYNC_DONE             5     /* Finished, waiting to be delivered */
+
+/* Called with the request's argument, 0 and the processed text on success,
+ * OTP_BUSY and NULL if the daemon turned the request away at capacity, or -1
+ * and NULL on failure. The text is only valid during the call. */
+typedef void (*otpAsyncCallback)(void *, int, const char *, int);
+
+/* A request in flight */
+struct otpAsyncReq {
+    const char *text;             /* The caller's text */
+    const char *key;              /* The caller's key */
+    int len;                      /* The text length */
+    int pos;                      /* Symbols answered so far */
+    int fd;                       /* The socket, -1 if not connected */
+    int state;                    /* One of the ASYNC states */
+    int events;                   /* The registered epoll events */
+    int status;                   /* 0, or OTP_BUSY or -1 once it has failed */
+    char *frame;                  /* The frame being sent or received */
+    int frameLen;                 /* The frame buffer length */
+    int ioLen;                    /* The bytes to send or receive */
+    int ioPos;                    /* The bytes sent or received so far */
+    int segmentLen;               /* The current segment length */
+    uint32_t seq;                 /* The current frame's sequence number */
+    char *out;                    /* The processed text */
+    otpAsyncCallback callback;    /* The completion callback */
+    void *arg;                    /* The callback argument */
+    struct otpAsyncReq *next;     /* The next request in submission order */
+};
+
+/* An asynchronous client */
+struct otpAsync {
+    int epfd;                     /* The epoll instance the caller waits on */
+    int wakefd;                   /* An eventfd set when requests finish */
+    struct clientAddrs addrs;     /* The server addresses */
+    int mode;                     /* OTP_ENCIPHER or OTP_DECIPHER */
+    int cipher;                   /* OTP_CIPHER_TEXT or OTP_CIPHER_XOR */
+    int flags;                    /* OTP_FRAME_PACKED or 0 */
+    int inflightMax;              /* The connection limit */
+    int inflight;                 /* Connections open */
+    int pending;                  /* Requests not yet delivered */
+    struct otpAsyncReq *head;     /* The oldest undelivered request */
+    struct otpAsyncReq *tail;     /* The newest request */
+    struct otpAsyncReq *queued;   /* The oldest request not yet started */
+};
+
+struct otpAsync *otpAsyncCreate(const char *, int, int, int, int);
+int otpAsyncFd(const struct otpAsync *);
+int otpAsyncSubmit(struct otpAsync *, const char *, const char *, int,
+                   otpAsyncCallback, void *);
+int otpAsyncProcess(struct otpAsync *);
+int otpAsyncPending(const struct otpAsync *);
+void otpAsyncDestroy(struct otpAsync *);
+
+#endif
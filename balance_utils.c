@@ -0,0 +1,435 @@
+/*******************************************************************************
+*      Filename: balance_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Spreads client connections over a list of daemon endpoints.
+*                Each endpoint's consecutive failures, hold down time and the
+*                client processes using it are kept in a small state file
+*                shared by every client run by the user, so a new client sees
+*                the load and health that earlier and concurrent ones left.
+*                Outstanding requests are counted as the live processes
+*                recorded against an endpoint; a process that exits without
+*                finishing is dropped the next time its endpoint is counted.
+*
+*                A failed endpoint is held down for BALANCE_DOWN_MS, doubled
+*                for each further failure, and is only tried again once the
+*                hold down expires or every other endpoint has failed. The
+*                file is locked with flock() while it is read or changed. A
+*                client that cannot open it balances on its own.
+*******************************************************************************/
+
+#include "balance_utils.h"
+#include "socket_utils.h"
+#include "time_utils.h"
+
+/*******************************************************************************
+*      Function: balanceParse()
+*   Description: Parses an endpoint list of the form port or host:port,
+*                separated by commas.
+*    Parameters: struct balancer *b - The balancer to fill in.
+*                const char *list - The endpoint list.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on an invalid list.
+*******************************************************************************/
+
+int balanceParse(struct balancer *b, const char *list) {
+    struct balanceEndpoint *ep;
+    const char *end, *colon;
+    int len, hostLen;
+
+    b->count = 0;
+    while (1) {
+        end = strchr(list, ',');
+        len = end ? (int)(end - list) : (int)strlen(list);
+        if (len == 0 || len >= BALANCE_NAME_MAX ||
+            b->count == BALANCE_ENDPOINTS_MAX) {
+            fprintf(stderr, "balanceParse: invalid endpoint list\n");
+            return -1;
+        }
+        ep = &b->endpoint[b->count++];
+        memcpy(ep->name, list, len);
+        ep->name[len] = '\0';
+
+        /* A bare port names this host */
+        colon = strrchr(ep->name, ':');
+        hostLen = colon ? (int)(colon - ep->name) : 0;
+        memcpy(ep->host, ep->name, hostLen);
+        ep->host[hostLen] = '\0';
+        if (strlen(&ep->name[colon ? hostLen + 1 : 0]) >= sizeof(ep->port) ||
+            (colon && hostLen == 0)) {
+            fprintf(stderr, "balanceParse: invalid endpoint %s\n", ep->name);
+            return -1;
+        }
+        strcpy(ep->port, &ep->name[colon ? hostLen + 1 : 0]);
+        if (convertPort(ep->port) < 0) {
+            return -1;
+        }
+        if (!end) {
+            return 0;
+        }
+        list = end + 1;
+    }
+}
+
+/*******************************************************************************
+*      Function: balanceOpenState()
+*   Description: Opens and maps the state file, initialising it if it is new
+*                or holds something else.
+*    Parameters: struct balancer *b - The balancer.
+*                const char *path - The state file path.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int balanceOpenState(struct balancer *b, const char *path) {
+    struct stat st;
+    void *region;
+
+    b->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (b->fd < 0) {
+        perror("balanceOpenState: open");
+        return -1;
+    }
+    if (flock(b->fd, LOCK_EX) < 0 || fstat(b->fd, &st) < 0 ||
+        (st.st_size != sizeof(struct balanceState) &&
+         ftruncate(b->fd, sizeof(struct balanceState)) < 0)) {
+        perror("balanceOpenState");
+        close(b->fd);
+        b->fd = -1;
+        return -1;
+    }
+    region = mmap(NULL, sizeof(struct balanceState), PROT_READ | PROT_WRITE,
+                  MAP_SHARED, b->fd, 0);
+    if (region == MAP_FAILED) {
+        perror("balanceOpenState: mmap");
+        close(b->fd);
+        b->fd = -1;
+        return -1;
+    }
+    b->state = region;
+    if (b->state->magic != BALANCE_MAGIC ||
+        b->state->slots != BALANCE_SLOTS) {
+        memset(b->state, 0, sizeof(*b->state));
+        b->state->magic = BALANCE_MAGIC;
+        b->state->slots = BALANCE_SLOTS;
+    }
+    flock(b->fd, LOCK_UN);
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: balanceInit()
+*   Description: Prepares a balancer over an endpoint list.
+*    Parameters: struct balancer *b - The balancer.
+*                const char *list - The endpoint list.
+*                int policy - BALANCE_P2C or BALANCE_LOR.
+*                const char *path - The state file, or NULL for the default.
+*                int profile - The OTP_PROFILE applied to connections.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on an invalid list.
+*******************************************************************************/
+
+int balanceInit(struct balancer *b, const char *list, int policy,
+                const char *path, int profile) {
+    char defaultPath[64];
+
+    memset(b, 0, sizeof(*b));
+    b->policy = policy;
+    b->profile = profile;
+    b->fd = -1;
+    b->current = -1;
+    b->seed = (unsigned)getpid() ^ (unsigned)timeNowNs();
+    if (balanceParse(b, list) < 0) {
+        return -1;
+    }
+
+    /* A single endpoint has nothing to choose between */
+    if (b->count == 1) {
+        return 0;
+    }
+    if (!path) {
+        snprintf(defaultPath, sizeof(defaultPath), "%s.%u",
+                 BALANCE_STATE_DEFAULT, (unsigned)getuid());
+        path = defaultPath;
+    }
+    if (balanceOpenState(b, path) < 0) {
+        fprintf(stderr, "balanceInit: continuing without shared state\n");
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: balanceSlot()
+*   Description: Finds an endpoint's slot in the state file, claiming one if
+*                the endpoint has none. A full table gives up the slot the
+*                name hashes to.
+*    Parameters: struct balancer *b - The balancer.
+*                const char *name - The endpoint name.
+* Preconditions: The state file is mapped and locked.
+*       Returns: The slot.
+*******************************************************************************/
+
+struct balanceSlot *balanceSlot(struct balancer *b, const char *name) {
+    struct balanceSlot *slot;
+    unsigned hash = 2166136261U;
+    const char *p;
+    int i;
+
+    for (p = name; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619U;
+    }
+    for (i = 0; i < BALANCE_SLOTS; i++) {
+        slot = &b->state->slot[(hash + i) % BALANCE_SLOTS];
+        if (strcmp(slot->name, name) == 0) {
+            return slot;
+        }
+        if (!slot->name[0]) {
+            break;
+        }
+    }
+    if (i == BALANCE_SLOTS) {
+        slot = &b->state->slot[hash % BALANCE_SLOTS];
+    }
+    memset(slot, 0, sizeof(*slot));
+    strcpy(slot->name, name);
+    return slot;
+}
+
+/*******************************************************************************
+*      Function: balanceLoad()
+*   Description: Counts the live client processes using an endpoint, dropping
+*                those that have exited.
+*    Parameters: struct balanceSlot *slot - The endpoint's slot.
+* Preconditions: The state file is locked.
+*       Returns: The number of outstanding requests.
+*******************************************************************************/
+
+int balanceLoad(struct balanceSlot *slot) {
+    int i, load = 0;
+
+    for (i = 0; i < BALANCE_ACTIVE_MAX; i++) {
+        if (!slot->active[i]) {
+            continue;
+        }
+        if (kill(slot->active[i], 0) < 0 && errno == ESRCH) {
+            slot->active[i] = 0;
+        } else {
+            load++;
+        }
+    }
+    return load;
+}
+
+/*******************************************************************************
+*      Function: balanceHeld()
+*   Description: Finds how long an endpoint remains held down. A hold down
+*                longer than any failure sets, as one left by an earlier boot
+*                may be, is ignored.
+*    Parameters: struct balanceSlot *slot - The endpoint's slot.
+*                uint64_t now - The monotonic time in milliseconds.
+* Preconditions: The state file is locked.
+*       Returns: The remaining hold down time in milliseconds, 0 if healthy.
+*******************************************************************************/
+
+uint64_t balanceHeld(const struct balanceSlot *slot, uint64_t now) {
+    if (slot->downUntil <= now ||
+        slot->downUntil - now > BALANCE_DOWN_MAX_MS) {
+        return 0;
+    }
+    return slot->downUntil - now;
+}
+
+/*******************************************************************************
+*      Function: balancePick()
+*   Description: Chooses an untried endpoint. Healthy endpoints are chosen by
+*                the policy; if none remain, the one whose hold down expires
+*                soonest is chosen. The client is recorded against the choice.
+*    Parameters: struct balancer *b - The balancer.
+* Preconditions: None.
+*       Returns: The endpoint index, -1 if every endpoint has been tried.
+*******************************************************************************/
+
+int balancePick(struct balancer *b) {
+    struct balanceSlot *slots[BALANCE_ENDPOINTS_MAX] = {0};
+    int healthy[BALANCE_ENDPOINTS_MAX];
+    int load[BALANCE_ENDPOINTS_MAX];
+    uint64_t held, soonest = UINT64_MAX;
+    uint64_t now = timeNowNs() / 1000000;
+    int i, a, c, n = 0, pick = -1, ties = 0;
+
+    if (b->state) {
+        flock(b->fd, LOCK_EX);
+    }
+    for (i = 0; i < b->count; i++) {
+        if (b->endpoint[i].tried) {
+            continue;
+        }
+        load[i] = 0;
+        held = 0;
+        if (b->state) {
+            slots[i] = balanceSlot(b, b->endpoint[i].name);
+            load[i] = balanceLoad(slots[i]);
+            held = balanceHeld(slots[i], now);
+        }
+        if (held == 0) {
+            healthy[n++] = i;
+        } else if (held < soonest) {
+            soonest = held;
+            pick = i;
+        }
+    }
+
+    if (n > 0 && b->policy == BALANCE_P2C) {
+        /* The less loaded of two distinct random choices */
+        a = rand_r(&b->seed) % n;
+        pick = healthy[a];
+        if (n > 1) {
+            c = rand_r(&b->seed) % (n - 1);
+            c = healthy[c >= a ? c + 1 : c];
+            pick = load[c] < load[pick] ? c : pick;
+        }
+    } else if (n > 0) {
+        /* The least loaded, ties broken at random */
+        pick = healthy[0];
+        for (i = 0; i < n; i++) {
+            if (load[healthy[i]] < load[pick]) {
+                pick = healthy[i];
+                ties = 1;
+            } else if (load[healthy[i]] == load[pick] &&
+                       rand_r(&b->seed) % ++ties == 0) {
+                pick = healthy[i];
+            }
+        }
+    }
+
+    /* Record the client against the endpoint */
+    if (pick >= 0 && slots[pick]) {
+        for (i = 0; i < BALANCE_ACTIVE_MAX; i++) {
+            if (!slots[pick]->active[i]) {
+                slots[pick]->active[i] = getpid();
+                break;
+            }
+        }
+    }
+    if (b->state) {
+        flock(b->fd, LOCK_UN);
+    }
+    return pick;
+}
+
+/*******************************************************************************
+*      Function: balanceRecord()
+*   Description: Removes the client from an endpoint and records the outcome
+*                of its use.
+*    Parameters: struct balancer *b - The balancer.
+*                int index - The endpoint index.
+*                int ok - Nonzero if the endpoint served the client.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void balanceRecord(struct balancer *b, int index, int ok) {
+    struct balanceSlot *slot;
+    uint64_t down;
+    int i;
+
+    if (!b->state) {
+        return;
+    }
+    flock(b->fd, LOCK_EX);
+    slot = balanceSlot(b, b->endpoint[index].name);
+    for (i = 0; i < BALANCE_ACTIVE_MAX; i++) {
+        if (slot->active[i] == getpid()) {
+            slot->active[i] = 0;
+            break;
+        }
+    }
+    if (ok) {
+        slot->failures = 0;
+        slot->downUntil = 0;
+    } else {
+        /* Hold the endpoint down, doubling the time for each failure */
+        down = BALANCE_DOWN_MS;
+        for (i = 0; i < (int)slot->failures && down < BALANCE_DOWN_MAX_MS;
+             i++) {
+            down *= 2;
+        }
+        if (down > BALANCE_DOWN_MAX_MS) {
+            down = BALANCE_DOWN_MAX_MS;
+        }
+        slot->failures++;
+        slot->downUntil = timeNowNs() / 1000000 + down;
+    }
+    flock(b->fd, LOCK_UN);
+}
+
+/*******************************************************************************
+*      Function: balanceConnect()
+*   Description: Connects to an endpoint chosen by the balancer, trying the
+*                others in turn if it cannot be reached. Each endpoint is
+*                resolved once, when it is first tried.
+*    Parameters: struct balancer *b - The balancer.
+* Preconditions: No connection is outstanding.
+*       Returns: The socket file descriptor, -1 if no endpoint was reached.
+*******************************************************************************/
+
+int balanceConnect(struct balancer *b) {
+    struct balanceEndpoint *ep;
+    int i, sockfd;
+
+    for (i = 0; i < b->count; i++) {
+        b->endpoint[i].tried = 0;
+    }
+    while ((i = balancePick(b)) >= 0) {
+        ep = &b->endpoint[i];
+        ep->tried = 1;
+        if (!ep->resolved &&
+            clientResolveHost(ep->host[0] ? ep->host : NULL, ep->port,
+                              &ep->addrs) == 0) {
+            ep->resolved = 1;
+        }
+        if (ep->resolved &&
+            (sockfd = clientConnectAddrs(&ep->addrs, b->profile)) >= 0) {
+            b->current = i;
+            return sockfd;
+        }
+        balanceRecord(b, i, 0);
+    }
+    return -1;
+}
+
+/*******************************************************************************
+*      Function: balanceFinish()
+*   Description: Records the outcome of the connection made by balanceConnect.
+*    Parameters: struct balancer *b - The balancer.
+*                int ok - Nonzero if the transfer succeeded.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void balanceFinish(struct balancer *b, int ok) {
+    if (b->current < 0) {
+        return;
+    }
+    balanceRecord(b, b->current, ok);
+    b->current = -1;
+}
+
+/*******************************************************************************
+*      Function: balanceClose()
+*   Description: Unmaps and closes the state file.
+*    Parameters: struct balancer *b - The balancer.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void balanceClose(struct balancer *b) {
+    if (b->state) {
+        munmap(b->state, sizeof(*b->state));
+        b->state = NULL;
+    }
+    if (b->fd >= 0) {
+        close(b->fd);
+        b->fd = -1;
+    }
+}
@@ -0,0 +1,85 @@
+/*******************************************************************************
+*      Filename: balance_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for balance_utils.c. Please see
+*                balance_utils.c for more details.
+*******************************************************************************/
+
+#ifndef BALANCE_UTILS_H
+#define BALANCE_UTILS_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "socket_utils.h"
+
+#define BALANCE_P2C            0     /* The less loaded of two random picks */
+#define BALANCE_LOR            1     /* The least outstanding requests */
+
+#define BALANCE_ENDPOINTS_MAX 16     /* The most endpoints in a list */
+#define BALANCE_NAME_MAX      48     /* The longest host:port name, with NUL */
+#define BALANCE_SLOTS         64     /* Endpoints held in the state file */
+#define BALANCE_ACTIVE_MAX    16     /* Clients counted per endpoint */
+#define BALANCE_DOWN_MS     1000     /* The first failure's hold down time,
+                                      * doubled for each further failure */
+#define BALANCE_DOWN_MAX_MS 30000    /* The longest hold down time */
+#define BALANCE_STATE_DEFAULT "/tmp/otp_balance" /* The state file, suffixed
+                                                  * with the user ID */
+#define BALANCE_MAGIC 0x4250544fU    /* "OTPB", marks an initialised file */
+
+/* An endpoint's health and load, shared through the state file */
+struct balanceSlot {
+    char name[BALANCE_NAME_MAX];     /* The host:port name, empty if free */
+    uint32_t failures;               /* Consecutive failures */
+    uint64_t downUntil;              /* Monotonic ms until the endpoint is
+                                      * tried again, 0 if healthy */
+    int32_t active[BALANCE_ACTIVE_MAX]; /* The client processes using it */
+};
+
+/* The state file's layout */
+struct balanceState {
+    uint32_t magic;                  /* BALANCE_MAGIC */
+    uint32_t slots;                  /* BALANCE_SLOTS */
+    struct balanceSlot slot[BALANCE_SLOTS];
+};
+
+/* An endpoint in the client's list */
+struct balanceEndpoint {
+    char name[BALANCE_NAME_MAX];     /* The host:port name */
+    char host[BALANCE_NAME_MAX];     /* The host, empty for this host */
+    char port[8];                    /* The port string */
+    int tried;                       /* Nonzero once tried by this connect */
+    int resolved;                    /* Nonzero once addrs is filled in */
+    struct clientAddrs addrs;        /* The endpoint's addresses */
+};
+
+/* A client's view of its endpoints */
+struct balancer {
+    struct balanceEndpoint endpoint[BALANCE_ENDPOINTS_MAX];
+    int count;                       /* The number of endpoints */
+    int policy;                      /* BALANCE_P2C or BALANCE_LOR */
+    int fd;                          /* The state file, -1 if stateless */
+    struct balanceState *state;      /* The mapped state, NULL if stateless */
+    int current;                     /* The connected endpoint, -1 if none */
+    unsigned seed;                   /* The random pick seed */
+    int profile;                     /* The OTP_PROFILE of connections */
+};
+
+int balanceInit(struct balancer *, const char *, int, const char *, int);
+int balanceConnect(struct balancer *);
+void balanceFinish(struct balancer *, int);
+void balanceClose(struct balancer *);
+
+#endif
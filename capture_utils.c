@@ -0,0 +1,274 @@
+/*******************************************************************************
+*      Filename: capture_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Records a sample of the traffic a daemon receives, for
+*                otp_replay to play back. Whole connections are sampled, one in
+*                every so many in accept order, so that a replayed connection
+*                sends its frames in sequence. Each message received on a
+*                sampled connection is written as one record: its arrival
+*                time, its length and the frame header or packet delimiters.
+*                The message itself, text and key alike, is only written if
+*                payloads were asked for; otherwise otp_replay sends random
+*                symbols of the same alphabet, encoding and length.
+*
+*                Every process serving the port appends to the same file. A
+*                record and its payload are written with a single writev() to
+*                a file opened with O_APPEND, so records never interleave.
+*******************************************************************************/
+
+#include "capture_utils.h"
+#include "cipher_utils.h"
+#include "msg_utils.h"
+#include "time_utils.h"
+
+/* State shared by every process serving the port */
+struct captureShared {
+    uint64_t start;      /* The time the capture started */
+    uint64_t conns;      /* Connections accepted */
+};
+
+static struct captureShared *captureState = NULL; /* NULL if disabled */
+static int captureFd = -1;           /* The capture file */
+static int captureOneIn = 1;         /* The sampling interval */
+static int capturePayload = 0;       /* Nonzero to record payloads */
+
+/*******************************************************************************
+*      Function: captureInit()
+*   Description: Creates the capture file and maps the shared state.
+*    Parameters: const char *path - The capture file.
+*                int oneIn - Record one connection in this many.
+*                int payload - Nonzero to record the messages themselves.
+* Preconditions: No child process has been forked yet.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int captureInit(const char *path, int oneIn, int payload) {
+    struct captureFileHeader header = {0};
+    void *region;
+
+    captureFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+    if (captureFd < 0) {
+        perror("captureInit: open");
+        return -1;
+    }
+    header.magic = CAPTURE_MAGIC;
+    header.version = CAPTURE_VERSION;
+    header.flags = payload ? CAPTURE_PAYLOAD : 0;
+    header.oneIn = oneIn;
+    if (write(captureFd, &header, sizeof(header)) != sizeof(header)) {
+        perror("captureInit: write");
+        close(captureFd);
+        return -1;
+    }
+
+    region = mmap(NULL, sizeof(struct captureShared), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("captureInit: mmap");
+        close(captureFd);
+        return -1;
+    }
+    captureState = region;
+    captureState->start = timeNowNs();
+    captureOneIn = oneIn;
+    capturePayload = payload;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: captureConnection()
+*   Description: Numbers an accepted connection and decides whether it is
+*                recorded.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The connection number if it is recorded, 0 otherwise.
+*******************************************************************************/
+
+uint64_t captureConnection() {
+    uint64_t conn;
+
+    if (!captureState) {
+        return 0;
+    }
+    conn = __atomic_add_fetch(&captureState->conns, 1, __ATOMIC_RELAXED);
+    return (conn - 1) % captureOneIn == 0 ? conn : 0;
+}
+
+/*******************************************************************************
+*      Function: captureMessage()
+*   Description: Records a message received on a sampled connection.
+*    Parameters: uint64_t conn - The connection number, 0 if not recorded.
+*                uint64_t arrival - The time the message arrived.
+*                const char *msg - The message, before it is processed.
+*                int len - The message length.
+* Preconditions: The message is a complete packet or frame.
+*       Returns: None.
+*******************************************************************************/
+
+void captureMessage(uint64_t conn, uint64_t arrival, const char *msg,
+                    int len) {
+    struct captureRecord rec = {0};
+    struct iovec iov[2];
+
+    if (!conn || !captureState || len <= 0) {
+        return;
+    }
+    rec.conn = conn;
+    rec.arrivalNs = arrival - captureState->start;
+    rec.bytes = len;
+    if (msg[0] == OTP_FRAME_MAGIC) {
+        memcpy(rec.head, msg, OTP_FRAME_HEADER_BYTES);
+    } else {
+        rec.head[0] = msg[0];
+        rec.head[1] = msg[len - 1];
+    }
+    if (capturePayload) {
+        rec.payload = len;
+    }
+
+    iov[0].iov_base = &rec;
+    iov[0].iov_len = sizeof(rec);
+    iov[1].iov_base = (void *)msg;
+    iov[1].iov_len = len;
+    if (writev(captureFd, iov, capturePayload ? 2 : 1) < 0) {
+        perror("captureMessage: writev");
+    }
+}
+
+/*******************************************************************************
+*      Function: captureReadHeader()
+*   Description: Reads and checks a capture file's header.
+*    Parameters: int fd - The capture file, at its start.
+*                struct captureFileHeader *header - The header to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 if the file is not a capture file.
+*******************************************************************************/
+
+int captureReadHeader(int fd, struct captureFileHeader *header) {
+    if (read(fd, header, sizeof(*header)) != sizeof(*header) ||
+        header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION) {
+        fprintf(stderr, "captureReadHeader: not a capture file\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: captureReadRecord()
+*   Description: Reads the next record, skipping over its payload.
+*    Parameters: int fd - The capture file.
+*                struct captureRecord *rec - The record to fill in.
+*                off_t *payloadOffset - Set to the payload's file offset.
+* Preconditions: The header has been read.
+*       Returns: 1 on success, 0 at the end of the file, -1 on error.
+*******************************************************************************/
+
+int captureReadRecord(int fd, struct captureRecord *rec,
+                      off_t *payloadOffset) {
+    ssize_t n;
+
+    n = read(fd, rec, sizeof(*rec));
+    if (n == 0) {
+        return 0;
+    }
+    if (n != sizeof(*rec) || (rec->payload && rec->payload != rec->bytes)) {
+        fprintf(stderr, "captureReadRecord: truncated or corrupt record\n");
+        return -1;
+    }
+    *payloadOffset = lseek(fd, 0, SEEK_CUR);
+    if (*payloadOffset < 0 || lseek(fd, rec->payload, SEEK_CUR) < 0) {
+        perror("captureReadRecord: lseek");
+        return -1;
+    }
+    return 1;
+}
+
+/*******************************************************************************
+*      Function: captureFill()
+*   Description: Fills a buffer with random symbols of an alphabet, or random
+*                bytes for the binary cipher.
+*    Parameters: char *buf - The buffer.
+*                int len - The number of symbols.
+*                int cipher - The frame cipher.
+*                uint64_t *state - The generator state.
+* Preconditions: The cipher is valid.
+*       Returns: None.
+*******************************************************************************/
+
+void captureFill(char *buf, int len, int cipher, uint64_t *state) {
+    const struct otpAlphabet *alphabet = alphabetByCipher(cipher);
+    uint64_t x = *state;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = alphabet ? alphabet->symbol[(x >> 32) % alphabet->size] :
+                            (char)(x >> 32);
+    }
+    *state = x;
+}
+
+/*******************************************************************************
+*      Function: captureSynthesize()
+*   Description: Builds a stand-in for a message recorded without its payload.
+*                Its header, length, alphabet and encoding match the original;
+*                its text and key are random symbols.
+*    Parameters: const struct captureRecord *rec - The record.
+*                char *buf - A buffer of at least rec->bytes bytes.
+*                uint64_t seed - The generator seed, so that each replay
+*                                sends the same bytes.
+* Preconditions: None.
+*       Returns: 0 on success, -1 if the record describes no valid message.
+*******************************************************************************/
+
+int captureSynthesize(const struct captureRecord *rec, char *buf,
+                      uint64_t seed) {
+    struct otpFrameHeader header;
+    uint64_t state = seed * 0x9e3779b97f4a7c15ULL + 1;
+    char *chars;
+    int len, segmentBytes;
+
+    if (rec->head[0] != OTP_FRAME_MAGIC) {
+        /* A delimited packet: mode, text, delimiter, key, delimiters */
+        len = ((int)rec->bytes - OTP_DELIMITER_BYTES - OTP_HEADER_BYTES) / 2;
+        if (len <= 0 || segmentToPacketLen(len) != (int)rec->bytes ||
+            (rec->head[1] != OTP_CONT_DELIM && rec->head[1] != OTP_END_DELIM)) {
+            return -1;
+        }
+        buf[0] = rec->head[0];
+        captureFill(&buf[1], len, OTP_CIPHER_TEXT, &state);
+        buf[1 + len] = OTP_DELIMITER;
+        captureFill(&buf[2 + len], len, OTP_CIPHER_TEXT, &state);
+        buf[2 + 2 * len] = OTP_DELIMITER;
+        buf[3 + 2 * len] = rec->head[1];
+        return 0;
+    }
+
+    if (frameHeaderUnpack(rec->head, &header) < 0 ||
+        segmentToFrameLen(header.len, header.flags) != (int)rec->bytes) {
+        return -1;
+    }
+    memcpy(buf, rec->head, OTP_FRAME_HEADER_BYTES);
+    buf += OTP_FRAME_HEADER_BYTES;
+    if (!(header.flags & OTP_FRAME_PACKED)) {
+        captureFill(buf, 2 * header.len, header.cipher, &state);
+        return 0;
+    }
+
+    /* Packed segments are packed from a scratch copy */
+    segmentBytes = frameSegmentBytes(header.len, header.flags);
+    chars = malloc(header.len > 0 ? header.len : 1);
+    if (!chars) {
+        perror("captureSynthesize: malloc");
+        return -1;
+    }
+    captureFill(chars, header.len, header.cipher, &state);
+    framePackSymbols(chars, header.len, (unsigned char *)buf);
+    captureFill(chars, header.len, header.cipher, &state);
+    framePackSymbols(chars, header.len, (unsigned char *)&buf[segmentBytes]);
+    free(chars);
+    return 0;
+}
@@ -0,0 +1,54 @@
+/*******************************************************************************
+*      Filename: capture_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for capture_utils.c. Please see
+*                capture_utils.c for more details.
+*******************************************************************************/
+
+#ifndef CAPTURE_UTILS_H
+#define CAPTURE_UTILS_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define CAPTURE_MAGIC     0x5250544fU  /* "OTPR", starts a capture file */
+#define CAPTURE_VERSION   1            /* The capture file format version */
+#define CAPTURE_PAYLOAD   0x01         /* Records carry the received bytes */
+#define CAPTURE_HEAD_BYTES 24          /* Message bytes kept in every record */
+
+/* The start of a capture file */
+struct captureFileHeader {
+    uint32_t magic;      /* CAPTURE_MAGIC */
+    uint32_t version;    /* CAPTURE_VERSION */
+    uint32_t flags;      /* CAPTURE_PAYLOAD if payloads were recorded */
+    uint32_t oneIn;      /* One connection in this many was recorded */
+};
+
+/* A received message. A frame keeps its header, which holds no pad material;
+ * a delimited packet keeps its mode and final delimiter. */
+struct captureRecord {
+    uint64_t conn;       /* The connection, numbered from 1 in accept order */
+    uint64_t arrivalNs;  /* The arrival time since the capture started */
+    uint32_t bytes;      /* The message length */
+    uint32_t payload;    /* Bytes of the message that follow the record,
+                          * 0 or bytes */
+    char head[CAPTURE_HEAD_BYTES]; /* The frame header, or the packet's first
+                                    * and last bytes */
+};
+
+int captureInit(const char *, int, int);
+uint64_t captureConnection();
+void captureMessage(uint64_t, uint64_t, const char *, int);
+int captureReadHeader(int, struct captureFileHeader *);
+int captureReadRecord(int, struct captureRecord *, off_t *);
+int captureSynthesize(const struct captureRecord *, char *, uint64_t);
+
+#endif
@@ -1,24 +1,134 @@
 /*******************************************************************************
 *      Filename: cipher_utils.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: Provides utilities for enciphering and deciphering one-time pad
-*                characters.
+*                characters, and the alphabets they are drawn from.
 *******************************************************************************/
 
 #include "cipher_utils.h"
 
+/* Each alphabet is two ranges of characters, given as the first character, the
+ * last character and the value of the first, for both ranges in turn. An
+ * alphabet of a single range repeats it. These definitions are the only
+ * description of the alphabets: keygen, the pads, the packed encoding and the
+ * cipher all use the tables built from them. */
+#define ALPHA_TEXT     'A', 'Z', 0, ' ', ' ', 26
+#define ALPHA_ASCII95  ' ', '~', 0, ' ', '~', 0
+#define ALPHA_DIGITS   '0', '9', 0, '0', '9', 0
+
+/* The symbol value of a character, or -1 */
+#define ALPHA_VALUE(c, f0, l0, v0, f1, l1, v1) \
+    ((c) >= (f0) && (c) <= (l0) ? (c) - (f0) + (v0) : \
+     (c) >= (f1) && (c) <= (l1) ? (c) - (f1) + (v1) : -1)
+
+/* The character of a symbol value, or 0 */
+#define ALPHA_SYMBOL(v, f0, l0, v0, f1, l1, v1) \
+    ((v) >= (v0) && (v) <= (v0) + (l0) - (f0) ? (v) - (v0) + (f0) : \
+     (v) >= (v1) && (v) <= (v1) + (l1) - (f1) ? (v) - (v1) + (f1) : 0)
+
+/* The number of symbols */
+#define ALPHA_SIZE_OF(f0, l0, v0, f1, l1, v1) \
+    ((v0) + (l0) - (f0) > (v1) + (l1) - (f1) ? (v0) + (l0) - (f0) + 1 : \
+                                               (v1) + (l1) - (f1) + 1)
+
+#define ALPHA_RANGES_OF(f0, l0, v0, f1, l1, v1) {{f0, l0, v0}, {f1, l1, v1}}
+#define ALPHA_RANGES(...) ALPHA_RANGES_OF(__VA_ARGS__)
+#define ALPHA_SIZE(...)   ALPHA_SIZE_OF(__VA_ARGS__)
+
+/* Expand a list of ranges before it is split into arguments */
+#define ALPHA_APPLY(m, x, ...) m(x, __VA_ARGS__)
+
+/* Evaluate f at 64 or 256 consecutive integers, at compile time */
+#define ALPHA_T4(f, n)   f(n), f((n) + 1), f((n) + 2), f((n) + 3)
+#define ALPHA_T16(f, n)  ALPHA_T4(f, n), ALPHA_T4(f, (n) + 4), \
+                         ALPHA_T4(f, (n) + 8), ALPHA_T4(f, (n) + 12)
+#define ALPHA_T64(f, n)  ALPHA_T16(f, n), ALPHA_T16(f, (n) + 16), \
+                         ALPHA_T16(f, (n) + 32), ALPHA_T16(f, (n) + 48)
+#define ALPHA_T256(f)    ALPHA_T64(f, 0), ALPHA_T64(f, 64), \
+                         ALPHA_T64(f, 128), ALPHA_T64(f, 192)
+#define ALPHA_T128(f)    ALPHA_T64(f, 0), ALPHA_T64(f, 64)
+
+#define TEXT_VALUE(c)     ALPHA_APPLY(ALPHA_VALUE, c, ALPHA_TEXT)
+#define TEXT_SYMBOL(v)    ALPHA_APPLY(ALPHA_SYMBOL, v, ALPHA_TEXT)
+#define ASCII95_VALUE(c)  ALPHA_APPLY(ALPHA_VALUE, c, ALPHA_ASCII95)
+#define ASCII95_SYMBOL(v) ALPHA_APPLY(ALPHA_SYMBOL, v, ALPHA_ASCII95)
+#define DIGITS_VALUE(c)   ALPHA_APPLY(ALPHA_VALUE, c, ALPHA_DIGITS)
+#define DIGITS_SYMBOL(v)  ALPHA_APPLY(ALPHA_SYMBOL, v, ALPHA_DIGITS)
+
+static const signed char textValues[256] = { ALPHA_T256(TEXT_VALUE) };
+static const char textSymbols[OTP_ALPHABET_MAX] = { ALPHA_T128(TEXT_SYMBOL) };
+static const signed char ascii95Values[256] = { ALPHA_T256(ASCII95_VALUE) };
+static const char ascii95Symbols[OTP_ALPHABET_MAX] = { 
+    ALPHA_T128(ASCII95_SYMBOL) 
+};
+static const signed char digitsValues[256] = { ALPHA_T256(DIGITS_VALUE) };
+static const char digitsSymbols[OTP_ALPHABET_MAX] = { 
+    ALPHA_T128(DIGITS_SYMBOL) 
+};
+
+const struct otpAlphabet otpAlphabets[] = {
+    {"text", OTP_CIPHER_TEXT, ALPHA_SIZE(ALPHA_TEXT), 
+     ALPHA_RANGES(ALPHA_TEXT), textValues, textSymbols},
+    {"ascii95", OTP_CIPHER_ASCII95, ALPHA_SIZE(ALPHA_ASCII95), 
+     ALPHA_RANGES(ALPHA_ASCII95), ascii95Values, ascii95Symbols},
+    {"digits", OTP_CIPHER_DIGITS, ALPHA_SIZE(ALPHA_DIGITS), 
+     ALPHA_RANGES(ALPHA_DIGITS), digitsValues, digitsSymbols},
+    {NULL, 0, 0, {{0, 0, 0}}, NULL, NULL}
+};
+
+/*******************************************************************************
+*      Function: alphabetByName()
+*   Description: Finds an alphabet by name.
+*    Parameters: const char *name - The alphabet name.
+* Preconditions: None.
+*       Returns: The alphabet, or NULL if there is none by that name.
+*******************************************************************************/
+
+const struct otpAlphabet *alphabetByName(const char *name) {
+    const struct otpAlphabet *a;
+
+    for (a = otpAlphabets; a->name; a++) {
+        if (strcmp(a->name, name) == 0) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+*      Function: alphabetByCipher()
+*   Description: Finds the alphabet of a frame cipher.
+*    Parameters: int cipher - The frame cipher.
+* Preconditions: None.
+*       Returns: The alphabet, or NULL if the cipher is not a text cipher.
+*******************************************************************************/
+
+const struct otpAlphabet *alphabetByCipher(int cipher) {
+    const struct otpAlphabet *a;
+
+    for (a = otpAlphabets; a->name; a++) {
+        if (a->cipher == cipher) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
 /*******************************************************************************
 *     Functions: charToInt()
 *   Description: Converts a character to its corresponding 0 - OTP_NUM_CHARS-1
-*                value.
+*                value. A character outside A-Z and space has no value and is
+*                taken as 0, so that it can never index outside the symbols.
 *    Parameters: char c - The character to be converted.
-* Preconditions: The character is in A-Z or is a space.
-*       Returns: The corresponding integer.
+* Preconditions: None.
+*       Returns: The corresponding integer, or 0 for an invalid character.
 *******************************************************************************/
 
 int charToInt(char c) {
-    return c == ' ' ? (OTP_NUM_CHARS - 1) : (c - 'A');
+    int val = textValues[(unsigned char)c];
+
+    return val < 0 ? 0 : val;
 }
 
 /*******************************************************************************
@@ -31,7 +141,7 @@ int charToInt(char c) {
 *******************************************************************************/
 
 char intToChar(int n) {
-    return n == (OTP_NUM_CHARS - 1) ? ' ' : (n + 'A');
+    return textSymbols[n];
 }
 
 /*******************************************************************************
@@ -85,3 +195,179 @@ char encipher(char plainChar, char keyChar) {
     /* Return the character value */
     return intToChar(val);
 }
+
+/* The alphabet kernels compare bytes, which baseline x86 does natively only
+ * 16 at a time. Wider vectors are compared one byte at a time there. */
+#ifdef __AVX2__
+#define OTP_ALPHA_VEC_BYTES 32
+#else
+#define OTP_ALPHA_VEC_BYTES 16
+#endif
+
+typedef unsigned char otpAlphaVec 
+    __attribute__((vector_size(OTP_ALPHA_VEC_BYTES)));
+
+/* An alphabet's ranges and size broadcast to vectors, built once per block */
+struct otpAlphabetVecs {
+    otpAlphaVec first[OTP_ALPHABET_RANGES]; /* The first character of each 
+                                             * range */
+    otpAlphaVec span[OTP_ALPHABET_RANGES];  /* The last less the first */
+    otpAlphaVec value[OTP_ALPHABET_RANGES]; /* The value of each first
+                                             * character */
+    otpAlphaVec size;                       /* The number of symbols */
+};
+
+/*******************************************************************************
+*      Function: alphabetVecs()
+*   Description: Broadcasts an alphabet's ranges and size to vectors.
+*    Parameters: const struct otpAlphabet *a - The alphabet.
+*                struct otpAlphabetVecs *vecs - The vectors to fill in.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void alphabetVecs(const struct otpAlphabet *a, struct otpAlphabetVecs *vecs) {
+    const struct otpAlphabetRange *r;
+    int i, j;
+
+    for (i = 0; i < OTP_ALPHABET_RANGES; i++) {
+        r = &a->range[i];
+        for (j = 0; j < OTP_ALPHA_VEC_BYTES; j++) {
+            vecs->first[i][j] = r->first;
+            vecs->span[i][j] = (unsigned char)(r->last - r->first);
+            vecs->value[i][j] = r->value;
+        }
+    }
+    for (j = 0; j < OTP_ALPHA_VEC_BYTES; j++) {
+        vecs->size[j] = (unsigned char)a->size;
+    }
+}
+
+/*******************************************************************************
+*      Function: alphabetCipherVec()
+*   Description: Enciphers or deciphers a vector of characters. Each character
+*                is converted to its symbol value one range at a time: its
+*                offset from the start of the range is in the range exactly
+*                when it is no greater than the range's span, since smaller
+*                characters wrap around. The values are added or subtracted
+*                modulo the alphabet size and converted back the same way.
+*    Parameters: const struct otpAlphabetVecs *vecs - The alphabet.
+*                otpAlphaVec *text - The text characters, overwritten with
+*                                    the result.
+*                const otpAlphaVec *key - The key characters.
+*                int mode - The cipher mode.
+* Preconditions: Every character is in the alphabet.
+*       Returns: None.
+*******************************************************************************/
+
+void alphabetCipherVec(const struct otpAlphabetVecs *vecs, otpAlphaVec *text,
+                       const otpAlphaVec *key, int mode) {
+    otpAlphaVec textVal = {0}, keyVal = {0}, out = {0};
+    otpAlphaVec off, sum;
+    int i;
+
+    for (i = 0; i < OTP_ALPHABET_RANGES; i++) {
+        off = *text - vecs->first[i];
+        textVal |= (otpAlphaVec)(off <= vecs->span[i]) & 
+                   (off + vecs->value[i]);
+        off = *key - vecs->first[i];
+        keyVal |= (otpAlphaVec)(off <= vecs->span[i]) & 
+                  (off + vecs->value[i]);
+    }
+    if (mode == OTP_ENCIPHER) {
+        sum = textVal + keyVal;
+    } else {
+        sum = textVal - keyVal + vecs->size;
+    }
+    /* Both values are below the size, so one subtraction reduces the sum */
+    sum -= (otpAlphaVec)(sum >= vecs->size) & vecs->size;
+    for (i = 0; i < OTP_ALPHABET_RANGES; i++) {
+        off = sum - vecs->value[i];
+        out |= (otpAlphaVec)(off <= vecs->span[i]) & (off + vecs->first[i]);
+    }
+    *text = out;
+}
+
+/*******************************************************************************
+*      Function: alphabetCipherBlock()
+*   Description: Enciphers or deciphers a block of characters of any alphabet
+*                in place, OTP_ALPHA_VEC_BYTES at a time without branches or
+*                table lookups, so every alphabet costs the same per byte. The
+*                tail is padded into a vector with the first character of the
+*                alphabet.
+*    Parameters: const struct otpAlphabet *a - The alphabet.
+*                char *text - The text block, overwritten with the result.
+*                const char *key - The key block.
+*                int len - The block length.
+*                int mode - The cipher mode.
+* Preconditions: Both blocks hold len characters of the alphabet.
+*       Returns: None.
+*******************************************************************************/
+
+void alphabetCipherBlock(const struct otpAlphabet *a, char *text, 
+                         const char *key, int len, int mode) {
+    struct otpAlphabetVecs vecs;
+    otpAlphaVec textVec, keyVec;
+    int i = 0;
+
+    alphabetVecs(a, &vecs);
+    /* memcpy() permits unaligned blocks and compiles to vector loads */
+    for (; i + OTP_ALPHA_VEC_BYTES <= len; i += OTP_ALPHA_VEC_BYTES) {
+        memcpy(&textVec, &text[i], OTP_ALPHA_VEC_BYTES);
+        memcpy(&keyVec, &key[i], OTP_ALPHA_VEC_BYTES);
+        alphabetCipherVec(&vecs, &textVec, &keyVec, mode);
+        memcpy(&text[i], &textVec, OTP_ALPHA_VEC_BYTES);
+    }
+    if (i < len) {
+        textVec = vecs.first[0];
+        keyVec = vecs.first[0];
+        memcpy(&textVec, &text[i], len - i);
+        memcpy(&keyVec, &key[i], len - i);
+        alphabetCipherVec(&vecs, &textVec, &keyVec, mode);
+        memcpy(&text[i], &textVec, len - i);
+    }
+}
+
+/*******************************************************************************
+*      Function: cipherBlock()
+*   Description: Enciphers or deciphers a block of text characters in place.
+*    Parameters: char *text - The text block, overwritten with the result.
+*                const char *key - The key block.
+*                int len - The block length.
+*                int mode - The cipher mode.
+* Preconditions: Both blocks hold len valid characters.
+*       Returns: None.
+*******************************************************************************/
+
+void cipherBlock(char *text, const char *key, int len, int mode) {
+    alphabetCipherBlock(OTP_ALPHABET_TEXT, text, key, len, mode);
+}
+
+/*******************************************************************************
+*     Functions: xorBlock()
+*   Description: XORs a block of raw bytes with raw key bytes in place. XOR is
+*                its own inverse, so the same kernel enciphers and deciphers.
+*                The block is processed OTP_VEC_BYTES at a time, with a scalar
+*                loop for the remaining tail.
+*    Parameters: char *text - The text block, overwritten with the result.
+*                const char *key - The key block.
+*                int len - The block length in bytes.
+* Preconditions: Both blocks hold at least len bytes.
+*       Returns: None.
+*******************************************************************************/
+
+void xorBlock(char *text, const char *key, int len) {
+    otpVec textVec, keyVec;
+    int i = 0;
+
+    /* memcpy() permits unaligned blocks and compiles to vector loads */
+    for (; i + OTP_VEC_BYTES <= len; i += OTP_VEC_BYTES) {
+        memcpy(&textVec, &text[i], OTP_VEC_BYTES);
+        memcpy(&keyVec, &key[i], OTP_VEC_BYTES);
+        textVec ^= keyVec;
+        memcpy(&text[i], &textVec, OTP_VEC_BYTES);
+    }
+    for (; i < len; i++) {
+        text[i] ^= key[i];
+    }
+}
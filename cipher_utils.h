@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: cipher_utils.h
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The header file for cipher_utils.c. Please see cipher_utils.c for
 *                more details.
 *******************************************************************************/
@@ -9,11 +9,54 @@
 #ifndef CIPHER_UTILS_H
 #define CIPHER_UTILS_H
 
+#include <stddef.h>
+#include <string.h>
+
 #define OTP_ENCIPHER   0    /* Encipher mode constant */
 #define OTP_DECIPHER   1    /* Decipher mode constant */
 #define OTP_NUM_CHARS 27    /* The number of chars in the cipher */
 
+#define OTP_CIPHER_TEXT 0   /* Modular arithmetic over the text characters */
+#define OTP_CIPHER_XOR  1   /* XOR of raw bytes */
+#define OTP_CIPHER_ASCII95 2 /* Modular arithmetic over printable ASCII */
+#define OTP_CIPHER_DIGITS  3 /* Modular arithmetic over decimal digits */
+#define OTP_VEC_BYTES  32   /* The width of the vector kernels in bytes */
+
+#define OTP_ALPHABET_RANGES 2   /* Character ranges per alphabet */
+#define OTP_ALPHABET_MAX  128   /* The most symbols in an alphabet */
+
+/* A vector of OTP_VEC_BYTES bytes. The compiler lowers operations on it to the
+ * widest instructions the target supports. */
+typedef unsigned char otpVec __attribute__((vector_size(OTP_VEC_BYTES)));
+
+/* A run of consecutive characters with consecutive symbol values */
+struct otpAlphabetRange {
+    unsigned char first;          /* The first character */
+    unsigned char last;           /* The last character */
+    unsigned char value;          /* The symbol value of the first character */
+};
+
+/* The characters of a text cipher */
+struct otpAlphabet {
+    const char *name;             /* The alphabet name */
+    int cipher;                   /* The frame cipher that selects it */
+    int size;                     /* The number of symbols */
+    struct otpAlphabetRange range[OTP_ALPHABET_RANGES]; /* Its characters */
+    const signed char *value;     /* Character to symbol value, -1 if none */
+    const char *symbol;           /* Symbol value to character */
+};
+
+/* Every alphabet, ending with a NULL name. The first is the default. */
+extern const struct otpAlphabet otpAlphabets[];
+#define OTP_ALPHABET_TEXT (&otpAlphabets[0])
+
+const struct otpAlphabet *alphabetByName(const char *);
+const struct otpAlphabet *alphabetByCipher(int);
 char decipher(char, char);
 char encipher(char, char);
+void alphabetCipherBlock(const struct otpAlphabet *, char *, const char *, int,
+                         int);
+void cipherBlock(char *, const char *, int, int);
+void xorBlock(char *, const char *, int);
 
 #endif
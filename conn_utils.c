@@ -0,0 +1,163 @@
+/*******************************************************************************
+*      Filename: conn_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: A client side pool of connections to a daemon. The daemon's
+*                addresses are resolved once, and connections can be
+*                established ahead of the first request. A connection whose
+*                message ended with OTP_FRAME_KEEPALIVE goes back to the pool
+*                and serves the next request, so that small messages do not
+*                each pay for a TCP handshake. A pooled connection the daemon
+*                has since closed, as it does once the idle deadline passes,
+*                is found and discarded when it is taken from the pool.
+*******************************************************************************/
+
+#include "conn_utils.h"
+
+/*******************************************************************************
+*      Function: connPoolInit()
+*   Description: Prepares an empty pool for the daemon on this host at a port.
+*    Parameters: struct connPool *pool - The pool.
+*                const char *port - The port string.
+*                int size - The most idle connections kept.
+*                int profile - The OTP_PROFILE of new connections.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int connPoolInit(struct connPool *pool, const char *port, int size,
+                 int profile) {
+    if (size < 1 || size > CONN_POOL_MAX) {
+        fprintf(stderr, "connPoolInit: pool size must be 1 to %d\n",
+                CONN_POOL_MAX);
+        return -1;
+    }
+    if (clientResolve(port, &pool->addrs) < 0) {
+        return -1;
+    }
+    pool->idle = malloc(size * sizeof(int));
+    if (!pool->idle) {
+        perror("connPoolInit: malloc");
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->profile = profile;
+    pool->idleCount = 0;
+    pool->size = size;
+    pool->opened = 0;
+    pool->reused = 0;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: connPoolWarm()
+*   Description: Establishes connections ahead of the first request, until the
+*                pool holds the number requested or is full.
+*    Parameters: struct connPool *pool - The pool.
+*                int count - The idle connections wanted.
+* Preconditions: The pool has been initialized.
+*       Returns: The number of idle connections, -1 if none could be made.
+*******************************************************************************/
+
+int connPoolWarm(struct connPool *pool, int count) {
+    int sockfd;
+
+    if (count > pool->size) {
+        count = pool->size;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (pool->idleCount < count) {
+        sockfd = clientConnectAddrs(&pool->addrs, pool->profile);
+        if (sockfd < 0) {
+            break;
+        }
+        pool->opened++;
+        pool->idle[pool->idleCount++] = sockfd;
+    }
+    count = pool->idleCount;
+    pthread_mutex_unlock(&pool->lock);
+    return count > 0 ? count : -1;
+}
+
+/*******************************************************************************
+*      Function: connPoolGet()
+*   Description: Takes a connection for a request: the most recently used idle
+*                one that is still open, or a new one. A pooled connection that
+*                is readable has been closed by the daemon, or holds data that
+*                no request asked for, and is discarded.
+*    Parameters: struct connPool *pool - The pool.
+* Preconditions: The pool has been initialized.
+*       Returns: The socket file descriptor, -1 on error.
+*******************************************************************************/
+
+int connPoolGet(struct connPool *pool) {
+    char probe;
+    int sockfd = -1;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->idleCount > 0) {
+        sockfd = pool->idle[--pool->idleCount];
+        if (recv(sockfd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pool->reused++;
+            break;
+        }
+        close(sockfd);
+        sockfd = -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (sockfd >= 0) {
+        clientTune(sockfd, pool->profile);
+        return sockfd;
+    }
+    sockfd = clientConnectAddrs(&pool->addrs, pool->profile);
+    if (sockfd >= 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->opened++;
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return sockfd;
+}
+
+/*******************************************************************************
+*      Function: connPoolPut()
+*   Description: Returns a connection after a request. It is kept for the next
+*                request if it may be reused and the pool has room, and is
+*                closed otherwise.
+*    Parameters: struct connPool *pool - The pool.
+*                int sockfd - The connection.
+*                int reusable - Nonzero if the request succeeded and ended
+*                               with OTP_FRAME_KEEPALIVE.
+* Preconditions: The connection was taken from the pool.
+*       Returns: None.
+*******************************************************************************/
+
+void connPoolPut(struct connPool *pool, int sockfd, int reusable) {
+    pthread_mutex_lock(&pool->lock);
+    if (reusable && pool->idleCount < pool->size) {
+        pool->idle[pool->idleCount++] = sockfd;
+        sockfd = -1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (sockfd >= 0) {
+        close(sockfd);
+    }
+}
+
+/*******************************************************************************
+*      Function: connPoolDestroy()
+*   Description: Closes the idle connections and frees the pool.
+*    Parameters: struct connPool *pool - The pool.
+* Preconditions: No connection taken from the pool is outstanding.
+*       Returns: None.
+*******************************************************************************/
+
+void connPoolDestroy(struct connPool *pool) {
+    while (pool->idleCount > 0) {
+        close(pool->idle[--pool->idleCount]);
+    }
+    free(pool->idle);
+    pool->idle = NULL;
+    pthread_mutex_destroy(&pool->lock);
+}
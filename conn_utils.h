@@ -0,0 +1,42 @@
+/*******************************************************************************
+*      Filename: conn_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for conn_utils.c. Please see conn_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef CONN_UTILS_H
+#define CONN_UTILS_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "socket_utils.h"
+
+#define CONN_POOL_MAX 1024  /* The most idle connections a pool keeps */
+
+/* A pool of connections to one daemon, shared by the threads of a client */
+struct connPool {
+    pthread_mutex_t lock;       /* Guards the idle connections and counts */
+    struct clientAddrs addrs;   /* The daemon's addresses, resolved once */
+    int profile;                /* The OTP_PROFILE of new connections */
+    int *idle;                  /* The idle connections, newest last */
+    int idleCount;              /* The number of idle connections */
+    int size;                   /* The most idle connections kept */
+    uint64_t opened;            /* Connections established */
+    uint64_t reused;            /* Requests served by an idle connection */
+};
+
+int connPoolInit(struct connPool *, const char *, int, int);
+int connPoolWarm(struct connPool *, int);
+int connPoolGet(struct connPool *);
+void connPoolPut(struct connPool *, int, int);
+void connPoolDestroy(struct connPool *);
+
+#endif
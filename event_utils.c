@@ -0,0 +1,819 @@
+/*******************************************************************************
+*      Filename: event_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: An epoll event engine for the daemons. A single process serves
+*                every connection with non-blocking sockets, in place of a
+*                forked child per connection. Each connection receives into a
+*                buffer from the pool, which is replaced by a larger one when a
+*                large frame arrives and given back once the reply is sent. When
+*                the pool budget is spent, the connection stops reading until
+*                other connections free buffers, rather than failing.
+*                Complete frames wait in a deficit round robin run queue, so
+*                that a connection sending large frames takes turns with the
+*                others instead of holding the process for a whole transfer.
+*                Every connection has one deadline at a time in a timer wheel:
+*                the idle deadline while no packet or frame has begun, the read
+*                deadline once one has, and the write deadline for the reply.
+*                A connection waiting on the daemon, for memory or for its turn
+*                in the run queue, has none. A connection past its deadline is
+*                closed and counted.
+*                Past the daemon's concurrency limit, an accepted connection is
+*                held without reading from it until a slot frees, and is turned
+*                away busy if none does in time.
+*******************************************************************************/
+
+#include "event_utils.h"
+#include "admit_utils.h"
+#include "capture_utils.h"
+#include "msg_utils.h"
+#include "pool_utils.h"
+#include "stats_utils.h"
+#include "time_utils.h"
+#include "trace_utils.h"
+
+/* The engine state */
+struct evEngine {
+    int epfd;                     /* The epoll instance */
+    int listenfd;                 /* The listening socket */
+    int mode;                     /* The cipher mode */
+    struct evConn *paused;        /* Connections waiting for memory */
+    int freed;                    /* Set when buffers have been freed */
+    struct evConn *readyHead;     /* The run queue of complete frames */
+    struct evConn *readyTail;     /* The last connection in the run queue */
+    int quantum;                  /* Frame bytes added per round */
+    struct otpTimeouts timeouts;  /* The connection deadlines */
+    struct timerWheel wheel;      /* The armed deadlines */
+    struct evConn *heldHead;      /* Connections waiting for admission */
+    struct evConn *heldTail;      /* The last connection waiting */
+    int held;                     /* The number of connections waiting */
+    int queueMs;                  /* How long a connection may wait */
+};
+
+/* The tag identifying the listening socket in epoll events */
+static int evListenTag;
+
+void evRead(struct evEngine *, struct evConn *);
+
+/*******************************************************************************
+*      Function: evSetEvents()
+*   Description: Changes the events a connection is registered for.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+*                int events - The new epoll events.
+* Preconditions: The connection is registered.
+*       Returns: None.
+*******************************************************************************/
+
+void evSetEvents(struct evEngine *eng, struct evConn *c, int events) {
+    struct epoll_event ev = {0};
+
+    if (c->events == events) {
+        return;
+    }
+    ev.events = events;
+    ev.data.ptr = c;
+    if (epoll_ctl(eng->epfd, EPOLL_CTL_MOD, c->fd, &ev) < 0) {
+        perror("evSetEvents: epoll_ctl");
+    }
+    c->events = events;
+}
+
+/*******************************************************************************
+*      Function: evDeadline()
+*   Description: Replaces a connection's deadline.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+*                int type - The STATS_TIMEOUT type of the new deadline.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evDeadline(struct evEngine *eng, struct evConn *c, int type) {
+    int ms;
+
+    switch (type) {
+        case STATS_TIMEOUT_READ:
+            ms = eng->timeouts.readMs;
+            break;
+        case STATS_TIMEOUT_WRITE:
+            ms = eng->timeouts.writeMs;
+            break;
+        default:
+            ms = eng->timeouts.idleMs;
+            break;
+    }
+    if (ms <= 0) {
+        timerCancel(&eng->wheel, &c->timer);
+        return;
+    }
+    c->timerType = type;
+    timerArm(&eng->wheel, &c->timer, timeNowNs() / TIME_NS_PER_MS + ms);
+}
+
+/*******************************************************************************
+*      Function: evRelease()
+*   Description: Returns a connection's buffer to the pool.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evRelease(struct evEngine *eng, struct evConn *c) {
+    if (c->buf) {
+        poolFree(c->buf);
+        c->buf = NULL;
+        eng->freed = 1;
+    }
+}
+
+/*******************************************************************************
+*      Function: evClose()
+*   Description: Closes a connection and releases its state.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The connection is not on the paused list.
+*       Returns: None.
+*******************************************************************************/
+
+void evClose(struct evEngine *eng, struct evConn *c) {
+    timerCancel(&eng->wheel, &c->timer);
+    epoll_ctl(eng->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    shutdown(c->fd, SHUT_RDWR);
+    close(c->fd);
+    evRelease(eng, c);
+    admitRelease(c->admitSlot, getpid());
+    STATS_RECORD(connDuration, timeNowNs() - c->connStart);
+    STATS_ADD(connActive, -1);
+    free(c);
+}
+
+/*******************************************************************************
+*      Function: evUnhold()
+*   Description: Removes a connection from the admission queue.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The held connection.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evUnhold(struct evEngine *eng, struct evConn *c) {
+    struct evConn **link = &eng->heldHead;
+    struct evConn *prev = NULL;
+
+    while (*link && *link != c) {
+        prev = *link;
+        link = &(*link)->nextHeld;
+    }
+    if (!*link) {
+        return;
+    }
+    *link = c->nextHeld;
+    if (eng->heldTail == c) {
+        eng->heldTail = prev;
+    }
+    eng->held--;
+    STATS_ADD(connQueued, -1);
+}
+
+/*******************************************************************************
+*      Function: evReject()
+*   Description: Turns a held connection away busy and releases its state.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The connection is not in the admission queue.
+*       Returns: None.
+*******************************************************************************/
+
+void evReject(struct evEngine *eng, struct evConn *c) {
+    timerCancel(&eng->wheel, &c->timer);
+    epoll_ctl(eng->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    admitReject(c->fd, eng->mode);
+    evRelease(eng, c);
+    STATS_ADD(connActive, -1);
+    free(c);
+}
+
+/*******************************************************************************
+*      Function: evHold()
+*   Description: Queues a connection that found no admission slot, without
+*                reading from it, if the queue has room and it may wait, and
+*                otherwise turns it away at once.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The connection is registered and holds no slot.
+*       Returns: None.
+*******************************************************************************/
+
+void evHold(struct evEngine *eng, struct evConn *c) {
+    c->state = EV_STATE_HELD;
+    evSetEvents(eng, c, 0);
+    if (eng->queueMs > 0 && eng->held < ADMIT_QUEUE_MAX) {
+        c->nextHeld = NULL;
+        if (eng->heldTail) {
+            eng->heldTail->nextHeld = c;
+        } else {
+            eng->heldHead = c;
+        }
+        eng->heldTail = c;
+        eng->held++;
+        STATS_ADD(connQueued, 1);
+        timerArm(&eng->wheel, &c->timer,
+                 timeNowNs() / TIME_NS_PER_MS + eng->queueMs);
+    } else {
+        evReject(eng, c);
+    }
+}
+
+/*******************************************************************************
+*      Function: evAdmit()
+*   Description: Starts serving held connections, in the order they arrived,
+*                while admission slots are free.
+*    Parameters: struct evEngine *eng - The engine.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evAdmit(struct evEngine *eng) {
+    struct evConn *c;
+    int slot;
+
+    while (eng->heldHead) {
+        slot = admitAcquire();
+        if (slot == ADMIT_FULL) {
+            return;
+        }
+        c = eng->heldHead;
+        evUnhold(eng, c);
+        admitAssign(slot, getpid());
+        c->admitSlot = slot;
+        c->state = EV_STATE_READ;
+        evSetEvents(eng, c, EPOLLIN);
+        evDeadline(eng, c, STATS_TIMEOUT_IDLE);
+    }
+}
+
+/*******************************************************************************
+*      Function: evPause()
+*   Description: Stops reading from a connection until buffers are freed. Its
+*                read or idle deadline stays armed, so a connection that never
+*                gets a buffer is still closed.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The pool could not supply the connection's buffer.
+*       Returns: None.
+*******************************************************************************/
+
+void evPause(struct evEngine *eng, struct evConn *c) {
+    evSetEvents(eng, c, 0);
+    c->paused = 1;
+    c->nextPaused = eng->paused;
+    eng->paused = c;
+    STATS_ADD(readPauses, 1);
+}
+
+/*******************************************************************************
+*      Function: evUnpause()
+*   Description: Removes a connection from the paused list.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The paused connection.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evUnpause(struct evEngine *eng, struct evConn *c) {
+    struct evConn **link = &eng->paused;
+
+    while (*link && *link != c) {
+        link = &(*link)->nextPaused;
+    }
+    if (*link) {
+        *link = c->nextPaused;
+    }
+    c->paused = 0;
+}
+
+/*******************************************************************************
+*      Function: evResume()
+*   Description: Retries the paused connections once buffers have been freed.
+*                A connection that still cannot get a buffer pauses again. The
+*                deadline armed before the pause still runs.
+*    Parameters: struct evEngine *eng - The engine.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evResume(struct evEngine *eng) {
+    struct evConn *c, *next;
+
+    if (!eng->freed || !eng->paused) {
+        return;
+    }
+    eng->freed = 0;
+    c = eng->paused;
+    eng->paused = NULL;
+    while (c) {
+        next = c->nextPaused;
+        c->paused = 0;
+        evSetEvents(eng, c, EPOLLIN);
+        evRead(eng, c);
+        c = next;
+    }
+}
+
+/*******************************************************************************
+*      Function: evWrite()
+*   Description: Sends as much of the reply as the socket accepts. Once the
+*                reply is sent, the connection either reads the next packet or
+*                closes.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The connection holds a reply.
+*       Returns: None.
+*******************************************************************************/
+
+void evWrite(struct evEngine *eng, struct evConn *c) {
+    int n;
+
+    while (c->outPos < c->outLen) {
+        n = send(c->fd, &c->out[c->outPos], c->outLen - c->outPos,
+                 MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                evSetEvents(eng, c, EPOLLOUT);
+                return;
+            }
+            STATS_ADD(errors[STATS_ERR_SEND], 1);
+            evClose(eng, c);
+            return;
+        }
+        c->outPos += n;
+    }
+    STATS_ADD(framesOut, 1);
+    STATS_ADD(bytesOut, c->outLen);
+    STATS_RECORD(frameLatency, timeNowNs() - c->frameStart);
+
+    if (!c->continuation) {
+        evClose(eng, c);
+        return;
+    }
+    /* An idle kept-alive connection gives its slot to others between
+     * messages */
+    if (!c->cursor.started && c->cursor.kept) {
+        admitRelease(c->admitSlot, getpid());
+        c->admitSlot = ADMIT_FULL;
+    }
+    /* Large buffers go back to the pool between frames */
+    c->state = EV_STATE_READ;
+    c->have = 0;
+    c->need = 0;
+    if (poolBufSize(c->buf) > EV_BUF_INITIAL) {
+        evRelease(eng, c);
+    }
+    evSetEvents(eng, c, EPOLLIN);
+    evDeadline(eng, c, STATS_TIMEOUT_IDLE);
+}
+
+/*******************************************************************************
+*      Function: evProcess()
+*   Description: Processes a complete packet or frame in place and starts the
+*                reply.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The buffer holds a complete packet or frame.
+*       Returns: None.
+*******************************************************************************/
+
+void evProcess(struct evEngine *eng, struct evConn *c) {
+    struct otpFrameHeader header;
+    uint64_t cipherStart, traceStart;
+    int status;
+
+    cipherStart = timeNowNs();
+    STATS_RECORD(queueWait[c->cls], cipherStart - c->frameStart);
+    captureMessage(c->capture, c->frameStart, c->buf, c->have);
+    traceStart = traceBegin();
+    if (c->buf[0] == OTP_FRAME_MAGIC) {
+        frameHeaderUnpack(c->buf, &header);
+        status = processFrame(&c->buf[OTP_FRAME_HEADER_BYTES], &header);
+        c->continuation = header.flags & (OTP_FRAME_CONT | 
+                                          OTP_FRAME_KEEPALIVE) ? 1 : 0;
+        header.flags &= ~OTP_FRAME_CONT;
+        frameHeaderPack(&header, c->buf);
+        c->out = c->buf;
+        c->outLen = OTP_FRAME_HEADER_BYTES +
+                    frameSegmentBytes(header.len, header.flags);
+        traceEnd("cipherFrame", traceStart);
+    } else {
+        status = processPacket(c->buf, c->have, eng->mode, &c->outLen,
+                               &c->packetOffset);
+        c->continuation = status;
+        c->out = &c->buf[OTP_HEADER_BYTES];
+        traceEnd("processPacket", traceStart);
+    }
+    STATS_ADD(cipherNs, timeNowNs() - cipherStart);
+    if (status < 0) {
+        STATS_ADD(errors[STATS_ERR_CIPHER], 1);
+        evClose(eng, c);
+        return;
+    }
+
+    c->state = EV_STATE_WRITE;
+    c->outPos = 0;
+    evDeadline(eng, c, STATS_TIMEOUT_WRITE);
+    evWrite(eng, c);
+}
+
+/*******************************************************************************
+*      Function: evSchedule()
+*   Description: Adds a connection holding a complete packet or frame to the
+*                run queue. The connection stops reading until it is served.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The buffer holds a complete packet or frame.
+*       Returns: None.
+*******************************************************************************/
+
+void evSchedule(struct evEngine *eng, struct evConn *c) {
+    c->frameStart = timeNowNs();
+    STATS_ADD(framesIn, 1);
+    STATS_ADD(bytesIn, c->have);
+
+    if (c->have > eng->quantum) {
+        c->cls = STATS_CLASS_BULK;
+    }
+    c->state = EV_STATE_READY;
+    evSetEvents(eng, c, 0);
+    timerCancel(&eng->wheel, &c->timer);
+    c->nextReady = NULL;
+    if (eng->readyTail) {
+        eng->readyTail->nextReady = c;
+    } else {
+        eng->readyHead = c;
+    }
+    eng->readyTail = c;
+}
+
+/*******************************************************************************
+*      Function: evRunRound()
+*   Description: Runs one deficit round robin round over the connections in the
+*                run queue. Each connection is owed another quantum of frame
+*                bytes and is served once it is owed its frame's length, so a
+*                frame no larger than the quantum waits at most one round
+*                however large the other frames are. Connections queued during
+*                the round wait for the next one. Rounds in which no frame
+*                would be served are credited at once rather than run.
+*    Parameters: struct evEngine *eng - The engine.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void evRunRound(struct evEngine *eng) {
+    struct evConn *c;
+    struct evConn *last = eng->readyTail;
+    int done = !last;
+    int idle = INT_MAX;
+    int rounds;
+
+    /* Find the rounds that would pass before any frame is served */
+    for (c = eng->readyHead; c; c = c->nextReady) {
+        rounds = (c->have - c->deficit - 1) / eng->quantum;
+        if (rounds < idle) {
+            idle = rounds;
+        }
+    }
+    if (idle > 0 && idle < INT_MAX) {
+        for (c = eng->readyHead; c; c = c->nextReady) {
+            c->deficit += idle * eng->quantum;
+        }
+    }
+
+    while (!done) {
+        c = eng->readyHead;
+        done = c == last;
+        eng->readyHead = c->nextReady;
+        if (!eng->readyHead) {
+            eng->readyTail = NULL;
+        }
+
+        c->deficit += eng->quantum;
+        if (c->deficit < c->have) {
+            c->nextReady = NULL;
+            if (eng->readyTail) {
+                eng->readyTail->nextReady = c;
+            } else {
+                eng->readyHead = c;
+            }
+            eng->readyTail = c;
+            continue;
+        }
+        /* A connection has one frame at a time, so its queue is now empty
+         * and nothing carries over */
+        c->deficit = 0;
+        evProcess(eng, c);
+    }
+}
+
+/*******************************************************************************
+*      Function: evRead()
+*   Description: Receives what the socket holds toward the current packet or
+*                frame. A frame header sets the length to wait for, and the
+*                buffer is replaced by a larger one if the frame needs it. A
+*                kept-alive connection between messages first waits for an
+*                admission slot.
+*    Parameters: struct evEngine *eng - The engine.
+*                struct evConn *c - The connection.
+* Preconditions: The connection is reading.
+*       Returns: None.
+*******************************************************************************/
+
+void evRead(struct evEngine *eng, struct evConn *c) {
+    struct otpFrameHeader header;
+    char *larger;
+    int n, limit, slot;
+
+    /* A kept-alive connection takes a slot again for its next message */
+    if (c->admitSlot == ADMIT_FULL) {
+        slot = admitAcquire();
+        if (slot == ADMIT_FULL) {
+            evHold(eng, c);
+            return;
+        }
+        admitAssign(slot, getpid());
+        c->admitSlot = slot;
+    }
+
+    while (1) {
+        /* Get a buffer large enough for what is expected */
+        if (!c->buf) {
+            c->buf = poolAlloc(EV_BUF_INITIAL);
+            if (!c->buf) {
+                evPause(eng, c);
+                return;
+            }
+        }
+        if (c->need > poolBufSize(c->buf)) {
+            larger = poolAlloc(c->need);
+            if (!larger) {
+                evPause(eng, c);
+                return;
+            }
+            memcpy(larger, c->buf, c->have);
+            evRelease(eng, c);
+            c->buf = larger;
+        }
+
+        limit = c->need ? c->need : OTP_PAYLOAD_MAX;
+        n = recv(c->fd, &c->buf[c->have], limit - c->have, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        /* A kept-alive connection may close between messages */
+        if (n == 0 && !c->have && c->cursor.kept && !c->cursor.started) {
+            evClose(eng, c);
+            return;
+        }
+        if (n <= 0) {
+            STATS_ADD(errors[STATS_ERR_RECV], 1);
+            evClose(eng, c);
+            return;
+        }
+        /* The read deadline runs from the first byte of a packet or frame */
+        if (!c->have) {
+            evDeadline(eng, c, STATS_TIMEOUT_READ);
+        }
+        c->have += n;
+
+        if (c->buf[0] != OTP_FRAME_MAGIC) {
+            /* A delimited packet ends with a final delimiter */
+            if (c->buf[c->have - 1] == OTP_CONT_DELIM ||
+                c->buf[c->have - 1] == OTP_END_DELIM) {
+                evSchedule(eng, c);
+                return;
+            }
+            if (c->have >= OTP_PAYLOAD_MAX) {
+                STATS_ADD(errors[STATS_ERR_FRAME], 1);
+                evClose(eng, c);
+                return;
+            }
+            continue;
+        }
+
+        if (!c->need && c->have >= OTP_FRAME_HEADER_BYTES) {
+            if (frameHeaderUnpack(c->buf, &header) < 0 ||
+                header.mode != eng->mode ||
+                frameCursorAdvance(&c->cursor, &header) < 0) {
+                STATS_ADD(errors[STATS_ERR_FRAME], 1);
+                evClose(eng, c);
+                return;
+            }
+            c->need = segmentToFrameLen(header.len, header.flags);
+        }
+        if (c->need && c->have > c->need) {
+            STATS_ADD(errors[STATS_ERR_FRAME], 1);
+            evClose(eng, c);
+            return;
+        }
+        if (c->need && c->have == c->need) {
+            evSchedule(eng, c);
+            return;
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: evAccept()
+*   Description: Accepts every pending connection. A connection over the
+*                concurrency limit is held if the queue has room and it may
+*                wait, and is otherwise turned away at once.
+*    Parameters: struct evEngine *eng - The engine.
+* Preconditions: The listening socket is non-blocking.
+*       Returns: None.
+*******************************************************************************/
+
+void evAccept(struct evEngine *eng) {
+    struct epoll_event ev = {0};
+    struct evConn *c;
+    uint64_t traceStart;
+    int fd, slot;
+
+    while (1) {
+        traceStart = traceBegin();
+        fd = accept4(eng->listenfd, NULL, NULL, SOCK_NONBLOCK);
+        traceEnd("accept", traceStart);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                perror("accept");
+                STATS_ADD(errors[STATS_ERR_ACCEPT], 1);
+            }
+            return;
+        }
+        c = calloc(1, sizeof(*c));
+        if (!c) {
+            perror("evAccept: calloc");
+            close(fd);
+            continue;
+        }
+        /* Connections that cannot be admitted are not read from, but are
+         * registered so that hangups are noticed */
+        slot = admitAcquire();
+        c->fd = fd;
+        c->state = slot == ADMIT_FULL ? EV_STATE_HELD : EV_STATE_READ;
+        c->events = slot == ADMIT_FULL ? 0 : EPOLLIN;
+        c->admitSlot = slot;
+        c->connStart = timeNowNs();
+        c->capture = captureConnection();
+        ev.events = c->events;
+        ev.data.ptr = c;
+        if (epoll_ctl(eng->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            perror("evAccept: epoll_ctl");
+            admitRelease(slot, ADMIT_RESERVED);
+            close(fd);
+            free(c);
+            continue;
+        }
+        STATS_ADD(connAccepted, 1);
+        STATS_ADD(connActive, 1);
+        if (slot != ADMIT_FULL) {
+            admitAssign(slot, getpid());
+            evDeadline(eng, c, STATS_TIMEOUT_IDLE);
+        } else {
+            evHold(eng, c);
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: evExpire()
+*   Description: Closes a connection whose deadline has passed, or turns away
+*                a held connection that was not admitted in time. A paused
+*                connection leaves the paused list first.
+*    Parameters: struct timerEntry *timer - The connection's timer.
+*                void *arg - The engine.
+* Preconditions: The connection is not in the run queue.
+*       Returns: None.
+*******************************************************************************/
+
+void evExpire(struct timerEntry *timer, void *arg) {
+    struct evConn *c = TIMER_OWNER(timer, struct evConn, timer);
+
+    if (c->state == EV_STATE_HELD) {
+        evUnhold(arg, c);
+        evReject(arg, c);
+        return;
+    }
+    if (c->paused) {
+        evUnpause(arg, c);
+    }
+    STATS_ADD(timeouts[c->timerType], 1);
+    evClose(arg, c);
+}
+
+/*******************************************************************************
+*      Function: eventServe()
+*   Description: Serves connections until the process is killed.
+*    Parameters: int listenfd - The listening socket.
+*                int mode - The cipher mode.
+*                int quantum - Frame bytes a connection may process per
+*                              scheduler round.
+*                const struct otpTimeouts *timeouts - The connection deadlines.
+*                int queueMs - How long a connection over the concurrency
+*                              limit may wait for admission.
+* Preconditions: The listening socket is listening.
+*       Returns: -1 on error. Does not return otherwise.
+*******************************************************************************/
+
+int eventServe(int listenfd, int mode, int quantum, 
+               const struct otpTimeouts *timeouts, int queueMs) {
+    struct epoll_event events[EV_MAX_EVENTS];
+    struct epoll_event ev = {0};
+    struct evEngine eng = {0};
+    struct evConn *c;
+    int i, n, wait;
+
+    eng.listenfd = listenfd;
+    eng.mode = mode;
+    eng.quantum = quantum;
+    eng.timeouts = *timeouts;
+    eng.queueMs = queueMs;
+    timerWheelInit(&eng.wheel, timeNowNs() / TIME_NS_PER_MS);
+
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK) < 0) {
+        perror("eventServe: fcntl");
+        return -1;
+    }
+    eng.epfd = epoll_create1(0);
+    if (eng.epfd < 0) {
+        perror("eventServe: epoll_create1");
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &evListenTag;
+    if (epoll_ctl(eng.epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0) {
+        perror("eventServe: epoll_ctl");
+        return -1;
+    }
+
+    while (1) {
+        /* Only block when no frames are waiting for the scheduler, and no
+         * longer than the next deadline. Held connections retry admission
+         * while slots may free in other processes. */
+        wait = 0;
+        if (!eng.readyHead) {
+            wait = timerWaitMs(&eng.wheel, timeNowNs() / TIME_NS_PER_MS);
+        }
+        if (eng.heldHead && (wait < 0 || wait > ADMIT_POLL_MS)) {
+            wait = ADMIT_POLL_MS;
+        }
+        traceTick();
+        n = epoll_wait(eng.epfd, events, EV_MAX_EVENTS, traceWaitMs(wait));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("eventServe: epoll_wait");
+            return -1;
+        }
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == &evListenTag) {
+                evAccept(&eng);
+                continue;
+            }
+            c = events[i].data.ptr;
+            /* A paused connection only reports errors and hangups */
+            if (c->paused) {
+                evUnpause(&eng, c);
+                STATS_ADD(errors[STATS_ERR_RECV], 1);
+                evClose(&eng, c);
+                continue;
+            }
+            /* A held connection only reports hangups, and is forgotten */
+            if (c->state == EV_STATE_HELD) {
+                evUnhold(&eng, c);
+                evClose(&eng, c);
+                continue;
+            }
+            /* A queued connection is served, or fails, in its turn */
+            if (c->state == EV_STATE_READY) {
+                continue;
+            }
+            if (c->state == EV_STATE_WRITE) {
+                evWrite(&eng, c);
+            } else {
+                evRead(&eng, c);
+            }
+        }
+        timerAdvance(&eng.wheel, timeNowNs() / TIME_NS_PER_MS, evExpire,
+                     &eng);
+        evAdmit(&eng);
+        evResume(&eng);
+        evRunRound(&eng);
+    }
+}
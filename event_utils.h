@@ -0,0 +1,77 @@
+/*******************************************************************************
+*      Filename: event_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for event_utils.c. Please see event_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef EVENT_UTILS_H
+#define EVENT_UTILS_H
+
+/* accept4() is a Linux extension */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "msg_utils.h"
+#include "socket_utils.h"
+#include "timer_utils.h"
+
+#define EV_MAX_EVENTS     64      /* Events handled per epoll_wait() */
+#define EV_BUF_INITIAL  2048      /* A connection's first buffer */
+
+#define EV_STATE_READ      0      /* Receiving a packet or frame */
+#define EV_STATE_WRITE     1      /* Sending a reply */
+#define EV_STATE_READY     2      /* Holding a frame for the scheduler */
+#define EV_STATE_HELD      3      /* Waiting for admission */
+
+#define EV_QUANTUM_DEFAULT 8192   /* Frame bytes a connection may process per
+                                   * scheduler round */
+
+/* A connection served by the event engine */
+struct evConn {
+    int fd;                       /* The socket */
+    int state;                    /* One of the EV states */
+    int events;                   /* The registered epoll events */
+    char *buf;                    /* The pool buffer, NULL until available */
+    int have;                     /* Bytes received into the buffer */
+    int need;                     /* The frame length, 0 until known */
+    int outPos;                   /* Reply bytes sent */
+    int outLen;                   /* The reply length */
+    char *out;                    /* The reply, within the buffer */
+    int continuation;             /* Nonzero if more packets follow */
+    uint64_t connStart;           /* The time the connection was accepted */
+    uint64_t frameStart;          /* The time the current frame arrived */
+    struct evConn *nextPaused;    /* The next connection waiting for memory */
+    int paused;                   /* Nonzero while waiting for memory */
+    struct otpFrameCursor cursor; /* The next frame accepted */
+    struct evConn *nextReady;     /* The next connection in the run queue */
+    int deficit;                  /* Frame bytes the scheduler owes */
+    uint64_t packetOffset;        /* The pad position of the next packet */
+    int cls;                      /* STATS_CLASS_BULK once a frame exceeds the
+                                   * quantum, else STATS_CLASS_INTERACTIVE */
+    uint64_t capture;             /* The capture number, 0 if not recorded */
+    struct timerEntry timer;      /* The connection's deadline */
+    int timerType;                /* The STATS_TIMEOUT type of the deadline */
+    int admitSlot;                /* The admission slot, ADMIT_ANY, or
+                                   * ADMIT_FULL while none is held */
+    struct evConn *nextHeld;      /* The next connection waiting for
+                                   * admission */
+};
+
+int eventServe(int, int, int, const struct otpTimeouts *, int);
+
+#endif
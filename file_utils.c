@@ -1,12 +1,13 @@
 /*******************************************************************************
 *      Filename: file_utils.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: Provides utilities for validating plain/ciphertext and key text
 *                files.
 *******************************************************************************/
 
 #include "file_utils.h"
+#include "pad_utils.h"
 
 /*******************************************************************************
 *      Function: validateFileReg()
@@ -34,16 +35,17 @@ int validateFileReg(struct stat *buf) {
 /*******************************************************************************
 *      Function: validateFileChars()
 *   Description: Validates the characters in a file. Files must contain only
-*                upper case letters, spaces, and at most one POSIX line feed
+*                characters of the alphabet, and at most one POSIX line feed
 *                at the end of the file. Determines the number of non-line feed
 *                characters in the file.
 *    Parameters: FILE *fptr - The file pointer.
+*                const struct otpAlphabet *alphabet - The alphabet.
 * Preconditions: None.
 *       Returns: -1 if invalid characters are present. A nonnegative integer
 *                representing the number of characters, otherwise.
 *******************************************************************************/
 
-int validateFileChars(FILE *fptr) {
+int validateFileChars(FILE *fptr, const struct otpAlphabet *alphabet) {
     int c;
     int count = 0;
     int newlineFound = 0;
@@ -67,7 +69,7 @@ int validateFileChars(FILE *fptr) {
             count++;
         }
         /* If the char isn't valid, return immediately */ 
-        if (!isupper(c) && c != ' ' && c != '\n') {
+        if (alphabet->value[c] < 0 && c != '\n') {
             fprintf(stderr, "Error: Input contains bad characters\n");
             return -1;
         }
@@ -88,12 +90,13 @@ int validateFileChars(FILE *fptr) {
 *      Function: validateFile()
 *   Description: Validates a single file.
 *    Parameters: FILE *fptr - A pointer to the file.
+*                const struct otpAlphabet *alphabet - The alphabet.
 * Preconditions: None.
 *       Returns: The number of non-line feed chars in the file on success, -1
 *                otherwise.
 *******************************************************************************/
 
-int validateFile(FILE *fptr) {
+int validateFile(FILE *fptr, const struct otpAlphabet *alphabet) {
     struct stat buf = {0};
     int fd, size, status;
     /* Test the file pointer */
@@ -115,11 +118,11 @@ int validateFile(FILE *fptr) {
     }
     /* Test file regularity */
     status = validateFileReg(&buf);
-    if (size == -1) {
+    if (status == -1) {
         return -1;
     }
     /* Validate file characters */ 
-    size = validateFileChars(fptr);
+    size = validateFileChars(fptr, alphabet);
     if (size == -1) {
         return -1;
     }
@@ -127,28 +130,86 @@ int validateFile(FILE *fptr) {
     return size;
 }
 
+/*******************************************************************************
+*      Function: validatePad()
+*   Description: Validates a key pad. Packed and indexed pads are checked as
+*                they are read, so their length is taken from the header.
+*    Parameters: struct otpPad *keyPad - The opened key pad.
+*                const struct otpAlphabet *alphabet - The alphabet of a text
+*                                                     pad.
+* Preconditions: None.
+*       Returns: The number of key characters on success, -1 otherwise.
+*******************************************************************************/
+
+int validatePad(struct otpPad *keyPad, const struct otpAlphabet *alphabet) {
+    if (keyPad->format != PAD_FORMAT_TEXT) {
+        return keyPad->length > INT_MAX ? INT_MAX : (int)keyPad->length;
+    }
+    return validateFile(keyPad->fptr, alphabet);
+}
+
+/*******************************************************************************
+*      Function: validateChunk()
+*   Description: Validates a chunk of streamed text under the same rules as
+*                validateFileChars(): characters of the alphabet, with at
+*                most one line feed, which must end the stream.
+*    Parameters: const char *buf - The chunk.
+*                int len - The chunk length.
+*                int *newlineFound - Set once the line feed has been seen, 
+*                                    carried from chunk to chunk.
+*                const struct otpAlphabet *alphabet - The alphabet.
+* Preconditions: None.
+*       Returns: The number of characters ahead of any line feed, or -1 if 
+*                invalid characters are present.
+*******************************************************************************/
+
+int validateChunk(const char *buf, int len, int *newlineFound,
+                  const struct otpAlphabet *alphabet) {
+    int i, count = 0;
+
+    for (i = 0; i < len; i++) {
+        if (*newlineFound) {
+            fprintf(stderr, "Error: Input contains bad characters\n");
+            return -1;
+        }
+        if (buf[i] == '\n') {
+            *newlineFound = 1;
+            continue;
+        }
+        if (alphabet->value[(unsigned char)buf[i]] < 0) {
+            fprintf(stderr, "Error: Input contains bad characters\n");
+            return -1;
+        }
+        count++;
+    }
+    return count;
+}
+
 /*******************************************************************************
 *      Function: validateFiles()
 *   Description: Validates text and key files, storing the number of characters
 *                to be processed in each file in integers passed by pointer.
+*                The length of a packed or indexed pad is taken from its header.
 *    Parameters: FILE *ptextPtr - The text file pointer.
-*                FILE *keyPtr - The key file pointer.
+*                struct otpPad *keyPad - The opened key pad.
 *                int *ptextSize - The text file size pointer.
 *                int *keySize - The key file size pointer.
+*                const struct otpAlphabet *alphabet - The alphabet.
 * Preconditions: None.
 *       Returns: 0 on success, -1 otherwise.
 *******************************************************************************/
 
-int validateFiles(FILE *ptextPtr, FILE *keyPtr, int *ptextSize, int *keySize) {
+int validateFiles(FILE *ptextPtr, struct otpPad *keyPad, int *ptextSize, 
+                  int *keySize, const struct otpAlphabet *alphabet) {
     int status;
  
     /* Validate the text file */ 
-    *ptextSize = validateFile(ptextPtr);
+    *ptextSize = validateFile(ptextPtr, alphabet);
     if (*ptextSize == -1) {
         return -1;
     }
     /* Validate the key file */
-    *keySize = validateFile(keyPtr);
+    *keySize = validatePad(keyPad, alphabet);
     if (*keySize == -1) {
         return -1;
     }
@@ -160,3 +221,210 @@ int validateFiles(FILE *ptextPtr, FILE *keyPtr, int *ptextSize, int *keySize) {
 
     return 0;
 }
+
+/*******************************************************************************
+*      Function: validateFileSize()
+*   Description: Validates a single binary file. Any byte value is allowed, so
+*                only the file type and length are checked.
+*    Parameters: FILE *fptr - A pointer to the file.
+* Preconditions: None.
+*       Returns: The number of bytes in the file on success, -1 otherwise.
+*******************************************************************************/
+
+int validateFileSize(FILE *fptr) {
+    struct stat buf = {0};
+    int fd;
+
+    if (!fptr) {
+        fprintf(stderr, "validateFileSize: NULL ptr argument\n");
+        return -1;
+    }
+    fd = fileno(fptr);
+    if (fd == -1) {
+        perror("validateFileSize: fileno");
+        return -1;
+    }
+    if (fstat(fd, &buf) == -1) {
+        perror("validateFileSize: fstat");
+        return -1;
+    }
+    if (validateFileReg(&buf) == -1) {
+        return -1;
+    }
+    if (buf.st_size > INT_MAX) {
+        fprintf(stderr, "Error: file is too large\n");
+        return -1;
+    }
+
+    return (int)buf.st_size;
+}
+
+/*******************************************************************************
+*      Function: validateBinaryFiles()
+*   Description: Validates binary text and key files, storing the number of
+*                bytes to be processed in each file in integers passed by 
+*                pointer.
+*    Parameters: FILE *ptextPtr - The text file pointer.
+*                struct otpPad *keyPad - The opened raw key pad.
+*                int *ptextSize - The text file size pointer.
+*                int *keySize - The key file size pointer.
+* Preconditions: None.
+*       Returns: 0 on success, -1 otherwise.
+*******************************************************************************/
+
+int validateBinaryFiles(FILE *ptextPtr, struct otpPad *keyPad, int *ptextSize, 
+                        int *keySize) {
+    *ptextSize = validateFileSize(ptextPtr);
+    if (*ptextSize == -1) {
+        return -1;
+    }
+    *keySize = validateFileSize(keyPad->fptr);
+    if (*keySize == -1) {
+        return -1;
+    }
+    if (*ptextSize > *keySize) {
+        fprintf(stderr, "Error: key is too short\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: checkpointLoad()
+*   Description: Reads the checkpoint of an interrupted transfer. A missing
+*                checkpoint file starts the transfer from the beginning.
+*    Parameters: struct otpCheckpoint *ckpt - The checkpoint. The path, mode,
+*                                             cipher and sizes are set by the
+*                                             caller and must match the file.
+* Preconditions: None.
+*       Returns: 0 on success, -1 if the checkpoint is unreadable or belongs to
+*                another transfer.
+*******************************************************************************/
+
+int checkpointLoad(struct otpCheckpoint *ckpt) {
+    char magic[sizeof(CKPT_MAGIC)];
+    long long textSize, keySize, offset;
+    unsigned long seq;
+    int mode, cipher, fields;
+    FILE *fptr;
+
+    ckpt->seq = 0;
+    ckpt->offset = 0;
+    fptr = fopen(ckpt->path, "r");
+    if (!fptr) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        perror("checkpointLoad: fopen");
+        return -1;
+    }
+    fields = fscanf(fptr, "%7s %d %d %lld %lld %lu %lld", magic, &mode, 
+                    &cipher, &textSize, &keySize, &seq, &offset);
+    fclose(fptr);
+    if (fields != 7 || strcmp(magic, CKPT_MAGIC) != 0 || offset < 0 ||
+        offset > textSize) {
+        fprintf(stderr, "checkpointLoad: Invalid checkpoint %s\n", 
+                ckpt->path);
+        return -1;
+    }
+    if (mode != ckpt->mode || cipher != ckpt->cipher || 
+        textSize != ckpt->textSize || keySize != ckpt->keySize) {
+        fprintf(stderr, "checkpointLoad: %s belongs to another transfer\n",
+                ckpt->path);
+        return -1;
+    }
+    ckpt->seq = (uint32_t)seq;
+    ckpt->offset = offset;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: checkpointSave()
+*   Description: Records the progress of a transfer. The checkpoint is written
+*                to a temporary file and renamed over the old one, so a crash
+*                leaves either the old or the new checkpoint.
+*    Parameters: const struct otpCheckpoint *ckpt - The checkpoint.
+* Preconditions: The output up to the offset has been flushed.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int checkpointSave(const struct otpCheckpoint *ckpt) {
+    char tmpPath[CKPT_PATH_MAX];
+    FILE *fptr;
+
+    if (snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", ckpt->path) >= 
+        (int)sizeof(tmpPath)) {
+        fprintf(stderr, "checkpointSave: Path too long\n");
+        return -1;
+    }
+    fptr = fopen(tmpPath, "w");
+    if (!fptr) {
+        perror("checkpointSave: fopen");
+        return -1;
+    }
+    fprintf(fptr, "%s %d %d %lld %lld %lu %lld\n", CKPT_MAGIC, ckpt->mode,
+            ckpt->cipher, ckpt->textSize, ckpt->keySize, 
+            (unsigned long)ckpt->seq, ckpt->offset);
+    if (fclose(fptr) == EOF) {
+        perror("checkpointSave: fclose");
+        return -1;
+    }
+    if (rename(tmpPath, ckpt->path) < 0) {
+        perror("checkpointSave: rename");
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: checkpointRemove()
+*   Description: Removes the checkpoint of a completed transfer.
+*    Parameters: const struct otpCheckpoint *ckpt - The checkpoint.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void checkpointRemove(const struct otpCheckpoint *ckpt) {
+    if (unlink(ckpt->path) < 0 && errno != ENOENT) {
+        perror("checkpointRemove: unlink");
+    }
+}
+
+/*******************************************************************************
+*      Function: checkpointRestoreOutput()
+*   Description: Positions the output of a resumed transfer. A regular output
+*                file must hold at least the checkpointed output, and anything
+*                written past the checkpoint is cut off. Other outputs, such as
+*                pipes, simply receive the rest of the message.
+*    Parameters: FILE *outPtr - The output stream.
+*                long long offset - The checkpointed offset.
+* Preconditions: Nothing has been written to the stream.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int checkpointRestoreOutput(FILE *outPtr, long long offset) {
+    struct stat buf = {0};
+    int fd = fileno(outPtr);
+
+    if (offset == 0) {
+        return 0;
+    }
+    if (fstat(fd, &buf) < 0) {
+        perror("checkpointRestoreOutput: fstat");
+        return -1;
+    }
+    if (!S_ISREG(buf.st_mode)) {
+        return 0;
+    }
+    if (buf.st_size < offset) {
+        fprintf(stderr, "Error: output holds less than the checkpoint; "
+                "append to the original output to resume\n");
+        return -1;
+    }
+    if (ftruncate(fd, offset) < 0 || lseek(fd, offset, SEEK_SET) < 0) {
+        perror("checkpointRestoreOutput: ftruncate");
+        return -1;
+    }
+    return 0;
+}
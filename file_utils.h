@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: file_utils.h
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The header file for file_utils.c. Please see file_utils.c for 
 *                more details.
 *******************************************************************************/
@@ -10,12 +10,46 @@
 #define FILE_UTILS_H
 
 #include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
-int validateFiles(FILE *, FILE *, int *, int *);
+#include "cipher_utils.h"
+
+#define CKPT_MAGIC "OTPCKPT"    /* The first word of a checkpoint file */
+#define CKPT_PATH_MAX 4096      /* The longest checkpoint path */
+
+/* The progress of a resumable transfer. The checkpoint file holds a single
+ * line: the magic, mode, cipher, text and key sizes, the next sequence number
+ * and the offset of the first symbol not yet written to the output. */
+struct otpCheckpoint {
+    const char *path;       /* The checkpoint file */
+    int mode;               /* The cipher mode */
+    int cipher;             /* The cipher */
+    long long textSize;     /* The text length */
+    long long keySize;      /* The key length */
+    uint32_t seq;           /* The next frame sequence number */
+    long long offset;       /* Symbols written to the output */
+};
+
+struct otpPad;
+
+int validateFileChars(FILE *, const struct otpAlphabet *);
+int validatePad(struct otpPad *, const struct otpAlphabet *);
+int validateChunk(const char *, int, int *, const struct otpAlphabet *);
+int validateFiles(FILE *, struct otpPad *, int *, int *, 
+                  const struct otpAlphabet *);
+int validateFileSize(FILE *);
+int validateBinaryFiles(FILE *, struct otpPad *, int *, int *);
+int checkpointLoad(struct otpCheckpoint *);
+int checkpointSave(const struct otpCheckpoint *);
+void checkpointRemove(const struct otpCheckpoint *);
+int checkpointRestoreOutput(FILE *, long long);
 
 #endif
@@ -0,0 +1,160 @@
+/*******************************************************************************
+*      Filename: hist_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Provides a lock-free log-linear histogram for latency samples.
+*                Values below HIST_SUB_COUNT are counted exactly; larger values
+*                fall into HIST_SUB_COUNT buckets per power of two, bounding the
+*                relative error of reported percentiles to about 3%.
+*******************************************************************************/
+
+#include "hist_utils.h"
+
+/*******************************************************************************
+*      Function: histIndex()
+*   Description: Maps a sample value to its bucket index.
+*    Parameters: uint64_t v - The sample value.
+* Preconditions: None.
+*       Returns: The bucket index.
+*******************************************************************************/
+
+int histIndex(uint64_t v) {
+    int msb, shift;
+
+    if (v < HIST_SUB_COUNT) {
+        return (int)v;
+    }
+    msb = 63 - __builtin_clzll(v);
+    shift = msb - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + 
+           (int)((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+/*******************************************************************************
+*      Function: histBucketLimit()
+*   Description: Determines the largest value counted by a bucket.
+*    Parameters: int idx - The bucket index.
+* Preconditions: The index is less than HIST_BUCKETS.
+*       Returns: The inclusive upper bound of the bucket.
+*******************************************************************************/
+
+uint64_t histBucketLimit(int idx) {
+    int shift;
+    uint64_t sub;
+
+    if (idx < HIST_SUB_COUNT) {
+        return (uint64_t)idx;
+    }
+    shift = (idx >> HIST_SUB_BITS) - 1;
+    sub = (uint64_t)(idx & (HIST_SUB_COUNT - 1)) | HIST_SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+/*******************************************************************************
+*      Function: histReset()
+*   Description: Clears every count in a histogram.
+*    Parameters: struct hist *h - The histogram.
+* Preconditions: No other thread is updating the histogram.
+*       Returns: None.
+*******************************************************************************/
+
+void histReset(struct hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+/*******************************************************************************
+*      Function: histRecord()
+*   Description: Records a single sample.
+*    Parameters: struct hist *h - The histogram.
+*                uint64_t v - The sample value.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void histRecord(struct hist *h, uint64_t v) {
+    uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+
+    __atomic_fetch_add(&h->buckets[histIndex(v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+
+    /* Raise the maximum unless another update has already exceeded v */
+    while (v > max && !__atomic_compare_exchange_n(&h->max, &max, v, 1,
+                                                   __ATOMIC_RELAXED,
+                                                   __ATOMIC_RELAXED)) {
+        ;
+    }
+}
+
+/*******************************************************************************
+*      Function: histMerge()
+*   Description: Adds the counts of one histogram into another.
+*    Parameters: struct hist *dst - The destination histogram.
+*                const struct hist *src - The source histogram.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void histMerge(struct hist *dst, const struct hist *src) {
+    int i;
+    uint64_t n;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        n = __atomic_load_n(&src->buckets[i], __ATOMIC_RELAXED);
+        if (n) {
+            __atomic_fetch_add(&dst->buckets[i], n, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_fetch_add(&dst->count, 
+                       __atomic_load_n(&src->count, __ATOMIC_RELAXED),
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&dst->sum, __atomic_load_n(&src->sum, __ATOMIC_RELAXED),
+                       __ATOMIC_RELAXED);
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/*******************************************************************************
+*      Function: histPercentile()
+*   Description: Estimates a percentile of the recorded samples.
+*    Parameters: const struct hist *h - The histogram.
+*                double p - The percentile in 0 - 100.
+* Preconditions: None.
+*       Returns: The upper bound of the bucket holding the percentile, capped at
+*                the recorded maximum. 0 if the histogram is empty.
+*******************************************************************************/
+
+uint64_t histPercentile(const struct hist *h, double p) {
+    uint64_t total = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+    uint64_t rank, seen = 0;
+    uint64_t limit;
+    double exact;
+    int i;
+
+    if (total == 0) {
+        return 0;
+    }
+    /* Find the rank of the requested sample, rounding up, so that at least p
+     * percent of the samples are at or below it */
+    exact = p / 100.0 * total;
+    rank = (uint64_t)exact;
+    if (rank < exact) {
+        rank++;
+    }
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > total) {
+        rank = total;
+    }
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        if (seen >= rank) {
+            limit = histBucketLimit(i);
+            return limit < h->max ? limit : h->max;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,36 @@
+/*******************************************************************************
+*      Filename: hist_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for hist_utils.c. Please see hist_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef HIST_UTILS_H
+#define HIST_UTILS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define HIST_SUB_BITS      5                     /* Sub-bucket bits per octave */
+#define HIST_SUB_COUNT     (1 << HIST_SUB_BITS)  /* Sub-buckets per octave */
+#define HIST_BUCKETS       ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+/* A log-linear histogram of nonnegative integer samples. Every update is a
+ * relaxed atomic, so a histogram may be shared between threads or placed in
+ * memory shared between processes. */
+struct hist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+};
+
+void histReset(struct hist *);
+void histRecord(struct hist *, uint64_t);
+void histMerge(struct hist *, const struct hist *);
+uint64_t histPercentile(const struct hist *, double);
+uint64_t histBucketLimit(int);
+
+#endif
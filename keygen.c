@@ -1,15 +1,27 @@
 /*******************************************************************************
 *      Filename: keygen.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: Writes random characters from the uppercase letters and space 
-*                into stdout.
+*                into stdout. With -A, the characters are drawn from another
+*                alphabet. With -b, writes random raw bytes instead for use
+*                with the binary XOR cipher. With -p, writes a packed pad at 5
+*                bits per character. With -i, writes an indexed pad. With -d,
+*                the characters are fetched from a keygen_d daemon instead.
 *******************************************************************************/
 
+#include "cipher_utils.h"
 #include "keygen.h"
+#include "keypool_utils.h"
+#include "pad_utils.h"
 
 int validateKeyLength(char *);
-char generateKeyChar();
+char generateKeyChar(const struct otpAlphabet *);
+char generateKeyByte();
+void generateBinaryKey(int);
+void generatePackedKey(int);
+void generateIndexedKey(int);
+void fetchDaemonKey(const char *, int);
 
 /*******************************************************************************
 *      Function: main()
@@ -21,24 +33,79 @@ char generateKeyChar();
 *******************************************************************************/
 
 int main(int argc, char **argv) {
-    int i, val; 
+    int i, val, opt; 
+    int binary = 0;
+    int packed = 0;
+    int indexed = 0;
+    int usage = 0;
+    const char *daemon = NULL;
+    const struct otpAlphabet *alphabet = OTP_ALPHABET_TEXT;
     /* Seed the random number generator */
     srand(time(NULL));
 
-    /* keygen takes only 1 argument representing the number of chars to 
-     * be generated */
-    if (argc != KEYGEN_ARGS) {
-        fprintf(stderr, "Usage: keygen keylength\n");
+    while (!usage && (opt = getopt(argc, argv, "bpiA:d:")) != -1) {
+        switch (opt) {
+            case 'A':
+                alphabet = alphabetByName(optarg);
+                if (!alphabet) {
+                    usage = 1;
+                }
+                break;
+            case 'd':
+                daemon = optarg;
+                break;
+            case 'b':
+                binary = 1;
+                break;
+            case 'p':
+                packed = 1;
+                break;
+            case 'i':
+                indexed = 1;
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+    /* keygen takes only 1 positional argument representing the number of 
+     * chars to be generated */
+    /* Packed and indexed pads and binary keys hold the default alphabet. A
+     * daemon generates the alphabet it was started with. */
+    if (usage || argc - optind != KEYGEN_ARGS - 1 ||
+        binary + packed + indexed > 1 ||
+        (alphabet != OTP_ALPHABET_TEXT && binary + packed + indexed > 0) ||
+        (daemon && (binary + packed + indexed > 0 ||
+                    alphabet != OTP_ALPHABET_TEXT))) {
+        fprintf(stderr, "Usage: keygen [-b | -p | -i | -A alphabet | "
+                "-d socket_path] keylength\n");
         exit(1);
     }    
     /* Validate the number of chars to be generated*/
-    val = validateKeyLength(argv[1]);
+    val = validateKeyLength(argv[optind]);
     if (val < 0) {
         exit(1);
     }
+    /* Binary keys are raw bytes without a trailing newline */
+    if (binary) {
+        generateBinaryKey(val);
+        return 0;
+    }
+    if (packed) {
+        generatePackedKey(val);
+        return 0;
+    }
+    if (indexed) {
+        generateIndexedKey(val);
+        return 0;
+    }
+    if (daemon) {
+        fetchDaemonKey(daemon, val);
+        return 0;
+    }
     /* Generate each char and output it to stdout */
     for (i = 0; i < val; i++) {
-        printf("%c", generateKeyChar());
+        printf("%c", generateKeyChar(alphabet));
     } 
     printf("\n");
     fflush(stdin);
@@ -79,25 +146,166 @@ int validateKeyLength(char *keylen) {
 /*******************************************************************************
 *      Function: generateKeyChar()
 *   Description: Generates a single character.
-*    Parameters: None.
+*    Parameters: const struct otpAlphabet *alphabet - The alphabet.
 * Preconditions: None.
-*       Returns: A random character in the uppercase letters or space.
+*       Returns: A random character of the alphabet.
 *******************************************************************************/
 
-char generateKeyChar() {
+char generateKeyChar(const struct otpAlphabet *alphabet) {
     /* Note that this will distort the probability distribution away from the
-     * normal distribution due to the fact that KEYGEN_NUM_CHARS does not 
+     * normal distribution due to the fact that the alphabet size does not 
      * (or is unlikely to) divide evenly into RAND_MAX. Also note that the
      * problem goes deeper, however, in that rand() itself is not guaranteed
      * to produce a uniform distribution. For simplicity's sake, we use
      * this simple method of random generation. If we decide that a uniform
      * distribution is necessary later on, we only need to alter code in
      * this function. */
-    int random = rand() % KEYGEN_NUM_CHARS;
+    return alphabet->symbol[rand() % alphabet->size];
+}
+
+/*******************************************************************************
+*      Function: generateKeyByte()
+*   Description: Generates a single raw key byte.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: A random byte value.
+*******************************************************************************/
 
-    if (random == KEYGEN_NUM_CHARS - 1) {
-        return ' ';
+char generateKeyByte() {
+    /* The same caveats as generateKeyChar() apply. The low bits of some rand()
+     * implementations are weak, so the byte is taken from higher bits. */
+    return (char)((rand() >> 7) & 0xff);
+}
+
+/*******************************************************************************
+*      Function: generateBinaryKey()
+*   Description: Writes a binary key of the requested length to stdout.
+*    Parameters: int len - The number of bytes to write.
+* Preconditions: The length has been validated.
+*       Returns: None.
+*******************************************************************************/
+
+void generateBinaryKey(int len) {
+    char buf[KEYGEN_BUF_BYTES];
+    int i, chunk;
+
+    while (len > 0) {
+        chunk = len < KEYGEN_BUF_BYTES ? len : KEYGEN_BUF_BYTES;
+        for (i = 0; i < chunk; i++) {
+            buf[i] = generateKeyByte();
+        }
+        if (fwrite(buf, 1, chunk, stdout) != (size_t)chunk) {
+            perror("fwrite");
+            exit(1);
+        }
+        len -= chunk;
     }
+    fflush(stdout);
+}
+
+/*******************************************************************************
+*      Function: generatePackedKey()
+*   Description: Writes a packed pad of the requested length to stdout.
+*    Parameters: int len - The number of characters in the pad.
+* Preconditions: The length has been validated.
+*       Returns: None.
+*******************************************************************************/
+
+void generatePackedKey(int len) {
+    char chars[KEYGEN_PACK_SYMBOLS];
+    unsigned char packed[KEYGEN_PACK_SYMBOLS / PACK_GROUP_SYMBOLS * 
+                         PACK_GROUP_BYTES];
+    int i, chunk;
 
-    return 'A' + random;
+    padWriteHeader(stdout, len);
+    while (len > 0) {
+        chunk = len < KEYGEN_PACK_SYMBOLS ? len : KEYGEN_PACK_SYMBOLS;
+        for (i = 0; i < chunk; i++) {
+            chars[i] = generateKeyChar(OTP_ALPHABET_TEXT);
+        }
+        packSymbols(chars, chunk, packed);
+        if (fwrite(packed, 1, packedLen(chunk), stdout) != 
+            (size_t)packedLen(chunk)) {
+            perror("fwrite");
+            exit(1);
+        }
+        len -= chunk;
+    }
+    fflush(stdout);
+}
+
+/*******************************************************************************
+*      Function: generateIndexedKey()
+*   Description: Writes an indexed pad of the requested length to stdout. The
+*                block checksums are gathered as the blocks are written and
+*                follow the symbols.
+*    Parameters: int len - The number of characters in the pad.
+* Preconditions: The length has been validated.
+*       Returns: None.
+*******************************************************************************/
+
+void generateIndexedKey(int len) {
+    char block[PAD_INDEX_BLOCK];
+    long long blocks = ((long long)len + PAD_INDEX_BLOCK - 1) / PAD_INDEX_BLOCK;
+    uint32_t *sums;
+    long long b;
+    int i, chunk;
+
+    sums = malloc(blocks * sizeof(*sums));
+    if (!sums) {
+        perror("malloc");
+        exit(1);
+    }
+    padWriteIndexedHeader(stdout, len, PAD_INDEX_BLOCK);
+    for (b = 0; b < blocks; b++) {
+        chunk = len < PAD_INDEX_BLOCK ? len : PAD_INDEX_BLOCK;
+        for (i = 0; i < chunk; i++) {
+            block[i] = generateKeyChar(OTP_ALPHABET_TEXT);
+        }
+        sums[b] = padChecksum(block, chunk);
+        if (fwrite(block, 1, chunk, stdout) != (size_t)chunk) {
+            perror("fwrite");
+            exit(1);
+        }
+        len -= chunk;
+    }
+    if (padWriteIndex(stdout, sums, blocks) < 0 || fflush(stdout) == EOF) {
+        perror("fwrite");
+        exit(1);
+    }
+    free(sums);
+}
+
+/*******************************************************************************
+*      Function: fetchDaemonKey()
+*   Description: Writes a key of the requested length to stdout, fetched from a
+*                keygen_d daemon.
+*    Parameters: const char *path - The daemon's socket path.
+*                int len - The number of characters in the key.
+* Preconditions: The length has been validated.
+*       Returns: None.
+*******************************************************************************/
+
+void fetchDaemonKey(const char *path, int len) {
+    char buf[KEYGEN_FETCH_SYMBOLS];
+    int fd, chunk;
+
+    fd = keypoolConnect(path);
+    if (fd < 0) {
+        exit(1);
+    }
+    while (len > 0) {
+        chunk = len < KEYGEN_FETCH_SYMBOLS ? len : KEYGEN_FETCH_SYMBOLS;
+        if (keypoolFetch(fd, buf, chunk) < 0) {
+            exit(1);
+        }
+        if (fwrite(buf, 1, chunk, stdout) != (size_t)chunk) {
+            perror("fwrite");
+            exit(1);
+        }
+        len -= chunk;
+    }
+    close(fd);
+    printf("\n");
+    fflush(stdout);
 }
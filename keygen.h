@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: keygen.h
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The header file for keygen.c. Please see keygen.c for more 
 *                details.
 *******************************************************************************/
@@ -16,4 +16,7 @@
 #include <unistd.h>
 
 #define KEYGEN_ARGS       2  /* The number of arguments to keygen */
-#define KEYGEN_NUM_CHARS 27  /* The number of characters in the keygen set */
+#define KEYGEN_BUF_BYTES 4096 /* The binary key output buffer size */
+#define KEYGEN_PACK_SYMBOLS 6144 /* Characters packed per write, a multiple
+                                  * of PACK_GROUP_SYMBOLS */
+#define KEYGEN_FETCH_SYMBOLS 65536 /* Characters fetched per daemon request */
@@ -0,0 +1,509 @@
+/*******************************************************************************
+*      Filename: keygen_d.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The key material daemon. Generator threads keep a pool of
+*                buffers filled with pad symbols drawn from the kernel CSPRNG,
+*                and clients fetch them over a local socket, so a short-lived
+*                pad needs neither a keygen process nor a file. Symbols are
+*                drawn by rejection sampling, so every symbol of the alphabet
+*                is equally likely. Each symbol is handed out once: a buffer is
+*                drained front to back, wiped as it goes, and only refilled
+*                once it is empty.
+*
+*                A client sends the number of symbols it wants, in decimal,
+*                ending with a newline, and reads back exactly that many. The
+*                request "stats" is answered with the pool depth, generation
+*                rate and traffic counters in the format of the daemons' stats
+*                port, after which the connection is closed.
+*******************************************************************************/
+
+#include "keygen_d.h"
+#include "time_utils.h"
+
+/*******************************************************************************
+*      Function: keygenFill()
+*   Description: Fills a buffer with uniformly distributed symbols. Random
+*                bytes at or above the largest multiple of the alphabet size
+*                are discarded, so that the modulus does not favour the first
+*                symbols.
+*    Parameters: const struct otpAlphabet *alphabet - The alphabet.
+*                char *buf - The buffer.
+*                int len - The number of symbols.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int keygenFill(const struct otpAlphabet *alphabet, char *buf, int len) {
+    unsigned char random[KEYGEN_D_RANDOM_BYTES];
+    int limit = 256 - 256 % alphabet->size;
+    int i = 0, j;
+    ssize_t n;
+
+    while (i < len) {
+        n = getrandom(random, sizeof(random), 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("keygenFill: getrandom");
+            return -1;
+        }
+        for (j = 0; j < n && i < len; j++) {
+            if (random[j] < limit) {
+                buf[i++] = alphabet->symbol[random[j] % alphabet->size];
+            }
+        }
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: keygenPoolInit()
+*   Description: Allocates the pool, every buffer of it empty.
+*    Parameters: struct keygenPool *pool - The pool.
+*                const struct otpAlphabet *alphabet - The symbols to generate.
+*                int count - The number of buffers.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int keygenPoolInit(struct keygenPool *pool, const struct otpAlphabet *alphabet,
+                   int count) {
+    int i;
+
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->filled, NULL);
+    pthread_cond_init(&pool->drained, NULL);
+    pool->alphabet = alphabet;
+    pool->count = count;
+    pool->current = -1;
+    pool->start = timeNowNs();
+    pool->bufs = calloc(count, sizeof(*pool->bufs));
+    pool->fullQ = calloc(count, sizeof(int));
+    pool->emptyQ = calloc(count, sizeof(int));
+    if (!pool->bufs || !pool->fullQ || !pool->emptyQ) {
+        perror("keygenPoolInit: calloc");
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        pool->bufs[i].data = malloc(KEYGEN_D_BUF_SYMBOLS);
+        if (!pool->bufs[i].data) {
+            perror("keygenPoolInit: malloc");
+            return -1;
+        }
+        pool->emptyQ[i] = i;
+    }
+    pool->emptyCount = count;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: keygenGenerator()
+*   Description: A generator thread. Refills drained buffers for as long as
+*                the daemon runs, sleeping while the pool is full.
+*    Parameters: void *arg - The pool.
+* Preconditions: The pool has been initialized.
+*       Returns: NULL if the CSPRNG fails.
+*******************************************************************************/
+
+void *keygenGenerator(void *arg) {
+    struct keygenPool *pool = arg;
+    uint64_t begin;
+    int buf;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->emptyCount == 0) {
+            pthread_cond_wait(&pool->drained, &pool->lock);
+        }
+        buf = pool->emptyQ[pool->emptyHead];
+        pool->emptyHead = (pool->emptyHead + 1) % pool->count;
+        pool->emptyCount--;
+        pthread_mutex_unlock(&pool->lock);
+
+        begin = timeNowNs();
+        if (keygenFill(pool->alphabet, pool->bufs[buf].data,
+                       KEYGEN_D_BUF_SYMBOLS) < 0) {
+            return NULL;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->bufs[buf].pos = 0;
+        pool->fullQ[(pool->fullHead + pool->fullCount) % pool->count] = buf;
+        pool->fullCount++;
+        pool->generated += KEYGEN_D_BUF_SYMBOLS;
+        pool->generateNs += timeNowNs() - begin;
+        pthread_cond_signal(&pool->filled);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/*******************************************************************************
+*      Function: keygenTake()
+*   Description: Takes symbols from the pool, waiting for a buffer to be filled
+*                if the pool is empty. The symbols taken are wiped from the
+*                pool and a buffer drained by the take goes back to the
+*                generators.
+*    Parameters: struct keygenPool *pool - The pool.
+*                char *out - The buffer to copy them into.
+*                int len - The most symbols to take.
+*                int *stalled - Set if the take had to wait.
+* Preconditions: len is positive.
+*       Returns: The number of symbols taken.
+*******************************************************************************/
+
+int keygenTake(struct keygenPool *pool, char *out, int len, int *stalled) {
+    struct keygenBuf *buf;
+    int n;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->current < 0) {
+        if (pool->fullCount == 0) {
+            *stalled = 1;
+        }
+        while (pool->fullCount == 0) {
+            pthread_cond_wait(&pool->filled, &pool->lock);
+        }
+        pool->current = pool->fullQ[pool->fullHead];
+        pool->fullHead = (pool->fullHead + 1) % pool->count;
+        pool->fullCount--;
+    }
+    buf = &pool->bufs[pool->current];
+    n = KEYGEN_D_BUF_SYMBOLS - buf->pos;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(out, &buf->data[buf->pos], n);
+    memset(&buf->data[buf->pos], 0, n);
+    buf->pos += n;
+    pool->served += n;
+
+    /* Hand a drained buffer back to the generators */
+    if (buf->pos == KEYGEN_D_BUF_SYMBOLS) {
+        pool->emptyQ[(pool->emptyHead + pool->emptyCount) % pool->count] =
+            pool->current;
+        pool->emptyCount++;
+        pool->current = -1;
+        pthread_cond_signal(&pool->drained);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
+
+/*******************************************************************************
+*      Function: keygenStats()
+*   Description: Writes the pool statistics.
+*    Parameters: struct keygenPool *pool - The pool.
+*                int fd - The client socket.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void keygenStats(struct keygenPool *pool, int fd) {
+    uint64_t symbols, generated, generateNs, served, requests, stalls;
+    double uptime;
+    int buffers;
+
+    pthread_mutex_lock(&pool->lock);
+    buffers = pool->fullCount;
+    symbols = (uint64_t)pool->fullCount * KEYGEN_D_BUF_SYMBOLS;
+    if (pool->current >= 0) {
+        symbols += KEYGEN_D_BUF_SYMBOLS - pool->bufs[pool->current].pos;
+    }
+    generated = pool->generated;
+    generateNs = pool->generateNs;
+    served = pool->served;
+    requests = pool->requests;
+    stalls = pool->stalls;
+    pthread_mutex_unlock(&pool->lock);
+    uptime = (double)(timeNowNs() - pool->start) / TIME_NS_PER_SEC;
+
+    dprintf(fd, "# TYPE keygen_pool_buffers gauge\n"
+            "keygen_pool_buffers %d\n"
+            "# TYPE keygen_pool_buffers_max gauge\n"
+            "keygen_pool_buffers_max %d\n"
+            "# TYPE keygen_pool_symbols gauge\n"
+            "keygen_pool_symbols %llu\n",
+            buffers, pool->count, (unsigned long long)symbols);
+    dprintf(fd, "# TYPE keygen_generated_symbols_total counter\n"
+            "keygen_generated_symbols_total %llu\n"
+            "# TYPE keygen_generation_rate_symbols_per_second gauge\n"
+            "keygen_generation_rate_symbols_per_second %.0f\n"
+            "# TYPE keygen_generator_seconds_total counter\n"
+            "keygen_generator_seconds_total %.9f\n",
+            (unsigned long long)generated,
+            generateNs ? (double)generated * TIME_NS_PER_SEC / generateNs : 0,
+            (double)generateNs / TIME_NS_PER_SEC);
+    dprintf(fd, "# TYPE keygen_served_symbols_total counter\n"
+            "keygen_served_symbols_total %llu\n"
+            "# TYPE keygen_requests_total counter\n"
+            "keygen_requests_total %llu\n"
+            "# TYPE keygen_stalls_total counter\n"
+            "keygen_stalls_total %llu\n"
+            "# TYPE keygen_uptime_seconds gauge\n"
+            "keygen_uptime_seconds %.3f\n",
+            (unsigned long long)served, (unsigned long long)requests,
+            (unsigned long long)stalls, uptime);
+}
+
+/*******************************************************************************
+*      Function: keygenServe()
+*   Description: Answers a request for symbols.
+*    Parameters: struct keygenPool *pool - The pool.
+*                int fd - The client socket.
+*                int len - The number of symbols.
+*                char *chunk - A buffer of KEYGEN_D_CHUNK_SYMBOLS bytes.
+* Preconditions: None.
+*       Returns: 0 on success, -1 if the client went away.
+*******************************************************************************/
+
+int keygenServe(struct keygenPool *pool, int fd, int len, char *chunk) {
+    int n, sent, stalled = 0;
+    ssize_t w;
+
+    while (len > 0) {
+        n = keygenTake(pool, chunk, len < KEYGEN_D_CHUNK_SYMBOLS ?
+                                    len : KEYGEN_D_CHUNK_SYMBOLS, &stalled);
+        for (sent = 0; sent < n; sent += w) {
+            w = send(fd, &chunk[sent], n - sent, MSG_NOSIGNAL);
+            if (w < 0 && errno == EINTR) {
+                w = 0;
+                continue;
+            }
+            if (w <= 0) {
+                return -1;
+            }
+        }
+        len -= n;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->requests++;
+    pool->stalls += stalled;
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/* A client connection */
+struct keygenConn {
+    struct keygenPool *pool;
+    int fd;
+};
+
+/*******************************************************************************
+*      Function: keygenConnMain()
+*   Description: Serves a client's requests until it disconnects or sends an
+*                invalid request.
+*    Parameters: void *arg - The connection, freed on return.
+* Preconditions: None.
+*       Returns: NULL.
+*******************************************************************************/
+
+void *keygenConnMain(void *arg) {
+    struct keygenConn *conn = arg;
+    char line[KEYPOOL_REQUEST_MAX];
+    char *chunk, *endptr;
+    int used = 0;
+    ssize_t n;
+    long len;
+
+    chunk = malloc(KEYGEN_D_CHUNK_SYMBOLS);
+    if (!chunk) {
+        perror("keygenConnMain: malloc");
+        close(conn->fd);
+        free(conn);
+        return NULL;
+    }
+
+    for (;;) {
+        /* Read one request line a byte at a time, so that nothing past it is
+         * consumed */
+        n = recv(conn->fd, &line[used], 1, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        if (line[used] != '\n') {
+            if (++used == sizeof(line)) {
+                break;
+            }
+            continue;
+        }
+        line[used] = '\0';
+        used = 0;
+
+        if (strcmp(line, KEYPOOL_STATS) == 0) {
+            keygenStats(conn->pool, conn->fd);
+            break;
+        }
+        errno = 0;
+        len = strtol(line, &endptr, 10);
+        if (errno || endptr == line || *endptr != '\0' || len <= 0 ||
+            len > KEYPOOL_FETCH_MAX) {
+            break;
+        }
+        if (keygenServe(conn->pool, conn->fd, len, chunk) < 0) {
+            break;
+        }
+    }
+
+    /* The symbols last sent are not left behind in the heap */
+    memset(chunk, 0, KEYGEN_D_CHUNK_SYMBOLS);
+    free(chunk);
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+/*******************************************************************************
+*      Function: keygenListen()
+*   Description: Creates the daemon's local socket, replacing a stale one.
+*    Parameters: const char *path - The socket path.
+* Preconditions: None.
+*       Returns: The listening socket on success, -1 on error.
+*******************************************************************************/
+
+int keygenListen(const char *path) {
+    struct sockaddr_un addr = {0};
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "keygenListen: socket path too long\n");
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("keygenListen: socket");
+        return -1;
+    }
+    /* Only the owner may fetch pad material */
+    unlink(path);
+    umask(077);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, KEYGEN_D_BACKLOG) < 0) {
+        perror("keygenListen: bind");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*******************************************************************************
+*      Function: keygenArg()
+*   Description: Converts a positive integer option.
+*    Parameters: const char *arg - The option argument.
+*                int max - The largest value allowed.
+* Preconditions: None.
+*       Returns: The value, or -1 if it is invalid.
+*******************************************************************************/
+
+int keygenArg(const char *arg, int max) {
+    char *endptr;
+    long val;
+
+    errno = 0;
+    val = strtol(arg, &endptr, 10);
+    if (errno || endptr == arg || *endptr != '\0' || val <= 0 || val > max) {
+        return -1;
+    }
+    return val;
+}
+
+/*******************************************************************************
+*      Function: main()
+*   Description: The main key material daemon function.
+*    Parameters: int argc - The argument count.
+*                char **argv - The argument list.
+* Preconditions: None.
+*       Returns: 1 on error. Otherwise the daemon runs until it is killed.
+*******************************************************************************/
+
+int main(int argc, char **argv) {
+    const struct otpAlphabet *alphabet = OTP_ALPHABET_TEXT;
+    int threads = KEYGEN_D_THREADS_DEFAULT;
+    int buffers = KEYGEN_D_BUFFERS_DEFAULT;
+    struct keygenPool pool;
+    struct keygenConn *conn;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int opt, listenFd, fd, i, usage = 0;
+
+    while (!usage && (opt = getopt(argc, argv, "A:n:t:")) != -1) {
+        switch (opt) {
+            case 'A':
+                alphabet = alphabetByName(optarg);
+                if (!alphabet) {
+                    usage = 1;
+                }
+                break;
+            case 'n':
+                buffers = keygenArg(optarg, INT_MAX / KEYGEN_D_BUF_SYMBOLS);
+                if (buffers < 0) {
+                    usage = 1;
+                }
+                break;
+            case 't':
+                threads = keygenArg(optarg, KEYGEN_D_THREADS_MAX);
+                if (threads < 0) {
+                    usage = 1;
+                }
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+    if (usage || argc - optind != 1) {
+        fprintf(stderr, "Usage: keygen_d [-A alphabet] [-n buffers] "
+                "[-t threads] socket_path\n");
+        exit(1);
+    }
+
+    if (keygenPoolInit(&pool, alphabet, buffers) < 0) {
+        exit(1);
+    }
+    listenFd = keygenListen(argv[optind]);
+    if (listenFd < 0) {
+        exit(1);
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&thread, &attr, keygenGenerator, &pool) != 0) {
+            fprintf(stderr, "keygen_d: pthread_create failed\n");
+            exit(1);
+        }
+    }
+
+    /* Each client is served by its own thread */
+    for (;;) {
+        fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("keygen_d: accept");
+            }
+            continue;
+        }
+        conn = malloc(sizeof(*conn));
+        if (!conn) {
+            perror("keygen_d: malloc");
+            close(fd);
+            continue;
+        }
+        conn->pool = &pool;
+        conn->fd = fd;
+        if (pthread_create(&thread, &attr, keygenConnMain, conn) != 0) {
+            fprintf(stderr, "keygen_d: pthread_create failed\n");
+            close(fd);
+            free(conn);
+        }
+    }
+}
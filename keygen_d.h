@@ -0,0 +1,65 @@
+/*******************************************************************************
+*      Filename: keygen_d.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for keygen_d.c. Please see keygen_d.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef KEYGEN_D_H
+#define KEYGEN_D_H
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cipher_utils.h"
+#include "keypool_utils.h"
+
+#define KEYGEN_D_BUF_SYMBOLS (1 << 20) /* Symbols per pool buffer */
+#define KEYGEN_D_BUFFERS_DEFAULT 16    /* Pool buffers */
+#define KEYGEN_D_THREADS_DEFAULT 2     /* Generator threads */
+#define KEYGEN_D_THREADS_MAX    64     /* The most generator threads */
+#define KEYGEN_D_RANDOM_BYTES 4096     /* Random bytes drawn per getrandom() */
+#define KEYGEN_D_CHUNK_SYMBOLS 65536   /* Symbols sent per write */
+#define KEYGEN_D_BACKLOG 64            /* The listen backlog */
+
+/* A buffer of generated symbols */
+struct keygenBuf {
+    char *data;                   /* The symbols */
+    int pos;                      /* Symbols already handed out */
+};
+
+/* The pool of buffers. Filled buffers wait in a queue for the clients; each
+ * is drained front to back, wiped, and queued again for the generators. */
+struct keygenPool {
+    pthread_mutex_t lock;
+    pthread_cond_t filled;        /* Signalled when a buffer is filled */
+    pthread_cond_t drained;       /* Signalled when a buffer is drained */
+    const struct otpAlphabet *alphabet; /* The symbols generated */
+    struct keygenBuf *bufs;       /* Every buffer */
+    int count;                    /* The number of buffers */
+    int *fullQ;                   /* Filled buffers, oldest first */
+    int fullHead, fullCount;
+    int *emptyQ;                  /* Drained buffers, oldest first */
+    int emptyHead, emptyCount;
+    int current;                  /* The buffer being drained, -1 if none */
+    uint64_t start;               /* The time the daemon started */
+    uint64_t generated;           /* Symbols generated */
+    uint64_t generateNs;          /* Time the generators spent generating */
+    uint64_t served;              /* Symbols handed out */
+    uint64_t requests;            /* Requests answered */
+    uint64_t stalls;              /* Requests that waited for a buffer */
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*******************************************************************************
+*      Filename: keypool_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Fetches pad material from keygen_d over its local socket. A
+*                request is the number of symbols wanted, in decimal, ending
+*                with a newline; the reply is exactly that many symbols. A
+*                connection may carry any number of requests, and the daemon
+*                never hands out the same symbols twice.
+*******************************************************************************/
+
+#include "keypool_utils.h"
+
+/*******************************************************************************
+*      Function: keypoolConnect()
+*   Description: Connects to a keygen daemon.
+*    Parameters: const char *path - The daemon's socket path.
+* Preconditions: None.
+*       Returns: The connected socket on success, -1 on error.
+*******************************************************************************/
+
+int keypoolConnect(const char *path) {
+    struct sockaddr_un addr = {0};
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "keypoolConnect: socket path too long\n");
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("keypoolConnect: socket");
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("keypoolConnect: connect");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*******************************************************************************
+*      Function: keypoolFetch()
+*   Description: Fetches fresh pad symbols.
+*    Parameters: int fd - The connected socket.
+*                char *buf - The buffer to fill.
+*                int len - The number of symbols, at most KEYPOOL_FETCH_MAX.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int keypoolFetch(int fd, char *buf, int len) {
+    char request[KEYPOOL_REQUEST_MAX];
+    int n, got;
+
+    if (len <= 0 || len > KEYPOOL_FETCH_MAX) {
+        fprintf(stderr, "keypoolFetch: invalid length\n");
+        return -1;
+    }
+    n = snprintf(request, sizeof(request), "%d\n", len);
+    if (send(fd, request, n, MSG_NOSIGNAL) != n) {
+        perror("keypoolFetch: send");
+        return -1;
+    }
+    for (got = 0; got < len; got += n) {
+        n = recv(fd, &buf[got], len - got, 0);
+        if (n < 0 && errno == EINTR) {
+            n = 0;
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "keypoolFetch: connection closed\n");
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+/*******************************************************************************
+*      Filename: keypool_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for keypool_utils.c. Please see
+*                keypool_utils.c for more details.
+*******************************************************************************/
+
+#ifndef KEYPOOL_UTILS_H
+#define KEYPOOL_UTILS_H
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define KEYPOOL_REQUEST_MAX 32       /* The longest request line */
+#define KEYPOOL_FETCH_MAX (1 << 30)  /* The most symbols per request */
+#define KEYPOOL_STATS "stats"        /* The request for the pool statistics */
+
+int keypoolConnect(const char *);
+int keypoolFetch(int, char *, int);
+
+#endif
@@ -1,12 +1,16 @@
 /*******************************************************************************
 *      Filename: msg_utils.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: Provides utility functions for forming and extracting packets.
 *******************************************************************************/
 
 #include "cipher_utils.h"
 #include "msg_utils.h"
+#include "pack_utils.h"
+#include "pad_utils.h"
+#include "parallel_utils.h"
+#include "reuse_utils.h"
 
 /*******************************************************************************
 *      Function: min()
@@ -37,7 +41,7 @@ int segmentToPacketLen(int segmentLen) {
 *      Function: formPacket()
 *   Description: Forms a packet on the client side.
 *    Parameters: FILE *ptextPtr - The text file pointer.
-*                FILE *keyPtr - The key file pointer.
+*                struct otpPad *keyPad - The key pad.
 *                int ptextRem - The amount of text in bytes remaining to be 
 *                               processed.
 *                char *packetBuffer - The packet string buffer.
@@ -49,8 +53,8 @@ int segmentToPacketLen(int segmentLen) {
 *                otherwise.
 *******************************************************************************/
 
-int formPacket(FILE *ptextPtr, FILE *keyPtr, int ptextRem, char *packetBuffer, 
-               int packetBufferLen, int mode) {
+int formPacket(FILE *ptextPtr, struct otpPad *keyPad, int ptextRem, 
+               char *packetBuffer, int packetBufferLen, int mode) {
     char finalChar = OTP_END_DELIM;
     /* Determine the maximum length of the text segment. */
     int maxSegmentLen = (packetBufferLen - OTP_DELIMITER_BYTES - 
@@ -86,10 +90,11 @@ int formPacket(FILE *ptextPtr, FILE *keyPtr, int ptextRem, char *packetBuffer,
     /* Place the midline delimiter  */
     packetBuffer[offset++] = OTP_DELIMITER;
 
-    /* Place the ciphertext segment */
-    for (i = 0; i < segmentLen; i++) {
-        packetBuffer[offset++] = (unsigned char) fgetc(keyPtr);
+    /* Place the key segment */
+    if (padRead(keyPad, &packetBuffer[offset], segmentLen) < 0) {
+        return -1;
     }
+    offset += segmentLen;
   
     /* Place the ending delimiter */
     if (ptextRem > segmentLen) {
@@ -178,6 +183,80 @@ int extractPacket(char *packet, int packetLen, char *plain, int plainLen,
  
 }
 
+/*******************************************************************************
+*      Function: locatePacket()
+*   Description: Checks the layout of a received packet without copying it. The
+*                text and key segments are equal in length, so the delimiters 
+*                can only lie at fixed offsets. The text segment starts at 
+*                packet[OTP_HEADER_BYTES] and the key segment one byte after it
+*                ends.
+*    Parameters: const char *packet - The packet, which need not be terminated.
+*                int packetLen - The packet length.
+*                int expectedMode - The expected packet mode.
+*                int *segmentLen - Set to the segment length.
+* Preconditions: The expected mode (encipher or decipher) is correct.
+*       Returns: 1 if the packet is a continuation packet, 0 if the packet is
+*                an end transmission packet, -1 otherwise.
+*******************************************************************************/
+
+int locatePacket(const char *packet, int packetLen, int expectedMode,
+                 int *segmentLen) {
+    int len = (packetLen - OTP_DELIMITER_BYTES - OTP_HEADER_BYTES) / 2;
+
+    if (len <= 0 || segmentToPacketLen(len) != packetLen) {
+        fprintf(stderr, "locatePacket: Invalid packet length\n");
+        return -1;
+    }
+    if (packet[0] != (expectedMode == OTP_ENCIPHER ? 'e' : 'd')) {
+        return -1;
+    }
+    if (packet[OTP_HEADER_BYTES + len] != OTP_DELIMITER ||
+        packet[packetLen - 2] != OTP_DELIMITER) {
+        fprintf(stderr, "locatePacket: Misplaced delimiter\n");
+        return -1;
+    }
+    *segmentLen = len;
+    return packet[packetLen - 1] == OTP_CONT_DELIM ? 1 : 0;
+}
+
+/*******************************************************************************
+*      Function: processPacket()
+*   Description: Processes a received packet in place. The cipher runs over the
+*                text segment, using the key segment where it lies. The text is
+*                already followed by OTP_DELIMITER, and the first key byte, once
+*                used, becomes the final delimiter, so the reply is ready to
+*                send from &packet[OTP_HEADER_BYTES].
+*    Parameters: char *packet - The packet.
+*                int packetLen - The packet length.
+*                int mode - The expected cipher mode.
+*                int *replyLen - Set to the reply length.
+*                uint64_t *offset - The pad position of the segment, advanced
+*                                   past it. A connection's packets use the
+*                                   pad from its start.
+* Preconditions: The packet ends with a final delimiter.
+*       Returns: 1 if the packet is a continuation packet, 0 if the packet is
+*                an end transmission packet, -1 otherwise.
+*******************************************************************************/
+
+int processPacket(char *packet, int packetLen, int mode, int *replyLen,
+                  uint64_t *offset) {
+    char *text = &packet[OTP_HEADER_BYTES];
+    int continuation, segmentLen;
+
+    continuation = locatePacket(packet, packetLen, mode, &segmentLen);
+    if (continuation < 0) {
+        return -1;
+    }
+    if (reuseCheck(text, &text[segmentLen + 1], segmentLen, *offset, 0) < 0) {
+        return -1;
+    }
+    *offset += segmentLen;
+    cipherBlock(text, &text[segmentLen + 1], segmentLen, mode);
+    text[segmentLen + 1] = OTP_END_DELIM;
+    *replyLen = segmentLen + 2;
+    return continuation;
+}
+
 /*******************************************************************************
 *      Function: processMessage()
 *   Description: Processes text and key buffers into the text buffer according
@@ -249,3 +328,434 @@ int processResponse(char *text) {
 
     return 0;
 }
+
+/*******************************************************************************
+*      Function: frameSegmentBytes()
+*   Description: Converts a segment length in symbols to its size on the wire.
+*    Parameters: int segmentLen - The segment length.
+*                int flags - The frame flags.
+* Preconditions: None.
+*       Returns: The segment size in bytes.
+*******************************************************************************/
+
+int frameSegmentBytes(int segmentLen, int flags) {
+    return flags & OTP_FRAME_PACKED ? packedLen(segmentLen) : segmentLen;
+}
+
+/*******************************************************************************
+*      Function: segmentToFrameLen()
+*   Description: Converts a segment length to the length of a binary header
+*                frame.
+*    Parameters: int segmentLen - The segment length.
+*                int flags - The frame flags.
+* Preconditions: None.
+*       Returns: The frame length.
+*******************************************************************************/
+
+int segmentToFrameLen(int segmentLen, int flags) {
+    return OTP_FRAME_HEADER_BYTES + 
+           (frameSegmentBytes(segmentLen, flags) * 2);
+}
+
+/*******************************************************************************
+*      Function: frameHeaderPack()
+*   Description: Encodes a binary frame header.
+*    Parameters: const struct otpFrameHeader *header - The header fields.
+*                char *buf - The destination of OTP_FRAME_HEADER_BYTES bytes.
+* Preconditions: The header fields are valid.
+*       Returns: None.
+*******************************************************************************/
+
+void frameHeaderPack(const struct otpFrameHeader *header, char *buf) {
+    unsigned char *out = (unsigned char *)buf;
+    int i;
+
+    out[0] = OTP_FRAME_MAGIC;
+    out[1] = header->mode == OTP_ENCIPHER ? 'e' : 'd';
+    out[2] = (unsigned char)header->cipher;
+    out[3] = (unsigned char)header->flags;
+    out[4] = (unsigned char)(header->len >> 24);
+    out[5] = (unsigned char)(header->len >> 16);
+    out[6] = (unsigned char)(header->len >> 8);
+    out[7] = (unsigned char)header->len;
+    out[8] = (unsigned char)(header->seq >> 24);
+    out[9] = (unsigned char)(header->seq >> 16);
+    out[10] = (unsigned char)(header->seq >> 8);
+    out[11] = (unsigned char)header->seq;
+    for (i = 0; i < 8; i++) {
+        out[12 + i] = (unsigned char)(header->offset >> (56 - 8 * i));
+    }
+}
+
+/*******************************************************************************
+*      Function: frameHeaderUnpack()
+*   Description: Decodes and validates a binary frame header.
+*    Parameters: const char *buf - The OTP_FRAME_HEADER_BYTES header bytes.
+*                struct otpFrameHeader *header - The header to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 if the header is malformed.
+*******************************************************************************/
+
+int frameHeaderUnpack(const char *buf, struct otpFrameHeader *header) {
+    const unsigned char *in = (const unsigned char *)buf;
+    unsigned long len;
+    int i;
+
+    if (in[0] != OTP_FRAME_MAGIC || (in[1] != 'e' && in[1] != 'd')) {
+        fprintf(stderr, "frameHeaderUnpack: Invalid header\n");
+        return -1;
+    }
+    len = ((unsigned long)in[4] << 24) | ((unsigned long)in[5] << 16) | 
+          ((unsigned long)in[6] << 8) | in[7];
+    if (len > OTP_FRAME_SEGMENT_MAX) {
+        fprintf(stderr, "frameHeaderUnpack: Segment too long\n");
+        return -1;
+    }
+    /* An empty segment may only end a message */
+    if (len == 0 && (in[3] & OTP_FRAME_CONT)) {
+        fprintf(stderr, "frameHeaderUnpack: Empty segment\n");
+        return -1;
+    }
+
+    header->mode = in[1] == 'e' ? OTP_ENCIPHER : OTP_DECIPHER;
+    header->cipher = in[2];
+    header->flags = in[3];
+    header->len = (int)len;
+    header->seq = ((uint32_t)in[8] << 24) | ((uint32_t)in[9] << 16) |
+                  ((uint32_t)in[10] << 8) | in[11];
+    header->offset = 0;
+    for (i = 0; i < 8; i++) {
+        header->offset = (header->offset << 8) | in[12 + i];
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: frameCursorAdvance()
+*   Description: Checks that a frame follows the last one accepted on its 
+*                connection, and moves the cursor past it. Frames that repeat
+*                or skip a sequence number or offset are rejected, so a replayed
+*                segment is never processed twice on one connection. The final
+*                frame of a kept-alive message resets the cursor for the next
+*                message.
+*    Parameters: struct otpFrameCursor *cursor - The connection's cursor.
+*                const struct otpFrameHeader *header - The frame header.
+* Preconditions: The header has been unpacked.
+*       Returns: 0 if the frame is accepted, -1 otherwise.
+*******************************************************************************/
+
+int frameCursorAdvance(struct otpFrameCursor *cursor, 
+                       const struct otpFrameHeader *header) {
+    if (cursor->started && (header->seq != cursor->seq || 
+                            header->offset != cursor->offset)) {
+        fprintf(stderr, "frameCursorAdvance: Frame out of sequence\n");
+        return -1;
+    }
+    cursor->started = 1;
+    cursor->seq = header->seq + 1;
+    cursor->offset = header->offset + header->len;
+    if ((header->flags & (OTP_FRAME_CONT | OTP_FRAME_KEEPALIVE)) == 
+        OTP_FRAME_KEEPALIVE) {
+        cursor->started = 0;
+        cursor->kept++;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: formFrame()
+*   Description: Forms a binary header frame on the client side.
+*    Parameters: FILE *ptextPtr - The text file pointer.
+*                struct otpPad *keyPad - The key pad.
+*                int ptextRem - The amount of text in bytes remaining to be
+*                               processed.
+*                char *frameBuffer - The frame buffer.
+*                int frameBufferLen - The frame buffer length.
+*                struct otpFrameHeader *header - The mode, cipher, flags,
+*                                                sequence number and offset of
+*                                                the frame. The length and
+*                                                continuation flag are filled
+*                                                in.
+* Preconditions: Both files have been validated. The frame buffer length is
+*                accurate.
+*       Returns: -1 on error. The length of the text segment processed,
+*                otherwise.
+*******************************************************************************/
+
+int formFrame(FILE *ptextPtr, struct otpPad *keyPad, int ptextRem, 
+              char *frameBuffer, int frameBufferLen, 
+              struct otpFrameHeader *header) {
+    int flags = header->flags;
+    int maxSegmentLen = (frameBufferLen - OTP_FRAME_HEADER_BYTES) / 2;
+    int segmentLen, segmentBytes;
+    char *text = &frameBuffer[OTP_FRAME_HEADER_BYTES];
+    char *key;
+
+    if (maxSegmentLen > OTP_FRAME_SEGMENT_MAX) {
+        maxSegmentLen = OTP_FRAME_SEGMENT_MAX;
+    }
+    if (maxSegmentLen <= 0 || ptextRem <= 0) {
+        fprintf(stderr, "formFrame: Error in arguments\n");
+        return -1;
+    }
+    segmentLen = min(maxSegmentLen, ptextRem);
+
+    segmentBytes = frameSegmentBytes(segmentLen, flags);
+    key = &text[segmentBytes];
+
+    /* Read the text and key segments directly into place. Packed segments
+     * are packed in place; each group is read before it is overwritten and
+     * the packed output never passes the input. */
+    if (fread(text, 1, segmentLen, ptextPtr) != (size_t)segmentLen) {
+        fprintf(stderr, "formFrame: Short read\n");
+        return -1;
+    }
+    if (flags & OTP_FRAME_PACKED) {
+        framePackSymbols(text, segmentLen, (unsigned char *)text);
+    }
+    if (padRead(keyPad, key, segmentLen) < 0) {
+        return -1;
+    }
+    if (flags & OTP_FRAME_PACKED) {
+        framePackSymbols(key, segmentLen, (unsigned char *)key);
+    }
+
+    header->flags = (flags & (OTP_FRAME_PACKED | OTP_FRAME_KEEPALIVE)) | 
+                    (ptextRem > segmentLen ? OTP_FRAME_CONT : 0);
+    header->len = segmentLen;
+    frameHeaderPack(header, frameBuffer);
+
+    return segmentLen;
+}
+
+/*******************************************************************************
+*      Function: formFrameBuffer()
+*   Description: Forms a binary header frame from text and key held in memory.
+*    Parameters: const char *text - The remaining text.
+*                const char *key - The key for the remaining text.
+*                int ptextRem - The amount of text in bytes remaining to be
+*                               processed.
+*                char *frameBuffer - The frame buffer.
+*                int frameBufferLen - The frame buffer length.
+*                struct otpFrameHeader *header - As for formFrame().
+* Preconditions: The text and key are valid and at least ptextRem bytes long.
+*                The frame buffer length is accurate.
+*       Returns: -1 on error. The length of the text segment processed,
+*                otherwise.
+*******************************************************************************/
+
+int formFrameBuffer(const char *text, const char *key, int ptextRem,
+                    char *frameBuffer, int frameBufferLen, 
+                    struct otpFrameHeader *header) {
+    int flags = header->flags;
+    int maxSegmentLen = (frameBufferLen - OTP_FRAME_HEADER_BYTES) / 2;
+    int segmentLen, segmentBytes;
+    char *textSeg = &frameBuffer[OTP_FRAME_HEADER_BYTES];
+
+    if (maxSegmentLen > OTP_FRAME_SEGMENT_MAX) {
+        maxSegmentLen = OTP_FRAME_SEGMENT_MAX;
+    }
+    if (maxSegmentLen <= 0 || ptextRem <= 0) {
+        fprintf(stderr, "formFrameBuffer: Error in arguments\n");
+        return -1;
+    }
+    segmentLen = min(maxSegmentLen, ptextRem);
+    segmentBytes = frameSegmentBytes(segmentLen, flags);
+
+    if (flags & OTP_FRAME_PACKED) {
+        framePackSymbols(text, segmentLen, (unsigned char *)textSeg);
+        framePackSymbols(key, segmentLen, 
+                         (unsigned char *)&textSeg[segmentBytes]);
+    } else {
+        memcpy(textSeg, text, segmentLen);
+        memcpy(&textSeg[segmentBytes], key, segmentLen);
+    }
+
+    header->flags = (flags & (OTP_FRAME_PACKED | OTP_FRAME_KEEPALIVE)) | 
+                    (ptextRem > segmentLen ? OTP_FRAME_CONT : 0);
+    header->len = segmentLen;
+    frameHeaderPack(header, frameBuffer);
+
+    return segmentLen;
+}
+
+/* A frame's text and key, for the chunks of the cipher */
+struct otpFrameWork {
+    char *text;                          /* The text segment */
+    const char *key;                     /* The key segment */
+    const struct otpFrameHeader *header; /* The frame header */
+    const struct otpAlphabet *alphabet;  /* The alphabet, NULL for XOR */
+};
+
+/* The input and output of packing or unpacking */
+struct otpPackWork {
+    const void *in;                      /* The input */
+    void *out;                           /* The output */
+};
+
+/*******************************************************************************
+*      Function: processFrameChunk()
+*   Description: Applies a frame's cipher to a chunk of its segments in place.
+*    Parameters: void *arg - The struct otpFrameWork.
+*                char *scratch - Unused.
+*                int start - The first symbol.
+*                int len - The number of symbols.
+* Preconditions: A packed chunk starts on a group.
+*       Returns: 0 on success, -1 on invalid packed symbols.
+*******************************************************************************/
+
+int processFrameChunk(void *arg, char *scratch, int start, int len) {
+    struct otpFrameWork *work = arg;
+    int i = start;
+
+    (void)scratch;
+    if (work->header->flags & OTP_FRAME_PACKED) {
+        i = start / PACK_GROUP_SYMBOLS * PACK_GROUP_BYTES;
+        return packedCipher((unsigned char *)&work->text[i], 
+                            (const unsigned char *)&work->key[i], len, 
+                            work->header->mode);
+    }
+    if (!work->alphabet) {
+        xorBlock(&work->text[i], &work->key[i], len);
+    } else {
+        alphabetCipherBlock(work->alphabet, &work->text[i], &work->key[i], 
+                            len, work->header->mode);
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: processFrame()
+*   Description: Processes the text segment of a binary header frame in place
+*                according to the frame's cipher, mode and encoding.
+*    Parameters: char *text - The text segment, followed by the key segment.
+*                const struct otpFrameHeader *header - The frame header.
+* Preconditions: The buffer holds both segments in full.
+*       Returns: 0 on success, -1 on an unsupported or invalid frame.
+*******************************************************************************/
+
+int processFrame(char *text, const struct otpFrameHeader *header) {
+    int segmentBytes = frameSegmentBytes(header->len, header->flags);
+    struct otpFrameWork work = {text, &text[segmentBytes], header, NULL};
+    struct parallelTask task = {processFrameChunk, NULL, &work, 1};
+
+    if (reuseCheck(text, work.key, header->len, header->offset, 
+                   header->flags & OTP_FRAME_PACKED) < 0) {
+        return -1;
+    }
+
+    /* Packed segments only encode the default alphabet */
+    if (header->cipher != OTP_CIPHER_XOR) {
+        work.alphabet = alphabetByCipher(header->cipher);
+    }
+    if (header->flags & OTP_FRAME_PACKED ? 
+        work.alphabet != OTP_ALPHABET_TEXT : 
+        header->cipher != OTP_CIPHER_XOR && !work.alphabet) {
+        fprintf(stderr, "processFrame: Unsupported cipher\n");
+        return -1;
+    }
+    if (header->flags & OTP_FRAME_PACKED) {
+        task.align = PACK_GROUP_SYMBOLS;
+    }
+    if (parallelRun(&task, header->len) < 0) {
+        fprintf(stderr, "processFrame: Invalid packed symbols\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*     Functions: framePackChunk(), framePackCommit()
+*   Description: Packs a chunk of characters into the scratch buffer, or in
+*                place, and moves a packed chunk into place.
+*    Parameters: void *arg - The struct otpPackWork.
+*                char *scratch - The scratch buffer, or NULL.
+*                int start - The first symbol, which starts a group.
+*                int len - The number of symbols.
+* Preconditions: None.
+*       Returns: framePackChunk() returns 0. framePackCommit() returns nothing.
+*******************************************************************************/
+
+int framePackChunk(void *arg, char *scratch, int start, int len) {
+    struct otpPackWork *work = arg;
+    unsigned char *out = (unsigned char *)work->out + 
+                         start / PACK_GROUP_SYMBOLS * PACK_GROUP_BYTES;
+
+    packSymbols((const char *)work->in + start, len, 
+                scratch ? (unsigned char *)scratch : out);
+    return 0;
+}
+
+void framePackCommit(void *arg, const char *scratch, int start, int len) {
+    struct otpPackWork *work = arg;
+
+    memcpy((char *)work->out + start / PACK_GROUP_SYMBOLS * PACK_GROUP_BYTES, 
+           scratch, packedLen(len));
+}
+
+/*******************************************************************************
+*     Functions: frameUnpackChunk(), frameUnpackCommit()
+*   Description: Unpacks a chunk of groups into the scratch buffer, or in
+*                place, and moves an unpacked chunk into place.
+*    Parameters: void *arg - The struct otpPackWork.
+*                char *scratch - The scratch buffer, or NULL.
+*                int start - The first symbol, which starts a group.
+*                int len - The number of symbols.
+* Preconditions: None.
+*       Returns: frameUnpackChunk() returns 0 on success, -1 on an invalid
+*                group. frameUnpackCommit() returns nothing.
+*******************************************************************************/
+
+int frameUnpackChunk(void *arg, char *scratch, int start, int len) {
+    struct otpPackWork *work = arg;
+    const unsigned char *in = (const unsigned char *)work->in + 
+                              start / PACK_GROUP_SYMBOLS * PACK_GROUP_BYTES;
+
+    return unpackSymbols(in, len, scratch ? scratch : 
+                                            (char *)work->out + start);
+}
+
+void frameUnpackCommit(void *arg, const char *scratch, int start, int len) {
+    struct otpPackWork *work = arg;
+
+    memcpy((char *)work->out + start, scratch, len);
+}
+
+/*******************************************************************************
+*      Function: framePackSymbols()
+*   Description: Packs a frame segment, splitting a large one across threads.
+*                The output may overlap the input as it may for packSymbols().
+*    Parameters: const char *chars - The characters.
+*                int len - The number of characters.
+*                unsigned char *out - The destination of packedLen(len) bytes.
+* Preconditions: The characters are valid cipher characters.
+*       Returns: None.
+*******************************************************************************/
+
+void framePackSymbols(const char *chars, int len, unsigned char *out) {
+    struct otpPackWork work = {chars, out};
+    struct parallelTask task = {framePackChunk, framePackCommit, &work,
+                                PACK_GROUP_SYMBOLS};
+
+    parallelRun(&task, len);
+}
+
+/*******************************************************************************
+*      Function: frameUnpackSymbols()
+*   Description: Unpacks a frame segment, splitting a large one across threads.
+*                The output may overlap the input as it may for 
+*                unpackSymbols().
+*    Parameters: const unsigned char *in - The packed groups.
+*                int len - The number of characters to produce.
+*                char *chars - The destination of len characters.
+* Preconditions: The input holds packedLen(len) bytes.
+*       Returns: 0 on success, -1 if a group holds an invalid triple.
+*******************************************************************************/
+
+int frameUnpackSymbols(const unsigned char *in, int len, char *chars) {
+    struct otpPackWork work = {in, chars};
+    struct parallelTask task = {frameUnpackChunk, frameUnpackCommit, &work,
+                                PACK_GROUP_SYMBOLS};
+
+    return parallelRun(&task, len);
+}
@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: msg_utils.h
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The header file for msg_utils.c. Please see msg_utils.c for more
 *                details.
 *******************************************************************************/
@@ -9,6 +9,7 @@
 #ifndef MSG_UTILS_H
 #define MSG_UTILS_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,8 +21,73 @@
 #define OTP_HEADER_BYTES 1     /* The total number of header bytes */
 #define OTP_PAYLOAD_MAX 1460   /* The maximum message payload size */
 
+/* Binary header frames carry a fixed header followed by a text segment and a
+ * key segment of equal length. Replies carry the same header followed by the
+ * processed segment. Header layout:
+ *   [0] OTP_FRAME_MAGIC  [1] mode ('e' or 'd')  [2] cipher  [3] flags
+ *   [4..7] segment length in symbols  [8..11] sequence number
+ *   [12..19] offset of the segment in the message, in symbols
+ * Multibyte fields are big endian. Replies echo the sequence number and
+ * offset, which acknowledge the segment. With OTP_FRAME_PACKED, each text
+ * cipher segment, and the reply, is packed at 5 bits per symbol and takes
+ * packedLen() bytes. The final frame of a message may have an empty segment,
+ * which ends a stream of unknown length. A daemon turning a connection away
+ * sends a lone header with OTP_FRAME_BUSY and an empty segment in place of
+ * any reply, whichever protocol the client speaks. A final frame with
+ * OTP_FRAME_KEEPALIVE leaves the connection open for another message, which
+ * starts again at sequence number 0 and offset 0. */
+#define OTP_FRAME_MAGIC '#'                /* First byte of a header frame */
+#define OTP_FRAME_HEADER_BYTES 20          /* The header frame header size */
+#define OTP_FRAME_SEGMENT_MAX ((1 << 20) - OTP_FRAME_HEADER_BYTES / 2)
+                                           /* The maximum segment length, so
+                                            * that a full frame fills a 2 MiB
+                                            * pool buffer */
+#define OTP_FRAME_SEGMENT_DEFAULT 65536    /* The segment length clients send */
+#define OTP_FRAME_CONT 0x01                /* More frames follow */
+#define OTP_FRAME_PACKED 0x02              /* Segments are packed */
+#define OTP_FRAME_BUSY 0x04                /* The daemon is at capacity */
+#define OTP_FRAME_KEEPALIVE 0x08           /* The connection outlives the
+                                            * message */
+
+/* A decoded binary frame header */
+struct otpFrameHeader {
+    int mode;     /* OTP_ENCIPHER or OTP_DECIPHER */
+    int cipher;   /* OTP_CIPHER_TEXT or OTP_CIPHER_XOR */
+    int flags;    /* OTP_FRAME flags */
+    int len;      /* The segment length */
+    uint32_t seq;     /* The sequence number */
+    uint64_t offset;  /* The segment offset in the message */
+};
+
+/* The next frame a connection accepts. The first frame may start anywhere,
+ * so that a transfer can resume; each later frame must follow it directly. */
+struct otpFrameCursor {
+    int started;      /* Nonzero once a frame has been accepted */
+    uint32_t seq;     /* The expected sequence number */
+    uint64_t offset;  /* The expected offset */
+    uint32_t kept;    /* Messages ended with the connection kept open */
+};
+
 int segmentToPacketLen(int);
-int formPacket(FILE *, FILE *, int, char *, int, int);
+struct otpPad;
+
+int formPacket(FILE *, struct otpPad *, int, char *, int, int);
 int extractPacket(char *, int, char *, int, char *, int, int);
+int locatePacket(const char *, int, int, int *);
+int processPacket(char *, int, int, int *, uint64_t *);
+int processMessage(char *, char *, int);
+int processResponse(char *);
+int frameSegmentBytes(int, int);
+int segmentToFrameLen(int, int);
+void frameHeaderPack(const struct otpFrameHeader *, char *);
+int frameHeaderUnpack(const char *, struct otpFrameHeader *);
+int frameCursorAdvance(struct otpFrameCursor *, const struct otpFrameHeader *);
+int formFrame(FILE *, struct otpPad *, int, char *, int, 
+              struct otpFrameHeader *);
+int formFrameBuffer(const char *, const char *, int, char *, int,
+                    struct otpFrameHeader *);
+int processFrame(char *, const struct otpFrameHeader *);
+void framePackSymbols(const char *, int, unsigned char *);
+int frameUnpackSymbols(const unsigned char *, int, char *);
 
 #endif
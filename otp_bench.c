@@ -0,0 +1,661 @@
+/*******************************************************************************
+*      Filename: otp_bench.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Microbenchmarks for the cipher, validation and framing hot
+*                paths. Each case is measured across a sweep of input sizes and
+*                reported in bytes per second and cycles per byte as CSV or
+*                JSON. Where the kernel allows, hardware counters read around
+*                the measured loop add core cycles per byte, instructions per
+*                cycle, and cache and branch misses per kilobyte of input.
+*******************************************************************************/
+
+#include "cipher_utils.h"
+#include "file_utils.h"
+#include "msg_utils.h"
+#include "otp_bench.h"
+#include "pad_utils.h"
+#include "perf_utils.h"
+#include "time_utils.h"
+
+void benchEncipher(struct benchState *);
+void benchDecipher(struct benchState *);
+void benchProcessEnc(struct benchState *);
+void benchProcessDec(struct benchState *);
+void benchValidate(struct benchState *);
+void benchFormPacket(struct benchState *);
+void benchExtractPacket(struct benchState *);
+void benchPacketInPlace(struct benchState *);
+void benchProcessResponse(struct benchState *);
+void benchXorBlock(struct benchState *);
+void benchCipherBlock(struct benchState *);
+void benchPackedCipher(struct benchState *);
+void benchProcessFrame(struct benchState *);
+void benchProcessFramePacked(struct benchState *);
+void benchPackSymbols(struct benchState *);
+void benchUnpackSymbols(struct benchState *);
+void benchPadReadPacked(struct benchState *);
+void benchPadReadIndexed(struct benchState *);
+
+/* The benchmark registry. New kernels are added here. */
+static const struct benchCase benchCases[] = {
+    {"encipher",         benchEncipher},
+    {"decipher",         benchDecipher},
+    {"processMessage_e", benchProcessEnc},
+    {"processMessage_d", benchProcessDec},
+    {"validateFileChars", benchValidate},
+    {"formPacket",       benchFormPacket},
+    {"extractPacket",    benchExtractPacket},
+    {"packetInPlace",    benchPacketInPlace},
+    {"processResponse",  benchProcessResponse},
+    {"xorBlock",         benchXorBlock},
+    {"cipherBlock",      benchCipherBlock},
+    {"packedCipher",     benchPackedCipher},
+    {"processFrame",     benchProcessFrame},
+    {"processFrame_P",   benchProcessFramePacked},
+    {"packSymbols",      benchPackSymbols},
+    {"unpackSymbols",    benchUnpackSymbols},
+    {"padRead_packed",   benchPadReadPacked},
+    {"padRead_indexed",  benchPadReadIndexed},
+};
+
+/* Defeats dead code elimination of benchmark results */
+volatile int benchSink;
+
+/*******************************************************************************
+*      Function: fillSymbols()
+*   Description: Fills a buffer with pseudo-random cipher characters.
+*    Parameters: char *buf - The buffer.
+*                int len - The number of characters to write.
+*                unsigned int seed - The generator seed.
+* Preconditions: The buffer holds at least len + 1 bytes.
+*       Returns: None.
+*******************************************************************************/
+
+void fillSymbols(char *buf, int len, unsigned int seed) {
+    int i, r;
+
+    for (i = 0; i < len; i++) {
+        r = rand_r(&seed) % OTP_NUM_CHARS;
+        buf[i] = r == OTP_NUM_CHARS - 1 ? ' ' : 'A' + r;
+    }
+    buf[len] = '\0';
+}
+
+/*******************************************************************************
+*      Function: benchWriteIndexed()
+*   Description: Writes the key to the temporary indexed pad.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The key and the indexed pad file exist.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int benchWriteIndexed(struct benchState *s) {
+    int blocks = (s->size + PAD_INDEX_BLOCK - 1) / PAD_INDEX_BLOCK;
+    uint32_t *sums;
+    int i, len;
+
+    sums = malloc(blocks * sizeof(*sums));
+    if (!sums) {
+        perror("benchWriteIndexed: malloc");
+        return -1;
+    }
+    for (i = 0; i < blocks; i++) {
+        len = s->size - i * PAD_INDEX_BLOCK;
+        if (len > PAD_INDEX_BLOCK) {
+            len = PAD_INDEX_BLOCK;
+        }
+        sums[i] = padChecksum(&s->key[i * PAD_INDEX_BLOCK], len);
+    }
+    padWriteIndexedHeader(s->indexedFile, s->size, PAD_INDEX_BLOCK);
+    fwrite(s->key, 1, s->size, s->indexedFile);
+    padWriteIndex(s->indexedFile, sums, blocks);
+    fflush(s->indexedFile);
+    free(sums);
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: benchStateInit()
+*   Description: Allocates and fills the shared benchmark state for one input
+*                size.
+*    Parameters: struct benchState *s - The state to initialize.
+*                int size - The input size.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int benchStateInit(struct benchState *s, int size) {
+    memset(s, 0, sizeof(*s));
+    s->size = size;
+    s->packetLen = segmentToPacketLen(size) + 1;
+
+    s->text = calloc(size + 3, 1);
+    s->key = calloc(size + 3, 1);
+    s->work = calloc(size + 3, 1);
+    s->packet = calloc(s->packetLen, 1);
+    s->scratchPacket = calloc(s->packetLen, 1);
+    s->extractText = calloc(s->packetLen, 1);
+    s->extractKey = calloc(s->packetLen, 1);
+    s->packed = calloc(packedLen(size), 1);
+    s->packedText = calloc(packedLen(size), 1);
+    s->frame = calloc(2 * size, 1);
+    s->packedFrame = calloc(2 * packedLen(size), 1);
+    if (!s->text || !s->key || !s->work || !s->packet || !s->scratchPacket ||
+        !s->extractText || !s->extractKey || !s->packed || !s->packedText ||
+        !s->frame || !s->packedFrame) {
+        fprintf(stderr, "benchStateInit: calloc failed\n");
+        return -1;
+    }
+    fillSymbols(s->text, size, 1);
+    fillSymbols(s->key, size, 2);
+
+    /* Back the file based cases with temporary files */
+    s->textFile = tmpfile();
+    s->keyFile = tmpfile();
+    s->packedFile = tmpfile();
+    s->indexedFile = tmpfile();
+    if (!s->textFile || !s->keyFile || !s->packedFile || !s->indexedFile) {
+        perror("benchStateInit: tmpfile");
+        return -1;
+    }
+    fprintf(s->textFile, "%s\n", s->text);
+    fprintf(s->keyFile, "%s\n", s->key);
+    rewind(s->textFile);
+    rewind(s->keyFile);
+    padOpen(&s->keyPad, s->keyFile, 0);
+
+    /* Write the key as a packed pad */
+    packSymbols(s->key, size, s->packed);
+    packSymbols(s->text, size, s->packedText);
+    memcpy(&s->frame[size], s->key, size);
+    memcpy(&s->packedFrame[packedLen(size)], s->packed, packedLen(size));
+    padWriteHeader(s->packedFile, size);
+    fwrite(s->packed, 1, packedLen(size), s->packedFile);
+
+    /* Write the key as an indexed pad */
+    if (benchWriteIndexed(s) < 0) {
+        return -1;
+    }
+
+    /* Form a packet for the extraction case */
+    if (formPacket(s->textFile, &s->keyPad, size, s->packet, s->packetLen - 1,
+                   OTP_ENCIPHER) < 0) {
+        return -1;
+    }
+    rewind(s->textFile);
+    rewind(s->keyFile);
+
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: benchStateFree()
+*   Description: Releases the shared benchmark state.
+*    Parameters: struct benchState *s - The state to release.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void benchStateFree(struct benchState *s) {
+    free(s->text);
+    free(s->key);
+    free(s->work);
+    free(s->packet);
+    free(s->scratchPacket);
+    free(s->extractText);
+    free(s->extractKey);
+    free(s->packed);
+    free(s->packedText);
+    free(s->frame);
+    free(s->packedFrame);
+    if (s->textFile) {
+        fclose(s->textFile);
+    }
+    if (s->keyFile) {
+        fclose(s->keyFile);
+    }
+    if (s->packedFile) {
+        fclose(s->packedFile);
+    }
+    if (s->indexedFile) {
+        fclose(s->indexedFile);
+    }
+}
+
+/*******************************************************************************
+*     Functions: benchEncipher(), benchDecipher()
+*   Description: Applies the single character cipher over the whole input.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchEncipher(struct benchState *s) {
+    int i;
+
+    for (i = 0; i < s->size; i++) {
+        s->work[i] = encipher(s->text[i], s->key[i]);
+    }
+    benchSink = s->work[s->size - 1];
+}
+
+void benchDecipher(struct benchState *s) {
+    int i;
+
+    for (i = 0; i < s->size; i++) {
+        s->work[i] = decipher(s->text[i], s->key[i]);
+    }
+    benchSink = s->work[s->size - 1];
+}
+
+/*******************************************************************************
+*     Functions: benchProcessEnc(), benchProcessDec()
+*   Description: Runs processMessage() in place over the scratch buffer. The
+*                appended delimiters are cut off after each call so that the
+*                buffer stays a valid input.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The scratch buffer holds valid text of the input size.
+*       Returns: None.
+*******************************************************************************/
+
+void benchProcessEnc(struct benchState *s) {
+    benchSink = processMessage(s->work, s->key, OTP_ENCIPHER);
+    s->work[s->size] = '\0';
+}
+
+void benchProcessDec(struct benchState *s) {
+    benchSink = processMessage(s->work, s->key, OTP_DECIPHER);
+    s->work[s->size] = '\0';
+}
+
+/*******************************************************************************
+*      Function: benchValidate()
+*   Description: Validates the temporary text file. validateFileChars() rewinds
+*                the file on success.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchValidate(struct benchState *s) {
+    benchSink = validateFileChars(s->textFile, OTP_ALPHABET_TEXT);
+}
+
+/*******************************************************************************
+*      Function: benchFormPacket()
+*   Description: Forms a single packet covering the whole input.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchFormPacket(struct benchState *s) {
+    rewind(s->textFile);
+    rewind(s->keyFile);
+    benchSink = formPacket(s->textFile, &s->keyPad, s->size, s->scratchPacket,
+                           s->packetLen - 1, OTP_ENCIPHER);
+}
+
+/*******************************************************************************
+*      Function: benchExtractPacket()
+*   Description: Extracts the text and key segments of the formed packet.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchExtractPacket(struct benchState *s) {
+    benchSink = extractPacket(s->packet, s->packetLen - 1, s->extractText,
+                              s->packetLen, s->extractKey, s->packetLen,
+                              OTP_ENCIPHER);
+}
+
+/*******************************************************************************
+*      Function: benchPacketInPlace()
+*   Description: Locates the segments of the formed packet and enciphers the
+*                text segment where it lies, as the daemons do. Repeated passes
+*                keep the text valid.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchPacketInPlace(struct benchState *s) {
+    int len;
+
+    if (locatePacket(s->packet, segmentToPacketLen(s->size), OTP_ENCIPHER, 
+                     &len) < 0) {
+        benchSink = -1;
+        return;
+    }
+    cipherBlock(&s->packet[OTP_HEADER_BYTES], &s->packet[len + 2], len, 
+                OTP_ENCIPHER);
+    benchSink = s->packet[OTP_HEADER_BYTES];
+}
+
+/*******************************************************************************
+*      Function: benchProcessResponse()
+*   Description: Processes a server response of the input size. The delimiter
+*                consumed by processResponse() is restored after each call.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchProcessResponse(struct benchState *s) {
+    benchSink = processResponse(s->work);
+    s->work[s->size] = OTP_DELIMITER;
+}
+
+/*******************************************************************************
+*      Function: benchXorBlock()
+*   Description: Applies the binary XOR kernel in place over the scratch buffer.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchXorBlock(struct benchState *s) {
+    xorBlock(s->work, s->key, s->size);
+    benchSink = s->work[0];
+}
+
+/*******************************************************************************
+*     Functions: benchCipherBlock(), benchPackedCipher()
+*   Description: Enciphers the text in place, one character per byte or packed
+*                at 5 bits per symbol. The character case first copies the text
+*                into the scratch buffer, which other cases overwrite.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchCipherBlock(struct benchState *s) {
+    memcpy(s->work, s->text, s->size);
+    cipherBlock(s->work, s->key, s->size, OTP_ENCIPHER);
+    benchSink = s->work[0];
+}
+
+void benchPackedCipher(struct benchState *s) {
+    benchSink = packedCipher(s->packedText, s->packed, s->size, OTP_ENCIPHER);
+}
+
+/*******************************************************************************
+*     Functions: benchProcessFrame(), benchProcessFramePacked()
+*   Description: Processes a frame holding the whole input as one segment,
+*                which is split across threads above PARALLEL_THRESHOLD. The
+*                character case first copies the text into the frame.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchProcessFrame(struct benchState *s) {
+    struct otpFrameHeader header = {OTP_ENCIPHER, OTP_CIPHER_TEXT, 0, 
+                                    s->size, 0, 0};
+
+    memcpy(s->frame, s->text, s->size);
+    benchSink = processFrame(s->frame, &header);
+}
+
+void benchProcessFramePacked(struct benchState *s) {
+    struct otpFrameHeader header = {OTP_ENCIPHER, OTP_CIPHER_TEXT, 
+                                    OTP_FRAME_PACKED, s->size, 0, 0};
+
+    benchSink = processFrame((char *)s->packedFrame, &header);
+}
+
+/*******************************************************************************
+*     Functions: benchPackSymbols(), benchUnpackSymbols()
+*   Description: Packs the key, or unpacks the packed key, in memory.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchPackSymbols(struct benchState *s) {
+    packSymbols(s->key, s->size, s->packed);
+    benchSink = s->packed[0];
+}
+
+void benchUnpackSymbols(struct benchState *s) {
+    benchSink = unpackSymbols(s->packed, s->size, s->work);
+}
+
+/*******************************************************************************
+*      Function: benchPadReadPacked()
+*   Description: Reads the whole key back from the temporary packed pad.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchPadReadPacked(struct benchState *s) {
+    rewind(s->packedFile);
+    padOpen(&s->packedPad, s->packedFile, 0);
+    benchSink = padRead(&s->packedPad, s->work, s->size);
+}
+
+/*******************************************************************************
+*      Function: benchPadReadIndexed()
+*   Description: Opens the temporary indexed pad and reads the whole key back,
+*                verifying every block.
+*    Parameters: struct benchState *s - The benchmark state.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchPadReadIndexed(struct benchState *s) {
+    rewind(s->indexedFile);
+    padOpen(&s->indexedPad, s->indexedFile, 0);
+    benchSink = padRead(&s->indexedPad, s->work, s->size);
+    padClose(&s->indexedPad);
+}
+
+/*******************************************************************************
+*      Function: benchPrintField()
+*   Description: Prints a counter derived field, or an empty CSV field or JSON
+*                null if a counter it needs was unavailable.
+*    Parameters: int format - The output format.
+*                const char *name - The JSON field name.
+*                double value - The value.
+*                int available - Nonzero if the value could be computed.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void benchPrintField(int format, const char *name, double value,
+                     int available) {
+    if (format == BENCH_FORMAT_JSON) {
+        if (available) {
+            printf(", \"%s\": %.3f", name, value);
+        } else {
+            printf(", \"%s\": null", name);
+        }
+    } else if (available) {
+        printf(",%.3f", value);
+    } else {
+        printf(",");
+    }
+}
+
+/*******************************************************************************
+*      Function: benchPrintCounters()
+*   Description: Prints the fields derived from the hardware counters.
+*    Parameters: int format - The output format.
+*                const uint64_t *counts - The PERF_EVENTS counts.
+*                double bytes - The input bytes processed while counting.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void benchPrintCounters(int format, const uint64_t *counts, double bytes) {
+    uint64_t cycles = counts[PERF_CYCLES];
+    uint64_t instructions = counts[PERF_INSTRUCTIONS];
+
+    benchPrintField(format, "core_cycles_per_byte", cycles / bytes,
+                    cycles != PERF_UNAVAILABLE);
+    benchPrintField(format, "ipc", (double)instructions / cycles,
+                    cycles != PERF_UNAVAILABLE && cycles > 0 &&
+                    instructions != PERF_UNAVAILABLE);
+    benchPrintField(format, "l1d_misses_per_kb",
+                    counts[PERF_L1D_MISSES] * 1024.0 / bytes,
+                    counts[PERF_L1D_MISSES] != PERF_UNAVAILABLE);
+    benchPrintField(format, "llc_misses_per_kb",
+                    counts[PERF_LLC_MISSES] * 1024.0 / bytes,
+                    counts[PERF_LLC_MISSES] != PERF_UNAVAILABLE);
+    benchPrintField(format, "branch_misses_per_kb",
+                    counts[PERF_BRANCH_MISSES] * 1024.0 / bytes,
+                    counts[PERF_BRANCH_MISSES] != PERF_UNAVAILABLE);
+}
+
+/*******************************************************************************
+*      Function: benchMeasure()
+*   Description: Runs a case repeatedly until BENCH_MIN_NS have elapsed and
+*                reports the result.
+*    Parameters: const struct benchCase *c - The case.
+*                struct benchState *s - The benchmark state.
+*                int format - The output format.
+*                int *first - Set while no JSON record has been written.
+*                struct perfCounters *perf - The hardware counters.
+* Preconditions: The state has been initialized.
+*       Returns: None.
+*******************************************************************************/
+
+void benchMeasure(const struct benchCase *c, struct benchState *s, int format,
+                  int *first, struct perfCounters *perf) {
+    uint64_t counts[PERF_EVENTS];
+    uint64_t iters = 0;
+    uint64_t batch = 1;
+    uint64_t i, startNs, startCycles, elapsedNs, elapsedCycles;
+    double nsPerOp, bytesPerSec, cyclesPerByte;
+
+    /* Prepare the scratch buffer for the in place cases */
+    memcpy(s->work, s->text, s->size + 1);
+    if (c->run == benchProcessResponse) {
+        sprintf(&s->work[s->size], "%c%c", OTP_DELIMITER, OTP_END_DELIM);
+    }
+
+    /* Warm up caches and branch predictors */
+    c->run(s);
+
+    perfStart(perf);
+    startNs = timeNowNs();
+    startCycles = timeCycles();
+    do {
+        for (i = 0; i < batch; i++) {
+            c->run(s);
+        }
+        iters += batch;
+        batch *= 2;
+        elapsedNs = timeNowNs() - startNs;
+    } while (elapsedNs < BENCH_MIN_NS);
+    elapsedCycles = timeCycles() - startCycles;
+    perfStop(perf, counts);
+
+    nsPerOp = (double)elapsedNs / iters;
+    bytesPerSec = (double)s->size * iters * TIME_NS_PER_SEC / elapsedNs;
+    cyclesPerByte = (double)elapsedCycles / ((double)s->size * iters);
+
+    if (format == BENCH_FORMAT_JSON) {
+        printf("%s  {\"function\": \"%s\", \"size\": %d, \"iterations\": %llu, "
+               "\"ns_per_op\": %.1f, \"bytes_per_sec\": %.0f, "
+               "\"cycles_per_byte\": %.3f", *first ? "" : ",\n", c->name,
+               s->size, (unsigned long long)iters, nsPerOp, bytesPerSec,
+               cyclesPerByte);
+        *first = 0;
+    } else {
+        printf("%s,%d,%llu,%.1f,%.0f,%.3f", c->name, s->size,
+               (unsigned long long)iters, nsPerOp, bytesPerSec, cyclesPerByte);
+    }
+    benchPrintCounters(format, counts, (double)s->size * iters);
+    printf(format == BENCH_FORMAT_JSON ? "}" : "\n");
+    fflush(stdout);
+}
+
+/*******************************************************************************
+*      Function: main()
+*   Description: The main benchmark function.
+*    Parameters: int argc - The argument count.
+*                char **argv - The argument list.
+* Preconditions: None.
+*       Returns: 0 on success, 1 on error.
+*******************************************************************************/
+
+int main(int argc, char **argv) {
+    struct benchState state;
+    struct perfCounters perf;
+    const char *filter = NULL;
+    int format = BENCH_FORMAT_CSV;
+    int minSize = BENCH_SIZE_MIN;
+    int maxSize = BENCH_SIZE_MAX;
+    int first = 1;
+    int opt, size;
+    size_t i;
+
+    while ((opt = getopt(argc, argv, "jm:M:f:")) != -1) {
+        switch (opt) {
+            case 'j':
+                format = BENCH_FORMAT_JSON;
+                break;
+            case 'm':
+                minSize = atoi(optarg);
+                break;
+            case 'M':
+                maxSize = atoi(optarg);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: otp_bench [-j] [-m min_size] "
+                        "[-M max_size] [-f function]\n");
+                exit(1);
+        }
+    }
+    if (minSize <= 0 || maxSize < minSize) {
+        fprintf(stderr, "otp_bench: invalid size range\n");
+        exit(1);
+    }
+
+    /* Calibrate the cycle counter before any measurement */
+    fprintf(stderr, "otp_bench: %.3f cycles/ns\n", timeCyclesPerNs());
+
+    /* Missing hardware counters leave their fields empty */
+    if (perfOpen(&perf) == 0) {
+        fprintf(stderr, "otp_bench: hardware counters unavailable: %s\n",
+                strerror(errno));
+    } else if (perf.opened < PERF_EVENTS) {
+        fprintf(stderr, "otp_bench: %d of %d hardware counters available\n",
+                perf.opened, PERF_EVENTS);
+    }
+
+    if (format == BENCH_FORMAT_JSON) {
+        printf("[\n");
+    } else {
+        printf("function,size,iterations,ns_per_op,bytes_per_sec,"
+               "cycles_per_byte,core_cycles_per_byte,ipc,l1d_misses_per_kb,"
+               "llc_misses_per_kb,branch_misses_per_kb\n");
+    }
+
+    for (size = minSize; size <= maxSize; size *= BENCH_SIZE_STEP) {
+        if (benchStateInit(&state, size) < 0) {
+            benchStateFree(&state);
+            exit(1);
+        }
+        for (i = 0; i < sizeof(benchCases) / sizeof(benchCases[0]); i++) {
+            if (filter && strcmp(filter, benchCases[i].name) != 0) {
+                continue;
+            }
+            benchMeasure(&benchCases[i], &state, format, &first, &perf);
+        }
+        benchStateFree(&state);
+    }
+
+    if (format == BENCH_FORMAT_JSON) {
+        printf("\n]\n");
+    }
+    perfClose(&perf);
+    return 0;
+}
@@ -0,0 +1,57 @@
+/*******************************************************************************
+*      Filename: otp_bench.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for otp_bench.c. Please see otp_bench.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef OTP_BENCH_H
+#define OTP_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pad_utils.h"
+
+#define BENCH_SIZE_MIN          16  /* Default smallest input size */
+#define BENCH_SIZE_MAX     1048576  /* Default largest input size */
+#define BENCH_SIZE_STEP          4  /* Multiplier between sweep sizes */
+#define BENCH_MIN_NS      50000000  /* Minimum measured time per case */
+#define BENCH_FORMAT_CSV         0  /* CSV output format */
+#define BENCH_FORMAT_JSON        1  /* JSON output format */
+
+/* Buffers and files shared by every benchmark case at one input size */
+struct benchState {
+    int size;            /* The input size in bytes */
+    char *text;          /* Valid text of length size, NUL terminated */
+    char *key;           /* Valid key of length size, NUL terminated */
+    char *work;          /* Scratch buffer of length size + 3 */
+    char *packet;        /* A formed packet for the text and key */
+    char *scratchPacket; /* Packet buffer written by formPacket() */
+    int packetLen;       /* The packet buffer length */
+    char *extractText;   /* Extraction text buffer */
+    char *extractKey;    /* Extraction key buffer */
+    FILE *textFile;      /* A temporary file holding text */
+    FILE *keyFile;       /* A temporary file holding key */
+    struct otpPad keyPad;  /* The key file opened as a text pad */
+    unsigned char *packed; /* The key packed at 5 bits per symbol */
+    unsigned char *packedText; /* The text packed at 5 bits per symbol */
+    FILE *packedFile;      /* A temporary packed pad holding the key */
+    struct otpPad packedPad; /* The packed pad */
+    FILE *indexedFile;     /* A temporary indexed pad holding the key */
+    struct otpPad indexedPad; /* The indexed pad */
+    char *frame;           /* A frame segment pair: scratch text, then key */
+    unsigned char *packedFrame; /* The packed text, then the packed key */
+};
+
+/* A single benchmarked operation over the whole input */
+struct benchCase {
+    const char *name;
+    void (*run)(struct benchState *);
+};
+
+#endif
@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: otp_dec.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The one-time pad decryption client.
 *******************************************************************************/
 
@@ -19,12 +19,19 @@
 *******************************************************************************/
 
 int main(int argc, char **argv) {
+    struct otpClientConfig config;
+
     /* Validate arguments */
-    if (argc != OTP_ARGS) {
-        fprintf(stderr, "Usage: otp_enc plaintext key port\n");
+    if (otpClientArgs(argc, argv, OTP_DECIPHER, &config) < 0) {
+        fprintf(stderr, "Usage: otp_dec [-b | -P | -A alphabet] [-f segment] "
+                "[-k checkpoint]\n"
+                "               [-L p2c | lor] [-H state] "
+                "[-O system | latency | throughput]\n"
+                "               "
+                "ciphertext key port[,port...]\n");
         exit(1);
     }
 
     /* Run the client in decipher mode */
-    return otp_client(argv[1], argv[2], argv[3], OTP_DECIPHER);
+    return otp_client(&config);
 }
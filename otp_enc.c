@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: otp_enc.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The one-time pad encryption client.
 *******************************************************************************/
 
@@ -18,11 +18,18 @@
 *******************************************************************************/
 
 int main(int argc, char **argv) {
-    /* Validate the argument count */
-    if (argc != OTP_ARGS) {
-        fprintf(stderr, "Usage: otp_enc plaintext key port\n");
+    struct otpClientConfig config;
+
+    /* Validate the arguments */
+    if (otpClientArgs(argc, argv, OTP_ENCIPHER, &config) < 0) {
+        fprintf(stderr, "Usage: otp_enc [-b | -P | -A alphabet] [-f segment] "
+                "[-k checkpoint]\n"
+                "               [-L p2c | lor] [-H state] "
+                "[-O system | latency | throughput]\n"
+                "               "
+                "plaintext key port[,port...]\n");
         exit(1);
     }
     /* Execute the one-time pad client in encipher mode */
-    return otp_client(argv[1], argv[2], argv[3], OTP_ENCIPHER);
+    return otp_client(&config);
 }
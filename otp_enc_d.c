@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: otp_enc_d.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The one-time pad encryption server.
 *******************************************************************************/
 
@@ -18,11 +18,18 @@
 *******************************************************************************/
 
 int main(int argc, char **argv) {
-    /* Validate the argument count. */
-    if (argc != OTP_D_ARGS) {
-        fprintf(stderr, "Usage: otp_enc_d listening_port\n");
+    struct otpServerConfig config;
+
+    /* Validate the arguments. */
+    if (otpServerArgs(argc, argv, OTP_ENCIPHER, &config) < 0) {
+        fprintf(stderr, "Usage: otp_enc_d [-E fork|epoll] [-m pool_mb] "
+                "[-q quantum] [-R flag|reject[:index_mb]] [-s stats_port] "
+                "[-S cores]\n                 [-C sizes|payload:file] "
+                "[-c one_in]\n                 [-T read_ms:write_ms:idle_ms] "
+                "[-b backlog] [-a max_inflight[:queue_ms]]\n"
+                "                 listening_port\n");
         exit(1);
     }
     /* Execute the server in encipher mode */
-    return otp_server(argv[1], OTP_ENCIPHER);
+    return otp_server(&config);
 }
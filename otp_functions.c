@@ -1,66 +1,348 @@
 /*******************************************************************************
 *      Filename: otp_functions.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The main client and server functions.
 *******************************************************************************/
 
+#include "admit_utils.h"
+#include "affinity_utils.h"
+#include "balance_utils.h"
+#include "capture_utils.h"
 #include "cipher_utils.h"
+#include "event_utils.h"
 #include "file_utils.h"
 #include "msg_utils.h"
 #include "otp_functions.h"
+#include "pad_utils.h"
+#include "pool_utils.h"
+#include "reuse_utils.h"
 #include "signal_utils.h"
 #include "socket_utils.h"
+#include "stats_utils.h"
+#include "time_utils.h"
+#include "trace_utils.h"
+
+/*******************************************************************************
+*      Function: otpClientArgs()
+*   Description: Parses the client command line.
+*    Parameters: int argc - The argument count.
+*                char **argv - The argument list.
+*                int mode - The cipher mode of the client.
+*                struct otpClientConfig *config - The configuration to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on invalid arguments.
+*******************************************************************************/
+
+int otpClientArgs(int argc, char **argv, int mode, 
+                  struct otpClientConfig *config) {
+    const struct otpAlphabet *alphabet;
+    char *end;
+    long segment;
+    int opt;
+
+    memset(config, 0, sizeof(*config));
+    config->mode = mode;
+    config->cipher = OTP_CIPHER_TEXT;
+    config->segmentMax = OTP_FRAME_SEGMENT_DEFAULT;
+
+    while ((opt = getopt(argc, argv, "bPk:A:f:L:H:O:")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (config->cipher != OTP_CIPHER_TEXT) {
+                    return -1;
+                }
+                config->cipher = OTP_CIPHER_XOR;
+                break;
+            case 'A':
+                alphabet = alphabetByName(optarg);
+                if (!alphabet || config->cipher != OTP_CIPHER_TEXT) {
+                    return -1;
+                }
+                config->cipher = alphabet->cipher;
+                break;
+            case 'P':
+                config->frameFlags |= OTP_FRAME_PACKED;
+                break;
+            case 'k':
+                config->checkpoint = optarg;
+                break;
+            case 'f':
+                segment = strtol(optarg, &end, 10);
+                if (*end || segment <= 0 || segment > OTP_FRAME_SEGMENT_MAX) {
+                    return -1;
+                }
+                config->segmentMax = (int)segment;
+                break;
+            case 'L':
+                if (strcmp(optarg, "p2c") == 0) {
+                    config->balancePolicy = BALANCE_P2C;
+                } else if (strcmp(optarg, "lor") == 0) {
+                    config->balancePolicy = BALANCE_LOR;
+                } else {
+                    return -1;
+                }
+                break;
+            case 'H':
+                config->balanceState = optarg;
+                break;
+            case 'O':
+                config->profile = parseProfile(optarg);
+                if (config->profile < 0) {
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    /* Only text cipher segments can be packed */
+    if (config->cipher != OTP_CIPHER_TEXT && 
+        (config->frameFlags & OTP_FRAME_PACKED)) {
+        return -1;
+    }
+    /* The text, key and endpoint list positional arguments must remain */
+    if (argc - optind != OTP_ARGS - 1) {
+        return -1;
+    }
+    config->text = argv[optind];
+    config->key = argv[optind + 1];
+    config->port = argv[optind + 2];
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: otpClientResume()
+*   Description: Positions the text and key at a checkpoint and waits before
+*                reconnecting.
+*    Parameters: FILE *ptextPtr - The text file pointer.
+*                struct otpPad *keyPad - The key pad.
+*                const struct otpCheckpoint *ckpt - The checkpoint.
+*                int attempt - The number of reconnects so far, 0 when resuming
+*                              a checkpoint left by an earlier run.
+* Preconditions: The files have been validated.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int otpClientResume(FILE *ptextPtr, struct otpPad *keyPad, 
+                    const struct otpCheckpoint *ckpt, int attempt) {
+    struct timespec delay;
+    long ms;
+
+    if (attempt > 0) {
+        ms = (long)OTP_RESUME_BACKOFF_MS << (attempt - 1);
+        delay.tv_sec = ms / 1000;
+        delay.tv_nsec = (ms % 1000) * 1000000;
+        while (nanosleep(&delay, &delay) < 0) {
+            ;
+        }
+    }
+    if (fseeko(ptextPtr, ckpt->offset, SEEK_SET) < 0) {
+        perror("otpClientResume: fseeko");
+        return -1;
+    }
+    return padSeek(keyPad, ckpt->offset);
+}
+
+/*******************************************************************************
+*      Function: otpClientBackoff()
+*   Description: Waits a random time between half of and the full backoff.
+*    Parameters: long ms - The backoff in milliseconds.
+*                unsigned int *seed - The random seed.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void otpClientBackoff(long ms, unsigned int *seed) {
+    struct timespec delay;
+
+    ms = ms / 2 + rand_r(seed) % (ms / 2 + 1);
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (ms % 1000) * 1000000;
+    while (nanosleep(&delay, &delay) < 0) {
+        ;
+    }
+}
 
 /*******************************************************************************
 *      Function: otp_client()
 *   Description: The main otp_client procedure.
-*    Parameters: const char *ptext - The text filename.
-*                const char *key - The key filename.
-*                const char *port - The port value string.
-*                int mode - The cipher mode.
-* Preconditions: The client argument count has been validated.
+*    Parameters: struct otpClientConfig *config - The client configuration.
+* Preconditions: The client arguments have been validated.
 *       Returns: 0 on success, 1 on file error, 2 on connection error.
 *******************************************************************************/
 
-int otp_client(const char *ptext, const char *key, const char *port, 
-                   int mode) {
+int otp_client(struct otpClientConfig *config) {
     int sockfd, ptextSize, keySize, status;
+    int mode = config->mode;
+    int attempt = 0;
+    int busy = 0;
+    int stream = 0;
+    struct stat textStat;
     FILE *ptextPtr, *keyPtr;
+    struct otpPad keyPad;
+    struct otpCheckpoint ckpt = {0};
+    const struct otpAlphabet *alphabet = alphabetByCipher(config->cipher);
+    struct balancer balancer;
+    uint64_t traceStart;
 
-    /* Attempt to open the text and key files. */
-    ptextPtr = fopen(ptext, "r");
+    traceInit(mode == OTP_ENCIPHER ? "otp_enc" : "otp_dec");
+
+    /* Attempt to open the text and key files. The text may be stdin. */
+    ptextPtr = strcmp(config->text, "-") == 0 ? stdin : 
+                                                fopen(config->text, "r");
     if (!ptextPtr) {
         perror("fopen");
         exit(1);
     }
-    keyPtr = fopen(key, "r");
+    /* Text that is not a regular file, such as a pipe, is streamed */
+    if (fstat(fileno(ptextPtr), &textStat) < 0) {
+        perror("fstat");
+        exit(1);
+    }
+    stream = !S_ISREG(textStat.st_mode);
+    if (stream && config->checkpoint) {
+        fprintf(stderr, "Error: a streamed transfer cannot be resumed\n");
+        exit(1);
+    }
+    keyPtr = fopen(config->key, "r");
     if (!keyPtr) {
         perror("fopen");
         exit(1);
     }
+    /* Detect the key pad format. Binary keys are always raw bytes. */
+    if (padOpen(&keyPad, keyPtr, config->cipher == OTP_CIPHER_XOR) < 0) {
+        exit(1);
+    }
+    /* Packed and indexed pads hold only the default alphabet */
+    if (alphabet && alphabet != OTP_ALPHABET_TEXT && 
+        keyPad.format != PAD_FORMAT_TEXT) {
+        fprintf(stderr, "Error: the key pad does not hold the %s alphabet\n",
+                alphabet->name);
+        exit(1);
+    }
   
-    /* Validate both files */
-    status = validateFiles(ptextPtr, keyPtr, &ptextSize, &keySize);
+    /* Validate both files. Binary files are only checked for length. A 
+     * stream is validated as it is read. */
+    traceStart = traceBegin();
+    if (stream) {
+        ptextSize = 0;
+        keySize = config->cipher == OTP_CIPHER_XOR ? 
+                  validateFileSize(keyPtr) : validatePad(&keyPad, alphabet);
+        status = keySize;
+    } else if (config->cipher == OTP_CIPHER_XOR) {
+        status = validateBinaryFiles(ptextPtr, &keyPad, &ptextSize, &keySize);
+    } else {
+        status = validateFiles(ptextPtr, &keyPad, &ptextSize, &keySize,
+                               alphabet);
+    }
+    traceEnd("validate", traceStart);
     if (status < 0) {
         exit(1);
     }
 
-    /* Attempt to connect to the port */
-    sockfd = clientConnect(port);
-    if (sockfd < 0) {
-        exit(2);
+    /* A resumable transfer picks up where its checkpoint left off */
+    if (config->checkpoint) {
+        ckpt.path = config->checkpoint;
+        ckpt.mode = mode;
+        ckpt.cipher = config->cipher;
+        ckpt.textSize = ptextSize;
+        ckpt.keySize = keySize;
+        if (checkpointLoad(&ckpt) < 0 || 
+            checkpointRestoreOutput(stdout, ckpt.offset) < 0 ||
+            (ckpt.offset > 0 && 
+             otpClientResume(ptextPtr, &keyPad, &ckpt, 0) < 0)) {
+            exit(1);
+        }
     }
+
+    if (balanceInit(&balancer, config->port, config->balancePolicy,
+                    config->balanceState, config->profile) < 0) {
+        exit(1);
+    }
+
+    while (1) {
+        /* Attempt to connect to an endpoint. One that cannot be reached is
+         * held down and another is tried. */
+        traceStart = traceBegin();
+        sockfd = balanceConnect(&balancer);
+        traceEnd("connect", traceStart);
+        status = -1;
    
-    /* Perform all message sending and receiving operations */ 
-    status = clientProcessMessage(sockfd, ptextPtr, keyPtr, ptextSize, mode);
-    if (status < 0) {
-        fprintf(stderr, "Error: could not contact otp_%s_d on port %s\n", 
-                mode == OTP_ENCIPHER ? "enc" : "dec", port);
-        exit(2);
-    } 
+        /* Perform all message sending and receiving operations. Resumable
+         * transfers always use frames, which carry their offsets, as do
+         * ciphers other than the default text alphabet and transfers with a
+         * chosen segment length. */ 
+        if (sockfd < 0) {
+            status = -1;
+        } else if (stream) {
+            status = clientProcessStream(sockfd, fileno(ptextPtr), &keyPad,
+                                         keySize, mode, config->cipher,
+                                         config->frameFlags, 
+                                         config->segmentMax, stdout);
+            if (status == -2) {
+                exit(1);
+            }
+        } else if (config->cipher != OTP_CIPHER_TEXT || config->checkpoint ||
+                   (config->frameFlags & OTP_FRAME_PACKED) ||
+                   config->segmentMax != OTP_FRAME_SEGMENT_DEFAULT) {
+            status = clientProcessFrames(sockfd, ptextPtr, &keyPad, ptextSize, 
+                                         mode, config->cipher, 
+                                         config->frameFlags, 
+                                         config->segmentMax, stdout, 
+                                         config->checkpoint ? &ckpt : NULL);
+        } else {
+            status = clientProcessMessage(sockfd, ptextPtr, &keyPad, 
+                                          ptextSize, mode, stdout);
+        }
+        if (sockfd >= 0) {
+            close(sockfd);
+        }
+        balanceFinish(&balancer, status == 0);
+        if (status == 0) {
+            break;
+        }
+
+        /* A busy daemon turns a connection away before any text is
+         * processed, so the transfer starts again where it stood, after a
+         * randomized backoff that spreads out the clients it turned away.
+         * Text already read from a stream cannot be sent again. */
+        if (status == OTP_BUSY) {
+            if (stream || busy >= OTP_BUSY_RETRIES) {
+                fprintf(stderr, "Error: otp_%s_d on port %s is busy\n",
+                        mode == OTP_ENCIPHER ? "enc" : "dec", config->port);
+                exit(2);
+            }
+            busy++;
+            otpClientBackoff((long)OTP_BUSY_BACKOFF_MS << (busy - 1),
+                             &balancer.seed);
+            if (otpClientResume(ptextPtr, &keyPad, &ckpt, 0) < 0) {
+                exit(1);
+            }
+            continue;
+        }
+
+        /* Reconnect, possibly to another endpoint, and resume from the last
+         * checkpoint */
+        if (!config->checkpoint || attempt >= OTP_RESUME_RETRIES) {
+            fprintf(stderr, "Error: could not contact otp_%s_d on port %s\n", 
+                    mode == OTP_ENCIPHER ? "enc" : "dec", config->port);
+            exit(2);
+        }
+        attempt++;
+        fprintf(stderr, "Connection lost at offset %lld, resuming\n", 
+                ckpt.offset);
+        if (otpClientResume(ptextPtr, &keyPad, &ckpt, attempt) < 0) {
+            exit(1);
+        }
+    }
+    if (config->checkpoint) {
+        checkpointRemove(&ckpt);
+    }
+    balanceClose(&balancer);
 
     /* Close both files */
+    padClose(&keyPad);
     if (fclose(ptextPtr) == EOF) {
         perror("fclose");
     }
@@ -72,73 +354,510 @@ int otp_client(const char *ptext, const char *key, const char *port,
 }
 
 /*******************************************************************************
-*      Function: otp_server()
-*   Description: The otp server main function.
-*    Parameters: const char *port - The port string.
-*                int mode - The cipher mode.
-* Preconditions: The server arguments have been validated.
-*       Returns: 0 on success, 1 on error.
+*      Function: parseTimeouts()
+*   Description: Parses the connection deadlines, given as
+*                read_ms:write_ms:idle_ms. A deadline of 0 is disabled.
+*    Parameters: const char *spec - The deadlines.
+*                struct otpTimeouts *timeouts - The deadlines to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on invalid deadlines.
 *******************************************************************************/
 
-int otp_server(const char *port, int mode) {
-    struct sockaddr_in clientAddress = {0};
+int parseTimeouts(const char *spec, struct otpTimeouts *timeouts) {
+    int *fields[3] = {&timeouts->readMs, &timeouts->writeMs,
+                      &timeouts->idleMs};
+    char *endptr;
+    long ms;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        errno = 0;
+        ms = strtol(spec, &endptr, 10);
+        if (errno || endptr == spec || ms < 0 || ms > INT_MAX ||
+            *endptr != (i < 2 ? ':' : '\0')) {
+            return -1;
+        }
+        *fields[i] = (int)ms;
+        spec = endptr + 1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: otpServerArgs()
+*   Description: Parses the daemon command line.
+*    Parameters: int argc - The argument count.
+*                char **argv - The argument list.
+*                int mode - The cipher mode of the daemon.
+*                struct otpServerConfig *config - The configuration to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on invalid arguments.
+*******************************************************************************/
+
+int otpServerArgs(int argc, char **argv, int mode, 
+                  struct otpServerConfig *config) {
+    char *endptr;
+    long megabytes, quantum, oneIn, backlog, limit, queueMs;
+    int opt;
+
+    memset(config, 0, sizeof(*config));
+    config->mode = mode;
+    config->engine = OTP_ENGINE_FORK;
+    config->poolBudget = POOL_BUDGET_DEFAULT;
+    config->quantum = EV_QUANTUM_DEFAULT;
+    config->reuseBytes = (size_t)REUSE_INDEX_MB_DEFAULT << 20;
+    config->captureOneIn = 1;
+    config->timeouts.readMs = OTP_READ_TIMEOUT_MS;
+    config->timeouts.writeMs = OTP_WRITE_TIMEOUT_MS;
+    config->timeouts.idleMs = OTP_IDLE_TIMEOUT_MS;
+    config->backlog = OTP_CONN_MAX;
+
+    while ((opt = getopt(argc, argv, "s:E:m:S:q:R:C:c:T:b:a:")) != -1) {
+        switch (opt) {
+            case 's':
+                config->statsPort = optarg;
+                break;
+            case 'E':
+                if (strcmp(optarg, "fork") == 0) {
+                    config->engine = OTP_ENGINE_FORK;
+                } else if (strcmp(optarg, "epoll") == 0) {
+                    config->engine = OTP_ENGINE_EPOLL;
+                } else {
+                    return -1;
+                }
+                break;
+            case 'm':
+                megabytes = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || megabytes <= 0) {
+                    return -1;
+                }
+                config->poolBudget = (size_t)megabytes << 20;
+                break;
+            case 'q':
+                quantum = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || quantum <= 0 || quantum > INT_MAX) {
+                    return -1;
+                }
+                config->quantum = (int)quantum;
+                break;
+            case 'R':
+                /* A policy, optionally followed by the index size */
+                if (strncmp(optarg, "flag", 4) == 0) {
+                    config->reusePolicy = REUSE_FLAG;
+                    endptr = &optarg[4];
+                } else if (strncmp(optarg, "reject", 6) == 0) {
+                    config->reusePolicy = REUSE_REJECT;
+                    endptr = &optarg[6];
+                } else {
+                    return -1;
+                }
+                if (*endptr == ':') {
+                    megabytes = strtol(&endptr[1], &endptr, 10);
+                    if (*endptr != '\0' || megabytes <= 0) {
+                        return -1;
+                    }
+                    config->reuseBytes = (size_t)megabytes << 20;
+                } else if (*endptr != '\0') {
+                    return -1;
+                }
+                break;
+            case 'C':
+                /* What to record, followed by the capture file */
+                if (strncmp(optarg, "sizes:", 6) == 0) {
+                    config->capturePayload = 0;
+                    config->capture = &optarg[6];
+                } else if (strncmp(optarg, "payload:", 8) == 0) {
+                    config->capturePayload = 1;
+                    config->capture = &optarg[8];
+                } else {
+                    return -1;
+                }
+                if (*config->capture == '\0') {
+                    return -1;
+                }
+                break;
+            case 'c':
+                oneIn = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || oneIn <= 0 || oneIn > INT_MAX) {
+                    return -1;
+                }
+                config->captureOneIn = (int)oneIn;
+                break;
+            case 'T':
+                if (parseTimeouts(optarg, &config->timeouts) < 0) {
+                    return -1;
+                }
+                break;
+            case 'b':
+                backlog = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || backlog <= 0 || backlog > INT_MAX) {
+                    return -1;
+                }
+                config->backlog = (int)backlog;
+                break;
+            case 'a':
+                /* A concurrency limit, optionally followed by how long a
+                 * connection over it may wait */
+                limit = strtol(optarg, &endptr, 10);
+                if (endptr == optarg || limit <= 0 || 
+                    limit > ADMIT_INFLIGHT_MAX) {
+                    return -1;
+                }
+                queueMs = 0;
+                if (*endptr == ':') {
+                    queueMs = strtol(&endptr[1], &endptr, 10);
+                    if (queueMs < 0 || queueMs > ADMIT_QUEUE_MS_MAX) {
+                        return -1;
+                    }
+                }
+                if (*endptr != '\0') {
+                    return -1;
+                }
+                config->admitLimit = (int)limit;
+                config->admitQueueMs = (int)queueMs;
+                break;
+            case 'S':
+                free(config->shardCores);
+                config->shards = parseCoreList(optarg, &config->shardCores);
+                if (config->shards < 0) {
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+    /* Exactly one positional argument, the listening port, must remain */
+    if (argc - optind != OTP_D_ARGS - 1) {
+        return -1;
+    }
+    config->port = argv[optind];
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: otpServeListener()
+*   Description: Serves connections from a listening socket with the configured
+*                engine. Only returns in a forked child or on error. The fork
+*                engine accepts connections in batches and holds those over the
+*                concurrency limit until a slot frees or their wait runs out.
+*    Parameters: struct otpServerConfig *config - The daemon configuration.
+*                int listenfd - The listening socket.
+*                int statsfd - The stats socket, or -1 if disabled.
+*                const char *daemon - The daemon name.
+* Preconditions: The listening socket is listening and SIGCHLD is ignored.
+*       Returns: A forked child's message status, or 1 on error.
+*******************************************************************************/
+
+int otpServeListener(struct otpServerConfig *config, int listenfd, int statsfd,
+                     const char *daemon) {
+    struct sockaddr_storage clientAddress = {0};
+    struct pollfd fds[1];
+    struct {
+        int fd;             /* The connection */
+        uint64_t until;     /* When it is turned away, in milliseconds */
+    } pending[ADMIT_QUEUE_MAX];
     socklen_t sizeOfClientInfo;
-    pid_t spawnpid = -5;
-    int listenfd, inboundfd, status;
+    pid_t spawnpid;
+    uint64_t connStart, traceStart, now;
+    int inboundfd, status, slot, i;
+    int head = 0, count = 0;
 
-    sizeOfClientInfo = sizeof(clientAddress);
+    /* Scrapes are answered on a thread of their own, apart from clients */
+    if (statsfd >= 0 && statsStart(statsfd, daemon) < 0) {
+        return 1;
+    }
 
-    /* Register the SIGCHLD handler. This will automatically reap child
-     * processes. */
-    handlerRegister();
- 
-    /* Create the listening socket and bind it to the port */
-    listenfd = serverBind(port);
-    if (listenfd < 0) {
-        exit(1);
+    /* The event engine serves every connection from this process */
+    if (config->engine == OTP_ENGINE_EPOLL) {
+        eventServe(listenfd, config->mode, config->quantum, &config->timeouts,
+                   config->admitQueueMs);
+        return 1;
     }
 
-    /* Set up the listening socket state */
-    status = listen(listenfd, OTP_CONN_MAX);
-    if (status < 0) {
-        perror("listen");
-        exit(1);
+    /* Accepts are drained until the backlog is empty */
+    if (fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK) < 0) {
+        perror("otpServeListener: fcntl");
+        return 1;
     }
 
+    fds[0].fd = listenfd;
+    fds[0].events = POLLIN;
+
     while (1) {
-        /* Accept an inbound connection */
-        inboundfd = accept(listenfd, (struct sockaddr *)&clientAddress, 
-                           &sizeOfClientInfo);
-        if (inboundfd < 0) {
-            perror("accept");
-            close(inboundfd);
-        } else {
+        /* Wait for a client connection, or for a slot to free while
+         * connections are held */
+        traceTick();
+        if (poll(fds, 1, traceWaitMs(count > 0 ? ADMIT_POLL_MS : -1)) < 0) {
+            continue;
+        }
+
+        /* Accept a batch of inbound connections. A connection that cannot
+         * be held is turned away at once. */
+        for (i = 0; (fds[0].revents & POLLIN) && i < OTP_ACCEPT_BATCH; i++) {
+            sizeOfClientInfo = sizeof(clientAddress);
+            traceStart = traceBegin();
+            inboundfd = accept4(listenfd, (struct sockaddr *)&clientAddress, 
+                                &sizeOfClientInfo, 0);
+            traceEnd("accept", traceStart);
+            if (inboundfd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && 
+                    errno != EINTR) {
+                    perror("accept");
+                    STATS_ADD(errors[STATS_ERR_ACCEPT], 1);
+                }
+                break;
+            }
+            STATS_ADD(connAccepted, 1);
+            STATS_ADD(connActive, 1);
+            if (count == ADMIT_QUEUE_MAX) {
+                STATS_ADD(connActive, -1);
+                admitReject(inboundfd, config->mode);
+                continue;
+            }
+            pending[(head + count) % ADMIT_QUEUE_MAX].fd = inboundfd;
+            pending[(head + count) % ADMIT_QUEUE_MAX].until = 
+                timeNowNs() / TIME_NS_PER_MS + config->admitQueueMs;
+            count++;
+            STATS_ADD(connQueued, 1);
+        }
+
+        /* Serve held connections in the order they arrived while slots are
+         * free, then turn away those that have waited too long */
+        now = timeNowNs() / TIME_NS_PER_MS;
+        while (count > 0) {
+            slot = admitAcquire();
+            if (slot == ADMIT_FULL) {
+                break;
+            }
+            inboundfd = pending[head].fd;
+            head = (head + 1) % ADMIT_QUEUE_MAX;
+            count--;
+            STATS_ADD(connQueued, -1);
+
             /* Fork a process to handle the client */
+            traceStart = traceBegin();
             spawnpid = fork();
             switch(spawnpid) {
                 /* Error condition */
                 case -1:
                     perror("fork");
-                    exit(1);
+                    STATS_ADD(errors[STATS_ERR_FORK], 1);
+                    admitRelease(slot, ADMIT_RESERVED);
+                    return 1;
                     break;
                 /* Child process */
                 case 0:
+                    /* The child claims the slot before it can give it back */
+                    admitAssign(slot, getpid());
+                    traceFork();
+                    if (statsfd >= 0) {
+                        close(statsfd);
+                    }
+                    close(listenfd);
+                    for (i = 0; i < count; i++) {
+                        close(pending[(head + i) % ADMIT_QUEUE_MAX].fd);
+                    }
                     /* Receive and process the client message */
-                    status = serverProcessMessage(inboundfd, mode);
+                    connStart = timeNowNs();
+                    status = serverProcessMessage(inboundfd, config->mode,
+                                                  &config->timeouts,
+                                                  config->admitQueueMs, 
+                                                  &slot);
                     /* Regardless of error, shutdown and close the
                      * connection. Shutting down will prevent the
                      * client from blocking on recv(). */
                     shutdown(inboundfd, SHUT_RDWR);
                     close(inboundfd);
+                    STATS_RECORD(connDuration, timeNowNs() - connStart);
+                    STATS_ADD(connActive, -1);
+                    admitRelease(slot, getpid());
                     return status;
                     break;
                 /* Parent process */
                 default:
+                    traceEnd("fork", traceStart);
+                    /* The child owns the connection from here on */
+                    close(inboundfd);
                     break;
             }
         }
+        while (count > 0 && pending[head].until <= now) {
+            inboundfd = pending[head].fd;
+            head = (head + 1) % ADMIT_QUEUE_MAX;
+            count--;
+            STATS_ADD(connQueued, -1);
+            STATS_ADD(connActive, -1);
+            admitReject(inboundfd, config->mode);
+        }
     }
 
-    close(listenfd);
     return 0;
 }
+
+/*******************************************************************************
+*      Function: otpServeShards()
+*   Description: Runs one shard per configured core. Each shard is a process
+*                pinned to its core with its own listening socket on the shared
+*                port, so the kernel spreads connections across the shards and
+*                a shard's connections never leave its core. Shards that exit
+*                are restarted.
+*    Parameters: struct otpServerConfig *config - The daemon configuration.
+*                int statsfd - The stats socket, or -1 if disabled. Only the
+*                first shard serves it.
+*                const char *daemon - The daemon name.
+* Preconditions: The stats region is mapped.
+*       Returns: A shard's or forked child's status, or 1 on error.
+*******************************************************************************/
+
+int otpServeShards(struct otpServerConfig *config, int statsfd,
+                   const char *daemon) {
+    pid_t *pids;
+    pid_t pid;
+    int *listenfds;
+    int i, j;
+
+    pids = calloc(config->shards, sizeof(pid_t));
+    listenfds = malloc(config->shards * sizeof(int));
+    if (!pids || !listenfds) {
+        perror("otpServeShards: malloc");
+        return 1;
+    }
+
+    /* Bind every shard's socket up front so that a busy port fails at once */
+    for (i = 0; i < config->shards; i++) {
+        listenfds[i] = serverBind(config->port, 1);
+        if (listenfds[i] < 0) {
+            return 1;
+        }
+        if (listen(listenfds[i], config->backlog) < 0) {
+            perror("listen");
+            return 1;
+        }
+    }
+
+    while (1) {
+        for (i = 0; i < config->shards; i++) {
+            if (pids[i] > 0) {
+                continue;
+            }
+            pid = fork();
+            if (pid < 0) {
+                perror("fork");
+                STATS_ADD(errors[STATS_ERR_FORK], 1);
+                return 1;
+            }
+            if (pid == 0) {
+                /* Shards stop with the daemon */
+                if (prctl(PR_SET_PDEATHSIG, SIGTERM) < 0 || getppid() == 1) {
+                    exit(1);
+                }
+                /* Pin before anything is allocated so that the shard's memory
+                 * comes from its own node */
+                if (affinityPin(config->shardCores[i]) < 0) {
+                    exit(1);
+                }
+                handlerRegister();
+                for (j = 0; j < config->shards; j++) {
+                    if (j != i) {
+                        close(listenfds[j]);
+                    }
+                }
+                if (i != 0 && statsfd >= 0) {
+                    close(statsfd);
+                    statsfd = -1;
+                }
+                return otpServeListener(config, listenfds[i], statsfd, daemon);
+            }
+            pids[i] = pid;
+        }
+
+        /* Wait for a shard to exit, then restart it after a short delay */
+        traceTick();
+        pid = wait(NULL);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("wait");
+            return 1;
+        }
+        for (i = 0; i < config->shards; i++) {
+            if (pids[i] == pid) {
+                fprintf(stderr, "%s: shard %d on core %d exited\n", daemon, i,
+                        config->shardCores[i]);
+                pids[i] = 0;
+                usleep(OTP_SHARD_RESTART_MS * 1000);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: otp_server()
+*   Description: The otp server main function.
+*    Parameters: struct otpServerConfig *config - The daemon configuration.
+* Preconditions: The server arguments have been validated.
+*       Returns: 0 on success, 1 on error.
+*******************************************************************************/
+
+int otp_server(struct otpServerConfig *config) {
+    const char *daemon = config->mode == OTP_ENCIPHER ? "otp_enc_d" : 
+                                                        "otp_dec_d";
+    int listenfd, status;
+    int statsfd = -1;
+
+    traceInit(daemon);
+    traceHandleStop();
+
+    /* Map the stats region before forking so that children share it */
+    if (statsInit() < 0) {
+        exit(1);
+    }
+    if (config->reusePolicy != REUSE_OFF &&
+        reuseInit(config->reuseBytes, config->reusePolicy) < 0) {
+        exit(1);
+    }
+    if (config->capture &&
+        captureInit(config->capture, config->captureOneIn,
+                    config->capturePayload) < 0) {
+        exit(1);
+    }
+    if (config->admitLimit > 0 && admitInit(config->admitLimit) < 0) {
+        exit(1);
+    }
+    poolInit(config->poolBudget);
+    if (config->statsPort) {
+        statsfd = statsBind(config->statsPort);
+        if (statsfd < 0) {
+            exit(1);
+        }
+    }
+
+    /* Sharded daemons reap their own shards and register the SIGCHLD handler
+     * in each shard instead */
+    if (config->shards > 0) {
+        return otpServeShards(config, statsfd, daemon);
+    }
+
+    /* Register the SIGCHLD handler. This will automatically reap child
+     * processes. */
+    handlerRegister();
+ 
+    /* Create the listening socket and bind it to the port */
+    listenfd = serverBind(config->port, 0);
+    if (listenfd < 0) {
+        exit(1);
+    }
+
+    /* Set up the listening socket state */
+    status = listen(listenfd, config->backlog);
+    if (status < 0) {
+        perror("listen");
+        exit(1);
+    }
+
+    return otpServeListener(config, listenfd, statsfd, daemon);
+}
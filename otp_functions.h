@@ -9,15 +9,75 @@
 #ifndef OTP_FUNCTIONS_H
 #define OTP_FUNCTIONS_H
 
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/prctl.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "socket_utils.h"
+
 #define OTP_ARGS     4  /* The number of client arguments */
 #define OTP_D_ARGS   2  /* The number of server arguments */
 
-int otp_enc_client(const char *, const char *, const char *, int);
-int otp_enc_server(const char *, int);
+#define OTP_RESUME_RETRIES 5     /* Reconnects after a lost connection */
+#define OTP_RESUME_BACKOFF_MS 100 /* The first reconnect delay, doubled for
+                                   * each retry */
+
+#define OTP_ENGINE_FORK   0  /* A forked child per connection */
+#define OTP_ENGINE_EPOLL  1  /* One process serving every connection */
+
+#define OTP_SHARD_RESTART_MS 100  /* The delay before restarting a shard */
+#define OTP_ACCEPT_BATCH      64  /* Connections accepted per wakeup of the
+                                   * fork engine */
+
+#define OTP_BUSY_RETRIES       8  /* Retries after a daemon was busy */
+#define OTP_BUSY_BACKOFF_MS   50  /* The first delay after a daemon was busy,
+                                   * doubled for each retry */
+
+/* Client options parsed from the command line */
+struct otpClientConfig {
+    const char *text;       /* The text filename */
+    const char *key;        /* The key filename */
+    const char *port;       /* The daemon endpoint list */
+    int mode;               /* The cipher mode */
+    int cipher;             /* One of the OTP_CIPHER values */
+    int frameFlags;         /* OTP_FRAME_PACKED for a packed wire encoding */
+    const char *checkpoint; /* The checkpoint file, NULL if not resumable */
+    int segmentMax;         /* The longest frame segment to send */
+    int balancePolicy;      /* BALANCE_P2C or BALANCE_LOR */
+    const char *balanceState; /* The balancer state file, NULL for the
+                               * default */
+    int profile;            /* The OTP_PROFILE of the connections */
+};
+
+/* Daemon options parsed from the command line */
+struct otpServerConfig {
+    const char *port;       /* The listening port */
+    const char *statsPort;  /* The local stats port, NULL if disabled */
+    int mode;               /* The cipher mode */
+    int engine;             /* OTP_ENGINE_FORK or OTP_ENGINE_EPOLL */
+    size_t poolBudget;      /* The buffer pool budget in bytes per process */
+    int quantum;            /* Frame bytes per scheduler round, epoll only */
+    int reusePolicy;        /* REUSE_OFF, REUSE_FLAG or REUSE_REJECT */
+    size_t reuseBytes;      /* The pad reuse index size in bytes */
+    int *shardCores;        /* The core of each shard, NULL if unsharded */
+    int shards;             /* The number of shards, 0 if unsharded */
+    const char *capture;    /* The traffic capture file, NULL if disabled */
+    int capturePayload;     /* Nonzero to capture text and key as well */
+    int captureOneIn;       /* Capture one connection in this many */
+    struct otpTimeouts timeouts; /* The connection deadlines */
+    int backlog;            /* The listen backlog */
+    int admitLimit;         /* Connections served at once, 0 if unlimited */
+    int admitQueueMs;       /* How long a connection over the limit may wait
+                             * before it is turned away */
+};
+
+int otp_client(struct otpClientConfig *);
+int otp_server(struct otpServerConfig *);
+int otpClientArgs(int, char **, int, struct otpClientConfig *);
+int otpServerArgs(int, char **, int, struct otpServerConfig *);
 
 #endif
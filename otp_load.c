@@ -0,0 +1,549 @@
+/*******************************************************************************
+*      Filename: otp_load.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: A load generator for otp_enc_d and otp_dec_d. Drives a running
+*                daemon with a number of concurrent connections and reports
+*                throughput and latency percentiles.
+*
+*                In closed loop mode each connection issues its next request as
+*                soon as the previous one completes. In open loop mode requests
+*                are scheduled at a fixed arrival rate, and latency is measured
+*                from the scheduled start rather than the actual one so that a
+*                stalled server is not hidden by coordinated omission.
+*
+*                With -a, a single thread drives every connection through the
+*                asynchronous client instead of one thread per connection.
+*
+*                With -k, the connections are established before the run and
+*                kept open between requests, so that latency excludes the
+*                connection setup.
+*******************************************************************************/
+
+#include "async_utils.h"
+#include "cipher_utils.h"
+#include "conn_utils.h"
+#include "msg_utils.h"
+#include "otp_load.h"
+#include "pad_utils.h"
+#include "socket_utils.h"
+#include "time_utils.h"
+#include "trace_utils.h"
+
+/* Latency of every completed request in nanoseconds */
+struct hist loadLatency;
+
+/* Requests started by all workers, used to honor the request limit */
+long loadStarted = 0;
+
+/* The connections of every worker, to a daemon resolved once */
+struct connPool loadPool;
+
+/* The time at which all workers stop issuing requests */
+uint64_t loadDeadline;
+
+/*******************************************************************************
+*      Function: parseDist()
+*   Description: Parses a size distribution of the form fixed:N, uniform:A:B,
+*                or exp:MEAN.
+*    Parameters: const char *spec - The distribution string.
+*                struct loadDist *dist - The distribution to fill in.
+* Preconditions: None.
+*       Returns: The largest size the distribution yields, -1 on error.
+*******************************************************************************/
+
+int parseDist(const char *spec, struct loadDist *dist) {
+    memset(dist, 0, sizeof(*dist));
+
+    if (sscanf(spec, "fixed:%d", &dist->a) == 1 && dist->a > 0) {
+        dist->kind = LOAD_DIST_FIXED;
+        return dist->a;
+    }
+    if (sscanf(spec, "uniform:%d:%d", &dist->a, &dist->b) == 2 && 
+        dist->a > 0 && dist->b >= dist->a) {
+        dist->kind = LOAD_DIST_UNIFORM;
+        return dist->b;
+    }
+    if (sscanf(spec, "exp:%d", &dist->a) == 1 && dist->a > 0) {
+        dist->kind = LOAD_DIST_EXP;
+        return dist->a * LOAD_EXP_CAP;
+    }
+    fprintf(stderr, "parseDist: invalid distribution %s\n", spec);
+    return -1;
+}
+
+/*******************************************************************************
+*      Function: drawSize()
+*   Description: Draws a message size from the configured distribution.
+*    Parameters: struct loadWorker *w - The worker.
+* Preconditions: The distribution has been parsed.
+*       Returns: A size in 1 - cfg->maxSize.
+*******************************************************************************/
+
+int drawSize(struct loadWorker *w) {
+    struct loadDist *d = &w->cfg->dist;
+    double u;
+    int size;
+
+    switch (d->kind) {
+        case LOAD_DIST_UNIFORM:
+            return d->a + rand_r(&w->seed) % (d->b - d->a + 1);
+        case LOAD_DIST_EXP:
+            u = (rand_r(&w->seed) + 1.0) / ((double)RAND_MAX + 2.0);
+            size = (int)(-d->a * log(u)) + 1;
+            return size > w->cfg->maxSize ? w->cfg->maxSize : size;
+        default:
+            return d->a;
+    }
+}
+
+/*******************************************************************************
+*      Function: loadRequest()
+*   Description: Sends a single message to the daemon and waits for the
+*                complete response. The message goes over a new connection, or
+*                in keep-alive mode over a pooled one that is kept for the next
+*                request.
+*    Parameters: struct loadWorker *w - The worker.
+*                int len - The message length.
+* Preconditions: The worker buffers hold at least len characters.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int loadRequest(struct loadWorker *w, int len) {
+    FILE *textPtr, *keyPtr;
+    struct otpPad keyPad;
+    int sockfd, status;
+
+    textPtr = fmemopen(w->text, len, "r");
+    keyPtr = fmemopen(w->key, len, "r");
+    if (!textPtr || !keyPtr) {
+        perror("loadRequest: fmemopen");
+        if (textPtr) {
+            fclose(textPtr);
+        }
+        return -1;
+    }
+
+    padOpen(&keyPad, keyPtr, 1);
+
+    sockfd = connPoolGet(&loadPool);
+
+    status = -1;
+    if (sockfd >= 0 && w->cfg->keepAlive) {
+        status = clientProcessFrames(sockfd, textPtr, &keyPad, len, 
+                                     w->cfg->mode, OTP_CIPHER_TEXT,
+                                     OTP_FRAME_KEEPALIVE, 
+                                     OTP_FRAME_SEGMENT_DEFAULT, w->sink, NULL);
+        connPoolPut(&loadPool, sockfd, status == 0);
+    } else if (sockfd >= 0) {
+        status = clientProcessMessage(sockfd, textPtr, &keyPad, len, 
+                                      w->cfg->mode, w->sink);
+        connPoolPut(&loadPool, sockfd, 0);
+    }
+    fclose(textPtr);
+    fclose(keyPtr);
+    return status;
+}
+
+/*******************************************************************************
+*      Function: loadSleepUntil()
+*   Description: Sleeps until an absolute monotonic time.
+*    Parameters: uint64_t when - The wake time in nanoseconds.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void loadSleepUntil(uint64_t when) {
+    struct timespec ts;
+
+    ts.tv_sec = when / TIME_NS_PER_SEC;
+    ts.tv_nsec = when % TIME_NS_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+        ;
+    }
+}
+
+/*******************************************************************************
+*      Function: loadWorkerMain()
+*   Description: The worker thread body. Issues requests until the deadline or
+*                the request limit is reached.
+*    Parameters: void *arg - The worker.
+* Preconditions: The worker has been initialized.
+*       Returns: NULL.
+*******************************************************************************/
+
+void *loadWorkerMain(void *arg) {
+    struct loadWorker *w = arg;
+    struct loadConfig *cfg = w->cfg;
+    uint64_t interval = 0;
+    uint64_t start, end, intended = 0;
+    int len;
+
+    /* In open loop mode, the workers share the arrival schedule round robin */
+    if (cfg->rate > 0) {
+        interval = (uint64_t)(cfg->conns * TIME_NS_PER_SEC / cfg->rate);
+        intended = timeNowNs() + (uint64_t)(w->id * TIME_NS_PER_SEC / 
+                                            cfg->rate);
+    }
+
+    while (1) {
+        if (cfg->rate > 0) {
+            if (intended >= loadDeadline) {
+                break;
+            }
+            if (timeNowNs() < intended) {
+                loadSleepUntil(intended);
+            }
+            start = intended;
+            intended += interval;
+        } else {
+            start = timeNowNs();
+            if (start >= loadDeadline) {
+                break;
+            }
+        }
+        if (cfg->requests > 0 && 
+            __atomic_fetch_add(&loadStarted, 1, __ATOMIC_RELAXED) >= 
+            cfg->requests) {
+            break;
+        }
+
+        len = drawSize(w);
+        if (loadRequest(w, len) < 0) {
+            w->errors++;
+            continue;
+        }
+        end = timeNowNs();
+        histRecord(&loadLatency, end - start);
+        w->requests++;
+        w->bytes += len;
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+*      Function: loadAsyncDone()
+*   Description: The completion callback for asynchronous requests.
+*    Parameters: void *arg - The request.
+*                int status - 0 on success, OTP_BUSY or -1 on failure.
+*                const char *out - The processed text, unused.
+*                int len - The text length, unused.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void loadAsyncDone(void *arg, int status, const char *out, int len) {
+    struct loadAsyncReq *req = arg;
+
+    (void)out;
+    (void)len;
+    if (status < 0) {
+        req->w->errors++;
+    } else {
+        histRecord(&loadLatency, timeNowNs() - req->start);
+        req->w->requests++;
+        req->w->bytes += req->len;
+    }
+    free(req);
+}
+
+/*******************************************************************************
+*      Function: loadAsyncMain()
+*   Description: Issues requests through the asynchronous client from the
+*                calling thread until the deadline or the request limit is
+*                reached, then waits for the outstanding ones. In closed loop
+*                mode cfg->conns requests are kept outstanding; in open loop
+*                mode requests are submitted on schedule and at most cfg->conns
+*                connections are open at once.
+*    Parameters: struct loadWorker *w - The worker holding the message text.
+* Preconditions: The worker has been initialized.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int loadAsyncMain(struct loadWorker *w) {
+    struct loadConfig *cfg = w->cfg;
+    struct loadAsyncReq *req;
+    struct otpAsync *a;
+    struct pollfd pfd;
+    uint64_t now, interval = 0, intended = 0;
+    long started = 0;
+    int timeout;
+
+    a = otpAsyncCreate(cfg->port, cfg->mode, OTP_CIPHER_TEXT, 0, cfg->conns);
+    if (!a) {
+        return -1;
+    }
+    if (cfg->rate > 0) {
+        interval = (uint64_t)(TIME_NS_PER_SEC / cfg->rate);
+        intended = timeNowNs();
+    }
+    pfd.fd = otpAsyncFd(a);
+    pfd.events = POLLIN;
+
+    while (1) {
+        now = timeNowNs();
+        timeout = LOAD_POLL_MS;
+        while (now < loadDeadline && 
+               (cfg->requests == 0 || started < cfg->requests)) {
+            if (cfg->rate > 0) {
+                if (intended > now) {
+                    timeout = (int)((intended - now) / 1000000);
+                    break;
+                }
+                if (intended >= loadDeadline) {
+                    break;
+                }
+            } else if (otpAsyncPending(a) >= cfg->conns) {
+                break;
+            }
+
+            req = malloc(sizeof(*req));
+            if (!req) {
+                perror("loadAsyncMain: malloc");
+                break;
+            }
+            req->w = w;
+            req->len = drawSize(w);
+            req->start = cfg->rate > 0 ? intended : now;
+            intended += interval;
+            if (otpAsyncSubmit(a, w->text, w->key, req->len, loadAsyncDone, 
+                               req) < 0) {
+                w->errors++;
+                free(req);
+                break;
+            }
+            started++;
+        }
+        if (otpAsyncPending(a) == 0 && (now >= loadDeadline || 
+            (cfg->requests > 0 && started >= cfg->requests) ||
+            (cfg->rate > 0 && intended >= loadDeadline))) {
+            break;
+        }
+
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+            perror("loadAsyncMain: poll");
+            break;
+        }
+        if (otpAsyncProcess(a) < 0) {
+            break;
+        }
+    }
+
+    otpAsyncDestroy(a);
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: loadReport()
+*   Description: Writes the run summary to stdout.
+*    Parameters: struct loadConfig *cfg - The configuration.
+*                struct loadWorker *workers - The finished workers.
+*                int nworkers - The number of workers.
+*                double elapsed - The run time in seconds.
+* Preconditions: All workers have been joined.
+*       Returns: None.
+*******************************************************************************/
+
+void loadReport(struct loadConfig *cfg, struct loadWorker *workers, 
+                int nworkers, double elapsed) {
+    uint64_t requests = 0, errors = 0, bytes = 0;
+    int i;
+
+    for (i = 0; i < nworkers; i++) {
+        requests += workers[i].requests;
+        errors += workers[i].errors;
+        bytes += workers[i].bytes;
+    }
+
+    printf("loop: %s\n", cfg->rate > 0 ? "open" : "closed");
+    printf("client: %s\n", cfg->async ? "async" : "threads");
+    printf("connections: %d\n", cfg->conns);
+    if (!cfg->async) {
+        printf("keepalive: %s\n", cfg->keepAlive ? "on" : "off");
+        printf("connections_opened: %llu\n", 
+               (unsigned long long)loadPool.opened);
+        printf("connections_reused: %llu\n", 
+               (unsigned long long)loadPool.reused);
+    }
+    if (cfg->rate > 0) {
+        printf("target_rate: %.1f\n", cfg->rate);
+    }
+    printf("requests: %llu\n", (unsigned long long)requests);
+    printf("errors: %llu\n", (unsigned long long)errors);
+    printf("elapsed_s: %.3f\n", elapsed);
+    printf("throughput_rps: %.1f\n", requests / elapsed);
+    printf("throughput_bytes_per_sec: %.0f\n", bytes / elapsed);
+    printf("latency_mean_us: %.1f\n", loadLatency.count ? 
+           (double)loadLatency.sum / loadLatency.count / 1000.0 : 0.0);
+    printf("latency_p50_us: %.1f\n", histPercentile(&loadLatency, 50.0) / 1e3);
+    printf("latency_p90_us: %.1f\n", histPercentile(&loadLatency, 90.0) / 1e3);
+    printf("latency_p99_us: %.1f\n", histPercentile(&loadLatency, 99.0) / 1e3);
+    printf("latency_p999_us: %.1f\n", histPercentile(&loadLatency, 99.9) / 1e3);
+    printf("latency_max_us: %.1f\n", loadLatency.max / 1e3);
+}
+
+/*******************************************************************************
+*      Function: fillText()
+*   Description: Fills a buffer with pseudo-random cipher characters.
+*    Parameters: char *buf - The buffer.
+*                int len - The number of characters.
+*                unsigned int seed - The generator seed.
+* Preconditions: The buffer holds at least len bytes.
+*       Returns: None.
+*******************************************************************************/
+
+void fillText(char *buf, int len, unsigned int seed) {
+    int i, r;
+
+    for (i = 0; i < len; i++) {
+        r = rand_r(&seed) % OTP_NUM_CHARS;
+        buf[i] = r == OTP_NUM_CHARS - 1 ? ' ' : 'A' + r;
+    }
+}
+
+/*******************************************************************************
+*      Function: main()
+*   Description: The main load generator function.
+*    Parameters: int argc - The argument count.
+*                char **argv - The argument list.
+* Preconditions: None.
+*       Returns: 0 on success, 1 on error.
+*******************************************************************************/
+
+int main(int argc, char **argv) {
+    struct loadConfig cfg = {0};
+    struct loadWorker *workers;
+    struct sigaction ignoreAction = {0};
+    const char *distSpec = NULL;
+    uint64_t start;
+    int opt, i, nworkers, usage = 0;
+
+    cfg.mode = OTP_ENCIPHER;
+    cfg.conns = LOAD_CONNS_DEFAULT;
+    cfg.duration = LOAD_DURATION_DEFAULT;
+    cfg.dist.kind = LOAD_DIST_FIXED;
+    cfg.dist.a = LOAD_SIZE_DEFAULT;
+    cfg.maxSize = LOAD_SIZE_DEFAULT;
+
+    while (!usage && (opt = getopt(argc, argv, "c:r:d:n:s:DakO:")) != -1) {
+        switch (opt) {
+            case 'c':
+                cfg.conns = atoi(optarg);
+                break;
+            case 'r':
+                cfg.rate = atof(optarg);
+                break;
+            case 'd':
+                cfg.duration = atof(optarg);
+                break;
+            case 'n':
+                cfg.requests = atol(optarg);
+                break;
+            case 's':
+                distSpec = optarg;
+                break;
+            case 'D':
+                cfg.mode = OTP_DECIPHER;
+                break;
+            case 'a':
+                cfg.async = 1;
+                break;
+            case 'k':
+                cfg.keepAlive = 1;
+                break;
+            case 'O':
+                cfg.profile = parseProfile(optarg);
+                if (cfg.profile < 0) {
+                    usage = 1;
+                }
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+    /* The asynchronous client manages its own connections */
+    if (usage || optind != argc - 1 || cfg.conns <= 0 || cfg.duration <= 0 || 
+        cfg.rate < 0 || (cfg.async && cfg.keepAlive)) {
+        fprintf(stderr, "Usage: otp_load [-c conns] [-r rate] [-d seconds] "
+                "[-n requests] [-s fixed:N|uniform:A:B|exp:MEAN] [-D]\n"
+                "                [-a | -k] [-O system | latency | throughput] "
+                "port\n");
+        exit(1);
+    }
+    cfg.port = argv[optind];
+    if (distSpec) {
+        cfg.maxSize = parseDist(distSpec, &cfg.dist);
+        if (cfg.maxSize < 0) {
+            exit(1);
+        }
+    }
+
+    /* A daemon closing the connection early must not kill the generator */
+    ignoreAction.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignoreAction, NULL);
+
+    /* The asynchronous client drives every connection from one worker */
+    nworkers = cfg.async ? 1 : cfg.conns;
+    workers = calloc(nworkers, sizeof(*workers));
+    if (!workers) {
+        perror("calloc");
+        exit(1);
+    }
+    for (i = 0; i < nworkers; i++) {
+        workers[i].id = i;
+        workers[i].cfg = &cfg;
+        workers[i].seed = i + 1;
+        workers[i].text = malloc(cfg.maxSize);
+        workers[i].key = malloc(cfg.maxSize);
+        workers[i].sink = fopen("/dev/null", "w");
+        if (!workers[i].text || !workers[i].key || !workers[i].sink) {
+            perror("otp_load: worker setup");
+            exit(1);
+        }
+        fillText(workers[i].text, cfg.maxSize, 2 * i + 1);
+        fillText(workers[i].key, cfg.maxSize, 2 * i + 2);
+    }
+
+    /* Each worker keeps at most one connection between requests */
+    if (!cfg.async && 
+        (connPoolInit(&loadPool, cfg.port, nworkers, cfg.profile) < 0 ||
+         (cfg.keepAlive && connPoolWarm(&loadPool, nworkers) < 0))) {
+        exit(1);
+    }
+
+    traceInit("otp_load");
+    histReset(&loadLatency);
+    start = timeNowNs();
+    loadDeadline = start + (uint64_t)(cfg.duration * TIME_NS_PER_SEC);
+    if (cfg.async) {
+        if (loadAsyncMain(&workers[0]) < 0) {
+            exit(1);
+        }
+    } else {
+        for (i = 0; i < nworkers; i++) {
+            if (pthread_create(&workers[i].thread, NULL, loadWorkerMain, 
+                               &workers[i]) != 0) {
+                fprintf(stderr, "otp_load: pthread_create failed\n");
+                exit(1);
+            }
+        }
+        for (i = 0; i < nworkers; i++) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    loadReport(&cfg, workers, nworkers, 
+               (timeNowNs() - start) / (double)TIME_NS_PER_SEC);
+
+    if (!cfg.async) {
+        connPoolDestroy(&loadPool);
+    }
+    for (i = 0; i < nworkers; i++) {
+        free(workers[i].text);
+        free(workers[i].key);
+        fclose(workers[i].sink);
+    }
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*******************************************************************************
+*      Filename: otp_load.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for otp_load.c. Please see otp_load.c for more
+*                details.
+*******************************************************************************/
+
+#ifndef OTP_LOAD_H
+#define OTP_LOAD_H
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hist_utils.h"
+
+#define LOAD_DIST_FIXED      0  /* Every message has the same size */
+#define LOAD_DIST_UNIFORM    1  /* Sizes are uniform in [a, b] */
+#define LOAD_DIST_EXP        2  /* Sizes are exponential with mean a */
+#define LOAD_EXP_CAP        20  /* Exponential sizes are capped at cap * mean */
+#define LOAD_CONNS_DEFAULT   8  /* Default number of concurrent connections */
+#define LOAD_DURATION_DEFAULT 10.0 /* Default run time in seconds */
+#define LOAD_SIZE_DEFAULT  1024 /* Default fixed message size */
+#define LOAD_POLL_MS       100  /* Longest wait in asynchronous mode */
+
+/* A message size distribution */
+struct loadDist {
+    int kind;
+    int a;
+    int b;
+};
+
+/* The load generator configuration */
+struct loadConfig {
+    const char *port;      /* The daemon port */
+    int mode;              /* The cipher mode */
+    int conns;             /* The number of concurrent connections */
+    double rate;           /* Open loop arrivals per second, 0 if closed loop */
+    double duration;       /* The run time in seconds */
+    long requests;         /* The request limit, 0 if unlimited */
+    struct loadDist dist;  /* The message size distribution */
+    int maxSize;           /* The largest message the distribution yields */
+    int async;             /* Nonzero to drive every connection from one
+                            * thread with the asynchronous client */
+    int keepAlive;         /* Nonzero to reuse warmed connections */
+    int profile;           /* The OTP_PROFILE of the connections */
+};
+
+/* The state of a single connection driver */
+struct loadWorker {
+    pthread_t thread;
+    int id;
+    struct loadConfig *cfg;
+    char *text;            /* Message text of cfg->maxSize characters */
+    char *key;             /* Key text of cfg->maxSize characters */
+    FILE *sink;            /* Discards server responses */
+    unsigned int seed;     /* The size distribution generator state */
+    uint64_t requests;     /* Completed requests */
+    uint64_t errors;       /* Failed requests */
+    uint64_t bytes;        /* Text bytes processed by completed requests */
+};
+
+/* A request issued through the asynchronous client */
+struct loadAsyncReq {
+    struct loadWorker *w;  /* The worker that issued it */
+    uint64_t start;        /* The time latency is measured from */
+    int len;               /* The message length */
+};
+
+#endif
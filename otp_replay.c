@@ -0,0 +1,433 @@
+/*******************************************************************************
+*      Filename: otp_replay.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Replays traffic captured by a daemon started with -C against
+*                a running otp_enc_d or otp_dec_d, and reports throughput and
+*                latency. Each recorded connection is replayed on a connection
+*                of its own, opened at the time the recording's first message
+*                arrived, and sends each message at the time it arrived,
+*                scaled by the replay speed. A fixed pool of worker threads
+*                takes the connections in order of their first arrival, so at
+*                most that many are open at once. Messages recorded without their
+*                payload are rebuilt from random symbols, seeded by their
+*                position in the capture, so every replay sends the same bytes.
+*
+*                Latency is measured from each message's scheduled send time,
+*                so a daemon that falls behind the recorded pace is charged for
+*                the wait. At speed 0 every message is sent as soon as the one
+*                before it is answered.
+*******************************************************************************/
+
+#include "capture_utils.h"
+#include "msg_utils.h"
+#include "otp_replay.h"
+#include "socket_utils.h"
+#include "time_utils.h"
+
+/* The replay configuration, shared by every connection */
+struct replayConfig replayCfg;
+
+/* Latency of every answered message in nanoseconds */
+struct hist replayLatency;
+
+/*******************************************************************************
+*      Function: replayCompare()
+*   Description: Orders messages by connection, then by arrival, then by their
+*                place in the capture file.
+*    Parameters: const void *a - A message.
+*                const void *b - Another message.
+* Preconditions: None.
+*       Returns: Negative, zero or positive as a sorts before, with or after b.
+*******************************************************************************/
+
+int replayCompare(const void *a, const void *b) {
+    const struct replayMsg *x = a, *y = b;
+
+    if (x->rec.conn != y->rec.conn) {
+        return x->rec.conn < y->rec.conn ? -1 : 1;
+    }
+    if (x->rec.arrivalNs != y->rec.arrivalNs) {
+        return x->rec.arrivalNs < y->rec.arrivalNs ? -1 : 1;
+    }
+    return x->payloadOffset < y->payloadOffset ? -1 : 1;
+}
+
+/*******************************************************************************
+*      Function: replayConnCompare()
+*   Description: Orders connections by their first message's arrival.
+*    Parameters: const void *a - A connection.
+*                const void *b - Another connection.
+* Preconditions: Every connection has a message.
+*       Returns: Negative, zero or positive as a sorts before, with or after b.
+*******************************************************************************/
+
+int replayConnCompare(const void *a, const void *b) {
+    const struct replayConn *x = a, *y = b;
+
+    if (x->msgs[0].rec.arrivalNs == y->msgs[0].rec.arrivalNs) {
+        return 0;
+    }
+    return x->msgs[0].rec.arrivalNs < y->msgs[0].rec.arrivalNs ? -1 : 1;
+}
+
+/*******************************************************************************
+*      Function: replayLoad()
+*   Description: Reads every record of a capture and groups them into
+*                connections.
+*    Parameters: int fd - The capture file, past its header.
+*                struct replayMsg **msgsPtr - Set to the messages.
+*                struct replayConn **connsPtr - Set to the connections.
+* Preconditions: None.
+*       Returns: The number of connections, -1 on error.
+*******************************************************************************/
+
+int replayLoad(int fd, struct replayMsg **msgsPtr,
+               struct replayConn **connsPtr) {
+    struct replayMsg *msgs = NULL, *larger;
+    struct replayConn *conns;
+    int i, n = 0, cap = 0, nconns = 0, status;
+
+    while (1) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 1024;
+            larger = realloc(msgs, cap * sizeof(*msgs));
+            if (!larger) {
+                perror("replayLoad: realloc");
+                free(msgs);
+                return -1;
+            }
+            msgs = larger;
+        }
+        status = captureReadRecord(fd, &msgs[n].rec, &msgs[n].payloadOffset);
+        if (status < 0) {
+            free(msgs);
+            return -1;
+        }
+        if (status == 0) {
+            break;
+        }
+        n++;
+    }
+
+    qsort(msgs, n, sizeof(*msgs), replayCompare);
+    conns = calloc(n > 0 ? n : 1, sizeof(*conns));
+    if (!conns) {
+        perror("replayLoad: calloc");
+        free(msgs);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        if (i == 0 || msgs[i].rec.conn != msgs[i - 1].rec.conn) {
+            conns[nconns++].msgs = &msgs[i];
+        }
+        conns[nconns - 1].count++;
+        if ((int)msgs[i].rec.bytes > conns[nconns - 1].maxBytes) {
+            conns[nconns - 1].maxBytes = msgs[i].rec.bytes;
+        }
+    }
+    qsort(conns, nconns, sizeof(*conns), replayConnCompare);
+    *msgsPtr = msgs;
+    *connsPtr = conns;
+    return nconns;
+}
+
+/*******************************************************************************
+*      Function: replaySleepUntil()
+*   Description: Sleeps until an absolute monotonic time.
+*    Parameters: uint64_t when - The wake time in nanoseconds.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void replaySleepUntil(uint64_t when) {
+    struct timespec ts;
+
+    ts.tv_sec = when / TIME_NS_PER_SEC;
+    ts.tv_nsec = when % TIME_NS_PER_SEC;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+        ;
+    }
+}
+
+/*******************************************************************************
+*      Function: replayTime()
+*   Description: Finds when a recorded arrival is replayed.
+*    Parameters: uint64_t arrival - The recorded arrival time.
+* Preconditions: The replay has started and its speed is not 0.
+*       Returns: The monotonic replay time in nanoseconds.
+*******************************************************************************/
+
+uint64_t replayTime(uint64_t arrival) {
+    return replayCfg.start +
+           (uint64_t)((arrival - replayCfg.first) / replayCfg.speed);
+}
+
+/*******************************************************************************
+*      Function: replayReply()
+*   Description: Receives the daemon's answer to a message.
+*    Parameters: int sockfd - The socket file descriptor.
+*                char *buf - A buffer at least as long as the message.
+*                const struct captureRecord *rec - The message's record.
+* Preconditions: The message has been sent.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int replayReply(int sockfd, char *buf, const struct captureRecord *rec) {
+    struct otpFrameHeader header;
+    int segmentBytes;
+
+    if (rec->head[0] != OTP_FRAME_MAGIC) {
+        return recvDelimited(sockfd, buf, OTP_PAYLOAD_MAX, 0) > 0 ? 0 : -1;
+    }
+    if (recvAll(sockfd, buf, OTP_FRAME_HEADER_BYTES, 0) <= 0 ||
+        frameHeaderUnpack(buf, &header) < 0) {
+        return -1;
+    }
+    segmentBytes = frameSegmentBytes(header.len, header.flags);
+    if (segmentBytes > (int)rec->bytes - OTP_FRAME_HEADER_BYTES) {
+        return -1;
+    }
+    if (segmentBytes > 0 &&
+        recvAll(sockfd, &buf[OTP_FRAME_HEADER_BYTES], segmentBytes, 0) <= 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: replayConnRun()
+*   Description: Replays a connection. Sends each of its messages on schedule
+*                and waits for its answer.
+*    Parameters: struct replayConn *c - The connection.
+* Preconditions: The replay has started.
+*       Returns: None.
+*******************************************************************************/
+
+void replayConnRun(struct replayConn *c) {
+    struct captureRecord *rec;
+    uint64_t start;
+    char *buf;
+    int i, sockfd;
+
+    buf = malloc(c->maxBytes > OTP_PAYLOAD_MAX ? c->maxBytes :
+                                                 OTP_PAYLOAD_MAX);
+    sockfd = buf ? clientConnect(replayCfg.port) : -1;
+    if (sockfd < 0) {
+        c->errors = c->count;
+        free(buf);
+        return;
+    }
+
+    for (i = 0; i < c->count; i++) {
+        rec = &c->msgs[i].rec;
+        if (rec->payload) {
+            if (pread(replayCfg.fd, buf, rec->bytes,
+                      c->msgs[i].payloadOffset) != rec->bytes) {
+                perror("replayConnMain: pread");
+                break;
+            }
+        } else if (captureSynthesize(rec, buf, rec->conn * 1000003 + i) < 0) {
+            fprintf(stderr, "replayConnMain: invalid record\n");
+            break;
+        }
+
+        start = timeNowNs();
+        if (replayCfg.speed > 0) {
+            if (start < replayTime(rec->arrivalNs)) {
+                replaySleepUntil(replayTime(rec->arrivalNs));
+            }
+            start = replayTime(rec->arrivalNs);
+        }
+        if (sendPacket(sockfd, buf, rec->bytes) < 0 ||
+            replayReply(sockfd, buf, rec) < 0) {
+            break;
+        }
+        histRecord(&replayLatency, timeNowNs() - start);
+        c->messages++;
+        c->bytes += rec->bytes;
+    }
+    c->errors = c->count - i;
+
+    close(sockfd);
+    free(buf);
+}
+
+/*******************************************************************************
+*      Function: replayWorkerMain()
+*   Description: The worker thread body. Takes the next connection not yet
+*                replayed, waits until it is due and replays it, until none
+*                are left.
+*    Parameters: void *arg - Unused.
+* Preconditions: The replay has started.
+*       Returns: NULL.
+*******************************************************************************/
+
+void *replayWorkerMain(void *arg) {
+    struct replayConn *c;
+    int i;
+
+    (void)arg;
+    while ((i = __atomic_fetch_add(&replayCfg.next, 1, __ATOMIC_RELAXED)) <
+           replayCfg.nconns) {
+        c = &replayCfg.conns[i];
+        if (replayCfg.speed > 0) {
+            replaySleepUntil(replayTime(c->msgs[0].rec.arrivalNs));
+        }
+        replayConnRun(c);
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+*      Function: replayReport()
+*   Description: Prints the replay summary.
+*    Parameters: const struct captureFileHeader *header - The capture header.
+*                struct replayConn *conns - The connections.
+*                int nconns - The number of connections.
+*                double elapsed - The run time in seconds.
+* Preconditions: All connections have been joined.
+*       Returns: None.
+*******************************************************************************/
+
+void replayReport(const struct captureFileHeader *header,
+                  struct replayConn *conns, int nconns, double elapsed) {
+    uint64_t messages = 0, errors = 0, bytes = 0;
+    int i;
+
+    for (i = 0; i < nconns; i++) {
+        messages += conns[i].messages;
+        errors += conns[i].errors;
+        bytes += conns[i].bytes;
+    }
+
+    printf("payload: %s\n", header->flags & CAPTURE_PAYLOAD ? "recorded" :
+                                                              "synthetic");
+    printf("sampled_one_in: %u\n", header->oneIn);
+    if (replayCfg.speed > 0) {
+        printf("speed: %.2f\n", replayCfg.speed);
+    } else {
+        printf("speed: max\n");
+    }
+    printf("connections: %d\n", nconns);
+    printf("messages: %llu\n", (unsigned long long)messages);
+    printf("errors: %llu\n", (unsigned long long)errors);
+    printf("elapsed_s: %.3f\n", elapsed);
+    printf("throughput_mps: %.1f\n", messages / elapsed);
+    printf("throughput_bytes_per_sec: %.0f\n", bytes / elapsed);
+    printf("latency_mean_us: %.1f\n", replayLatency.count ?
+           (double)replayLatency.sum / replayLatency.count / 1000.0 : 0.0);
+    printf("latency_p50_us: %.1f\n",
+           histPercentile(&replayLatency, 50.0) / 1e3);
+    printf("latency_p90_us: %.1f\n",
+           histPercentile(&replayLatency, 90.0) / 1e3);
+    printf("latency_p99_us: %.1f\n",
+           histPercentile(&replayLatency, 99.0) / 1e3);
+    printf("latency_p999_us: %.1f\n",
+           histPercentile(&replayLatency, 99.9) / 1e3);
+    printf("latency_max_us: %.1f\n", replayLatency.max / 1e3);
+}
+
+/*******************************************************************************
+*      Function: main()
+*   Description: The main replay function.
+*    Parameters: int argc - The argument count.
+*                char **argv - The argument list.
+* Preconditions: None.
+*       Returns: 0 if every message was answered, 1 on error, 2 if any
+*                message was not answered.
+*******************************************************************************/
+
+int main(int argc, char **argv) {
+    struct captureFileHeader header;
+    struct replayMsg *msgs;
+    struct replayConn *conns;
+    struct sigaction ignoreAction = {0};
+    pthread_t *workers;
+    char *endptr;
+    int opt, i, nconns, failed = 0, usage = 0;
+
+    replayCfg.speed = REPLAY_SPEED_DEFAULT;
+    replayCfg.workers = REPLAY_CONNS_DEFAULT;
+    while (!usage && (opt = getopt(argc, argv, "c:x:")) != -1) {
+        switch (opt) {
+            case 'c':
+                replayCfg.workers = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || replayCfg.workers <= 0) {
+                    usage = 1;
+                }
+                break;
+            case 'x':
+                replayCfg.speed = strtod(optarg, &endptr);
+                if (*endptr != '\0' || replayCfg.speed < 0) {
+                    usage = 1;
+                }
+                break;
+            default:
+                usage = 1;
+                break;
+        }
+    }
+    if (usage || optind != argc - 2) {
+        fprintf(stderr, "Usage: otp_replay [-c conns] [-x speed] capture "
+                "port\n");
+        exit(1);
+    }
+    replayCfg.port = argv[optind + 1];
+
+    /* Read the whole capture before the first connection opens */
+    replayCfg.fd = open(argv[optind], O_RDONLY);
+    if (replayCfg.fd < 0) {
+        perror("open");
+        exit(1);
+    }
+    if (captureReadHeader(replayCfg.fd, &header) < 0) {
+        exit(1);
+    }
+    nconns = replayLoad(replayCfg.fd, &msgs, &conns);
+    if (nconns < 0) {
+        exit(1);
+    }
+
+    /* A daemon closing the connection early must not kill the replay */
+    ignoreAction.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignoreAction, NULL);
+
+    /* Open each connection when its recorded counterpart opened, with no
+     * more workers than there are connections */
+    if (replayCfg.workers > nconns) {
+        replayCfg.workers = nconns;
+    }
+    workers = malloc((replayCfg.workers > 0 ? replayCfg.workers : 1) *
+                     sizeof(*workers));
+    if (!workers) {
+        perror("malloc");
+        exit(1);
+    }
+    histReset(&replayLatency);
+    replayCfg.conns = conns;
+    replayCfg.nconns = nconns;
+    replayCfg.start = timeNowNs();
+    replayCfg.first = nconns > 0 ? conns[0].msgs[0].rec.arrivalNs : 0;
+    for (i = 0; i < replayCfg.workers; i++) {
+        if (pthread_create(&workers[i], NULL, replayWorkerMain, NULL) != 0) {
+            fprintf(stderr, "otp_replay: pthread_create failed\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < replayCfg.workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    for (i = 0; i < nconns; i++) {
+        failed |= conns[i].errors > 0;
+    }
+
+    replayReport(&header, conns, nconns,
+                 (timeNowNs() - replayCfg.start) / (double)TIME_NS_PER_SEC);
+
+    free(workers);
+    free(msgs);
+    free(conns);
+    close(replayCfg.fd);
+    return failed ? 2 : 0;
+}
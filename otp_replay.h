@@ -0,0 +1,56 @@
+/*******************************************************************************
+*      Filename: otp_replay.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for otp_replay.c. Please see otp_replay.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef OTP_REPLAY_H
+#define OTP_REPLAY_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture_utils.h"
+#include "hist_utils.h"
+
+#define REPLAY_SPEED_DEFAULT 1.0  /* Replay at the recorded pace */
+#define REPLAY_CONNS_DEFAULT 256  /* Connections replayed at once */
+
+/* A recorded message */
+struct replayMsg {
+    struct captureRecord rec;     /* The record */
+    off_t payloadOffset;          /* The file offset of its payload, if any */
+};
+
+/* A recorded connection */
+struct replayConn {
+    struct replayMsg *msgs;       /* Its messages in arrival order */
+    int count;                    /* The number of messages */
+    int maxBytes;                 /* The longest message */
+    uint64_t messages;            /* Messages answered */
+    uint64_t errors;              /* Messages not answered */
+    uint64_t bytes;               /* Message bytes answered */
+};
+
+/* The replay configuration */
+struct replayConfig {
+    const char *port;             /* The daemon port */
+    int fd;                       /* The capture file */
+    double speed;                 /* The pace relative to the recording, 0 for
+                                   * as fast as possible */
+    int workers;                  /* The most connections replayed at once */
+    struct replayConn *conns;     /* The connections by first arrival */
+    int nconns;                   /* The number of connections */
+    int next;                     /* The next connection to be replayed */
+    uint64_t start;               /* The time the replay started */
+    uint64_t first;               /* The first recorded arrival */
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*******************************************************************************
+*      Filename: pack_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Packs cipher characters at 5 bits per symbol. Three symbols
+*                form a base OTP_NUM_CHARS value below PACK_TRIPLE_MAX, which
+*                fits in 15 bits. Eight triples, 24 symbols, fill a group of 15
+*                bytes, 37.5% smaller than one byte per symbol. Triples are
+*                stored most significant bit first. A partial final group is
+*                padded with the symbol 'A'.
+*******************************************************************************/
+
+#include "cipher_utils.h"
+#include "pack_utils.h"
+
+/* Maps a triple divided by OTP_NUM_CHARS to its first two characters */
+static char packPairChars[OTP_NUM_CHARS * OTP_NUM_CHARS][2];
+
+/* Maps characters to symbol values and back, in the default alphabet */
+#define packCharValue (OTP_ALPHABET_TEXT->value)
+#define packChars (OTP_ALPHABET_TEXT->symbol)
+
+/* Maps a triple to its three symbol values, one per byte with the last symbol
+ * in the low byte, and to the values that subtract them modulo OTP_NUM_CHARS */
+static uint32_t packTripleDigits[PACK_TRIPLE_MAX];
+static uint32_t packTripleNegDigits[PACK_TRIPLE_MAX];
+
+static pthread_once_t packTablesOnce = PTHREAD_ONCE_INIT;
+
+/*******************************************************************************
+*      Function: packFillTables()
+*   Description: Fills the conversion tables.
+*    Parameters: None.
+* Preconditions: Called once, through packInitTables().
+*       Returns: None.
+*******************************************************************************/
+
+void packFillTables() {
+    uint32_t d0, d1, d2;
+    int i;
+
+    for (i = 0; i < OTP_NUM_CHARS * OTP_NUM_CHARS; i++) {
+        packPairChars[i][0] = packChars[i / OTP_NUM_CHARS];
+        packPairChars[i][1] = packChars[i % OTP_NUM_CHARS];
+    }
+    for (i = 0; i < PACK_TRIPLE_MAX; i++) {
+        d0 = i % OTP_NUM_CHARS;
+        d1 = i / OTP_NUM_CHARS % OTP_NUM_CHARS;
+        d2 = i / (OTP_NUM_CHARS * OTP_NUM_CHARS);
+        packTripleDigits[i] = (d2 << 16) | (d1 << 8) | d0;
+        packTripleNegDigits[i] = 
+            ((d2 ? OTP_NUM_CHARS - d2 : 0) << 16) |
+            ((d1 ? OTP_NUM_CHARS - d1 : 0) << 8) |
+            (d0 ? OTP_NUM_CHARS - d0 : 0);
+    }
+}
+
+/*******************************************************************************
+*      Function: packInitTables()
+*   Description: Fills the conversion tables on first use.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void packInitTables() {
+    pthread_once(&packTablesOnce, packFillTables);
+}
+
+/*******************************************************************************
+*      Function: packedLen()
+*   Description: Determines the packed size of a run of symbols.
+*    Parameters: int symbols - The number of symbols.
+* Preconditions: None.
+*       Returns: The packed size in bytes, a whole number of groups.
+*******************************************************************************/
+
+int packedLen(int symbols) {
+    return ((symbols + PACK_GROUP_SYMBOLS - 1) / PACK_GROUP_SYMBOLS) * 
+           PACK_GROUP_BYTES;
+}
+
+/*******************************************************************************
+*      Function: packSymbols()
+*   Description: Packs cipher characters into groups.
+*    Parameters: const char *chars - The characters.
+*                int len - The number of characters.
+*                unsigned char *out - The destination of packedLen(len) bytes.
+* Preconditions: The characters are valid cipher characters.
+*       Returns: None.
+*******************************************************************************/
+
+void packSymbols(const char *chars, int len, unsigned char *out) {
+    char group[PACK_GROUP_SYMBOLS];
+    const char *src;
+    unsigned __int128 bits;
+    unsigned int triple;
+    int i, k;
+
+    packInitTables();
+
+    for (i = 0; i < len; i += PACK_GROUP_SYMBOLS) {
+        src = &chars[i];
+        /* Pad a partial final group */
+        if (len - i < PACK_GROUP_SYMBOLS) {
+            memset(group, 'A', sizeof(group));
+            memcpy(group, src, len - i);
+            src = group;
+        }
+        bits = 0;
+        for (k = 0; k < PACK_GROUP_SYMBOLS; k += 3) {
+            triple = packCharValue[(unsigned char)src[k]] * OTP_NUM_CHARS * 
+                     OTP_NUM_CHARS + 
+                     packCharValue[(unsigned char)src[k + 1]] * OTP_NUM_CHARS +
+                     packCharValue[(unsigned char)src[k + 2]];
+            bits = (bits << PACK_TRIPLE_BITS) | triple;
+        }
+        for (k = PACK_GROUP_BYTES - 1; k >= 0; k--) {
+            out[k] = (unsigned char)bits;
+            bits >>= 8;
+        }
+        out += PACK_GROUP_BYTES;
+    }
+}
+
+/*******************************************************************************
+*      Function: unpackSymbols()
+*   Description: Unpacks groups into cipher characters.
+*    Parameters: const unsigned char *in - The packed groups.
+*                int len - The number of characters to produce.
+*                char *chars - The destination of len characters.
+* Preconditions: The input holds packedLen(len) bytes.
+*       Returns: 0 on success, -1 if a group holds an invalid triple.
+*******************************************************************************/
+
+int unpackSymbols(const unsigned char *in, int len, char *chars) {
+    char group[PACK_GROUP_SYMBOLS];
+    char *dst;
+    unsigned __int128 bits;
+    unsigned int triple, pair;
+    int i, k, shift;
+
+    packInitTables();
+
+    for (i = 0; i < len; i += PACK_GROUP_SYMBOLS) {
+        /* A partial final group is decoded aside and truncated */
+        dst = len - i < PACK_GROUP_SYMBOLS ? group : &chars[i];
+        bits = 0;
+        for (k = 0; k < PACK_GROUP_BYTES; k++) {
+            bits = (bits << 8) | in[k];
+        }
+        for (k = 0, shift = PACK_TRIPLE_BITS * 7; k < PACK_GROUP_SYMBOLS; 
+             k += 3, shift -= PACK_TRIPLE_BITS) {
+            triple = (unsigned int)(bits >> shift) & 0x7fff;
+            if (triple >= PACK_TRIPLE_MAX) {
+                return -1;
+            }
+            pair = triple / OTP_NUM_CHARS;
+            dst[k] = packPairChars[pair][0];
+            dst[k + 1] = packPairChars[pair][1];
+            dst[k + 2] = packChars[triple - pair * OTP_NUM_CHARS];
+        }
+        if (dst == group) {
+            memcpy(&chars[i], group, len - i);
+        }
+        in += PACK_GROUP_BYTES;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: packedCipher()
+*   Description: Enciphers or deciphers packed text with a packed key in place,
+*                without converting to characters. Each triple is split into its
+*                three symbol values by table, which are added to those of the
+*                key modulo OTP_NUM_CHARS in a single word and recombined.
+*    Parameters: unsigned char *text - The packed text, overwritten with the
+*                                      result.
+*                const unsigned char *key - The packed key.
+*                int len - The number of symbols.
+*                int mode - The cipher mode.
+* Preconditions: Both buffers hold packedLen(len) bytes.
+*       Returns: 0 on success, -1 if either buffer holds an invalid triple.
+*******************************************************************************/
+
+int packedCipher(unsigned char *text, const unsigned char *key, int len,
+                 int mode) {
+    const uint32_t *keyDigits;
+    unsigned __int128 textBits, keyBits, outBits;
+    uint32_t t, k, sum;
+    int groups = packedLen(len) / PACK_GROUP_BYTES;
+    int g, i, shift;
+
+    packInitTables();
+    keyDigits = mode == OTP_ENCIPHER ? packTripleDigits : packTripleNegDigits;
+
+    for (g = 0; g < groups; g++) {
+        textBits = 0;
+        keyBits = 0;
+        for (i = 0; i < PACK_GROUP_BYTES; i++) {
+            textBits = (textBits << 8) | text[i];
+            keyBits = (keyBits << 8) | key[i];
+        }
+        outBits = 0;
+        for (shift = PACK_TRIPLE_BITS * 7; shift >= 0; 
+             shift -= PACK_TRIPLE_BITS) {
+            t = (uint32_t)(textBits >> shift) & 0x7fff;
+            k = (uint32_t)(keyBits >> shift) & 0x7fff;
+            if (t >= PACK_TRIPLE_MAX || k >= PACK_TRIPLE_MAX) {
+                return -1;
+            }
+            /* Add the three digit pairs at once, one per byte, then reduce
+             * each byte that reached OTP_NUM_CHARS */
+            sum = packTripleDigits[t] + keyDigits[k];
+            sum -= (((sum + 0x010101 * (128 - OTP_NUM_CHARS)) & 0x808080) >> 7) *
+                   OTP_NUM_CHARS;
+            outBits = (outBits << PACK_TRIPLE_BITS) | 
+                      ((sum >> 16) * OTP_NUM_CHARS * OTP_NUM_CHARS + 
+                       ((sum >> 8) & 0xff) * OTP_NUM_CHARS + (sum & 0xff));
+        }
+        for (i = PACK_GROUP_BYTES - 1; i >= 0; i--) {
+            text[i] = (unsigned char)outBits;
+            outBits >>= 8;
+        }
+        text += PACK_GROUP_BYTES;
+        key += PACK_GROUP_BYTES;
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+/*******************************************************************************
+*      Filename: pack_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for pack_utils.c. Please see pack_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef PACK_UTILS_H
+#define PACK_UTILS_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PACK_TRIPLE_BITS     15  /* Bits holding three symbols */
+#define PACK_TRIPLE_MAX   19683  /* OTP_NUM_CHARS cubed */
+#define PACK_GROUP_SYMBOLS   24  /* Symbols in a packed group */
+#define PACK_GROUP_BYTES     15  /* Bytes in a packed group */
+
+int packedLen(int);
+void packSymbols(const char *, int, unsigned char *);
+int unpackSymbols(const unsigned char *, int, char *);
+int packedCipher(unsigned char *, const unsigned char *, int, int);
+
+#endif
@@ -0,0 +1,465 @@
+/*******************************************************************************
+*      Filename: pad_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Provides sequential reading of key pads. A pad is either a text
+*                file with one character per symbol, as written by keygen, or a
+*                packed file written by keygen -p. A packed pad starts with the
+*                PAD_PACKED_MAGIC line and a big endian 64 bit symbol count,
+*                followed by groups of PACK_GROUP_SYMBOLS packed symbols.
+*                An indexed pad, written by keygen -i, holds text symbols after
+*                a header recording the length, a validated flag and a header
+*                checksum, and ends with a checksum per block. Opening one
+*                costs a single header read, and only the blocks actually read
+*                are verified.
+*******************************************************************************/
+
+#include "pad_utils.h"
+
+/*******************************************************************************
+*     Functions: padGetBE(), padPutBE()
+*   Description: Decode and encode big endian integers of up to 8 bytes.
+*    Parameters: const unsigned char *in / unsigned char *out - The bytes.
+*                uint64_t val - The value to encode.
+*                int bytes - The integer width.
+* Preconditions: None.
+*       Returns: padGetBE() returns the value, padPutBE() returns nothing.
+*******************************************************************************/
+
+uint64_t padGetBE(const unsigned char *in, int bytes) {
+    uint64_t val = 0;
+    int i;
+
+    for (i = 0; i < bytes; i++) {
+        val = (val << 8) | in[i];
+    }
+    return val;
+}
+
+void padPutBE(unsigned char *out, uint64_t val, int bytes) {
+    int i;
+
+    for (i = bytes - 1; i >= 0; i--) {
+        out[i] = (unsigned char)val;
+        val >>= 8;
+    }
+}
+
+/*******************************************************************************
+*      Function: padChecksum()
+*   Description: Computes the 32 bit FNV-1a checksum of a run of bytes.
+*    Parameters: const char *buf - The bytes.
+*                int len - The number of bytes.
+* Preconditions: None.
+*       Returns: The checksum.
+*******************************************************************************/
+
+uint32_t padChecksum(const char *buf, int len) {
+    uint32_t sum = 2166136261u;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        sum = (sum ^ (unsigned char)buf[i]) * 16777619u;
+    }
+    return sum;
+}
+
+/*******************************************************************************
+*      Function: padOpenIndexed()
+*   Description: Checks the header of an indexed pad. Nothing past the header
+*                is read.
+*    Parameters: struct otpPad *pad - The pad being opened.
+*                const unsigned char *header - The PAD_INDEXED_HEADER bytes.
+* Preconditions: The magic has been matched.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padOpenIndexed(struct otpPad *pad, const unsigned char *header) {
+    if (padChecksum((const char *)header, PAD_INDEXED_HEADER - 4) != 
+        padGetBE(&header[PAD_INDEXED_HEADER - 4], 4)) {
+        fprintf(stderr, "padOpen: Corrupt indexed pad header\n");
+        return -1;
+    }
+    pad->format = PAD_FORMAT_INDEXED;
+    pad->length = (long long)padGetBE(&header[8], 8);
+    pad->indexOffset = (long long)padGetBE(&header[16], 8);
+    pad->blockSize = (int)padGetBE(&header[24], 4);
+    if (!(padGetBE(&header[28], 4) & PAD_FLAG_VALIDATED)) {
+        fprintf(stderr, "padOpen: Indexed pad has not been validated\n");
+        return -1;
+    }
+    if (pad->length < 0 || pad->blockSize <= 0 || 
+        pad->blockSize > PAD_INDEX_BLOCK_MAX || 
+        pad->indexOffset != PAD_INDEXED_HEADER + pad->length) {
+        fprintf(stderr, "padOpen: Invalid indexed pad header\n");
+        return -1;
+    }
+    pad->blockBuf = malloc(pad->blockSize);
+    if (!pad->blockBuf) {
+        perror("padOpen: malloc");
+        return -1;
+    }
+    pad->blockLoaded = -1;
+    pad->remaining = pad->length;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: padOpen()
+*   Description: Detects the format of a pad and prepares it for reading.
+*    Parameters: struct otpPad *pad - The pad to initialize.
+*                FILE *fptr - The open pad file.
+*                int raw - Nonzero if the pad holds raw bytes, which are never
+*                          treated as a packed pad.
+* Preconditions: The file is positioned at its start.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padOpen(struct otpPad *pad, FILE *fptr, int raw) {
+    unsigned char header[PAD_INDEXED_HEADER];
+    int i;
+
+    memset(pad, 0, sizeof(*pad));
+    pad->fptr = fptr;
+    pad->format = PAD_FORMAT_TEXT;
+    if (raw) {
+        return 0;
+    }
+
+    /* A text pad is read from the start, so rewind unless a magic matches */
+    if (fread(header, 1, PAD_PACKED_HEADER, fptr) != PAD_PACKED_HEADER) {
+        rewind(fptr);
+        return 0;
+    }
+    if (memcmp(header, PAD_INDEXED_MAGIC, PAD_MAGIC_BYTES) == 0) {
+        if (fread(&header[PAD_PACKED_HEADER], 1, 
+                  PAD_INDEXED_HEADER - PAD_PACKED_HEADER, fptr) != 
+            PAD_INDEXED_HEADER - PAD_PACKED_HEADER) {
+            fprintf(stderr, "padOpen: Short indexed pad header\n");
+            return -1;
+        }
+        return padOpenIndexed(pad, header);
+    }
+    if (memcmp(header, PAD_PACKED_MAGIC, PAD_MAGIC_BYTES) != 0) {
+        rewind(fptr);
+        return 0;
+    }
+
+    pad->format = PAD_FORMAT_PACKED;
+    for (i = PAD_MAGIC_BYTES; i < PAD_PACKED_HEADER; i++) {
+        pad->length = (pad->length << 8) | header[i];
+    }
+    if (pad->length < 0) {
+        fprintf(stderr, "padOpen: Invalid packed pad length\n");
+        return -1;
+    }
+    pad->remaining = pad->length;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: padReadPacked()
+*   Description: Reads symbols from a packed pad, decoding whole groups directly
+*                into the destination and keeping the tail of a partially read
+*                group for the next call.
+*    Parameters: struct otpPad *pad - The pad.
+*                char *buf - The destination.
+*                int len - The number of symbols to read.
+* Preconditions: The pad holds at least len unread symbols.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padReadPacked(struct otpPad *pad, char *buf, int len) {
+    unsigned char packed[PAD_READ_GROUPS * PACK_GROUP_BYTES];
+    int n, groups, symbols;
+
+    /* Use up the symbols left over from the previous read */
+    n = pad->spareLen - pad->sparePos;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(buf, &pad->spare[pad->sparePos], n);
+    pad->sparePos += n;
+    buf += n;
+    len -= n;
+
+    while (len > 0) {
+        groups = (len + PACK_GROUP_SYMBOLS - 1) / PACK_GROUP_SYMBOLS;
+        if (groups > PAD_READ_GROUPS) {
+            groups = PAD_READ_GROUPS;
+        }
+        if (fread(packed, PACK_GROUP_BYTES, groups, pad->fptr) != 
+            (size_t)groups) {
+            fprintf(stderr, "padRead: Short read\n");
+            return -1;
+        }
+        symbols = groups * PACK_GROUP_SYMBOLS;
+        if (symbols <= len) {
+            /* Whole groups decode straight into the destination */
+            if (unpackSymbols(packed, symbols, buf) < 0) {
+                fprintf(stderr, "padRead: Corrupt packed pad\n");
+                return -1;
+            }
+            buf += symbols;
+            len -= symbols;
+            continue;
+        }
+        /* The last group is only partly needed. Decode it aside. */
+        symbols -= PACK_GROUP_SYMBOLS;
+        if (unpackSymbols(packed, symbols, buf) < 0 ||
+            unpackSymbols(&packed[groups * PACK_GROUP_BYTES - PACK_GROUP_BYTES],
+                          PACK_GROUP_SYMBOLS, pad->spare) < 0) {
+            fprintf(stderr, "padRead: Corrupt packed pad\n");
+            return -1;
+        }
+        memcpy(&buf[symbols], pad->spare, len - symbols);
+        pad->spareLen = PACK_GROUP_SYMBOLS;
+        pad->sparePos = len - symbols;
+        len = 0;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: padLoadBlock()
+*   Description: Reads one block of an indexed pad and verifies it against its
+*                index entry. Reads go straight to the file offset, so only the
+*                blocks used are touched.
+*    Parameters: struct otpPad *pad - The pad.
+*                long long block - The block number.
+*                char *buf - The destination, at least one block long.
+* Preconditions: The block lies within the pad.
+*       Returns: The number of symbols in the block, or -1 on error.
+*******************************************************************************/
+
+int padLoadBlock(struct otpPad *pad, long long block, char *buf) {
+    unsigned char entry[PAD_INDEX_ENTRY];
+    long long start = block * pad->blockSize;
+    int fd = fileno(pad->fptr);
+    int len = pad->blockSize;
+
+    if (pad->length - start < len) {
+        len = (int)(pad->length - start);
+    }
+    if (pread(fd, buf, len, PAD_INDEXED_HEADER + start) != len ||
+        pread(fd, entry, sizeof(entry), 
+              pad->indexOffset + block * PAD_INDEX_ENTRY) != sizeof(entry)) {
+        fprintf(stderr, "padRead: Short read\n");
+        return -1;
+    }
+    if (padChecksum(buf, len) != padGetBE(entry, PAD_INDEX_ENTRY)) {
+        fprintf(stderr, "padRead: Indexed pad block %lld is corrupt\n", block);
+        return -1;
+    }
+    return len;
+}
+
+/*******************************************************************************
+*      Function: padReadIndexed()
+*   Description: Reads symbols from an indexed pad. Whole blocks are read and 
+*                verified in the destination. A partly read block is kept 
+*                aside, verified once, for the next call.
+*    Parameters: struct otpPad *pad - The pad.
+*                char *buf - The destination.
+*                int len - The number of symbols to read.
+* Preconditions: The pad holds at least len unread symbols.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padReadIndexed(struct otpPad *pad, char *buf, int len) {
+    long long pos = pad->length - pad->remaining;
+    long long block;
+    int offset, n, blockLen;
+
+    while (len > 0) {
+        block = pos / pad->blockSize;
+        offset = (int)(pos - block * pad->blockSize);
+        blockLen = pad->blockSize;
+        if (pad->length - block * pad->blockSize < blockLen) {
+            blockLen = (int)(pad->length - block * pad->blockSize);
+        }
+
+        if (offset == 0 && len >= blockLen && block != pad->blockLoaded) {
+            /* A whole block is verified where it lands */
+            if (padLoadBlock(pad, block, buf) < 0) {
+                return -1;
+            }
+            n = blockLen;
+        } else {
+            if (block != pad->blockLoaded) {
+                if (padLoadBlock(pad, block, pad->blockBuf) < 0) {
+                    return -1;
+                }
+                pad->blockLoaded = block;
+            }
+            n = blockLen - offset;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(buf, &pad->blockBuf[offset], n);
+        }
+        buf += n;
+        len -= n;
+        pos += n;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: padRead()
+*   Description: Reads the next symbols of a pad as cipher characters.
+*    Parameters: struct otpPad *pad - The pad.
+*                char *buf - The destination.
+*                int len - The number of symbols to read.
+* Preconditions: The pad has been opened.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padRead(struct otpPad *pad, char *buf, int len) {
+    if (pad->format == PAD_FORMAT_TEXT) {
+        if (fread(buf, 1, len, pad->fptr) != (size_t)len) {
+            fprintf(stderr, "padRead: Short read\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (len > pad->remaining) {
+        fprintf(stderr, "padRead: Read past the end of the pad\n");
+        return -1;
+    }
+    if (pad->format == PAD_FORMAT_INDEXED) {
+        if (padReadIndexed(pad, buf, len) < 0) {
+            return -1;
+        }
+    } else if (padReadPacked(pad, buf, len) < 0) {
+        return -1;
+    }
+    pad->remaining -= len;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: padSeek()
+*   Description: Positions a pad so that the next read starts at a symbol 
+*                offset. A packed pad is positioned at the group holding the
+*                offset and the symbols ahead of it in the group are read aside.
+*    Parameters: struct otpPad *pad - The pad.
+*                long long offset - The symbol offset from the start of the pad.
+* Preconditions: The pad has been opened.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padSeek(struct otpPad *pad, long long offset) {
+    char skip[PACK_GROUP_SYMBOLS];
+    long long group;
+
+    if (offset < 0 || (pad->format != PAD_FORMAT_TEXT && 
+                       offset > pad->length)) {
+        fprintf(stderr, "padSeek: Offset outside the pad\n");
+        return -1;
+    }
+    if (pad->format == PAD_FORMAT_TEXT) {
+        if (fseeko(pad->fptr, offset, SEEK_SET) < 0) {
+            perror("padSeek: fseeko");
+            return -1;
+        }
+        return 0;
+    }
+    if (pad->format == PAD_FORMAT_INDEXED) {
+        pad->remaining = pad->length - offset;
+        return 0;
+    }
+
+    group = offset / PACK_GROUP_SYMBOLS;
+    if (fseeko(pad->fptr, PAD_PACKED_HEADER + group * PACK_GROUP_BYTES, 
+               SEEK_SET) < 0) {
+        perror("padSeek: fseeko");
+        return -1;
+    }
+    pad->spareLen = 0;
+    pad->sparePos = 0;
+    pad->remaining = pad->length - group * PACK_GROUP_SYMBOLS;
+    return padRead(pad, skip, (int)(offset - group * PACK_GROUP_SYMBOLS));
+}
+
+/*******************************************************************************
+*      Function: padClose()
+*   Description: Releases the buffers of a pad. The file is left open.
+*    Parameters: struct otpPad *pad - The pad.
+* Preconditions: The pad has been opened.
+*       Returns: None.
+*******************************************************************************/
+
+void padClose(struct otpPad *pad) {
+    free(pad->blockBuf);
+    pad->blockBuf = NULL;
+}
+
+/*******************************************************************************
+*      Function: padWriteHeader()
+*   Description: Writes a packed pad header.
+*    Parameters: FILE *fptr - The output stream.
+*                long long length - The number of symbols in the pad.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void padWriteHeader(FILE *fptr, long long length) {
+    unsigned char header[PAD_PACKED_HEADER];
+    int i;
+
+    memcpy(header, PAD_PACKED_MAGIC, PAD_MAGIC_BYTES);
+    for (i = PAD_PACKED_HEADER - 1; i >= PAD_MAGIC_BYTES; i--) {
+        header[i] = (unsigned char)length;
+        length >>= 8;
+    }
+    fwrite(header, 1, sizeof(header), fptr);
+}
+
+/*******************************************************************************
+*      Function: padWriteIndexedHeader()
+*   Description: Writes an indexed pad header. The pad writer vouches that every
+*                symbol is a valid cipher character.
+*    Parameters: FILE *fptr - The output stream.
+*                long long length - The number of symbols in the pad.
+*                int blockSize - The number of symbols per indexed block.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void padWriteIndexedHeader(FILE *fptr, long long length, int blockSize) {
+    unsigned char header[PAD_INDEXED_HEADER];
+
+    memcpy(header, PAD_INDEXED_MAGIC, PAD_MAGIC_BYTES);
+    padPutBE(&header[8], length, 8);
+    padPutBE(&header[16], PAD_INDEXED_HEADER + length, 8);
+    padPutBE(&header[24], blockSize, 4);
+    padPutBE(&header[28], PAD_FLAG_VALIDATED, 4);
+    padPutBE(&header[PAD_INDEXED_HEADER - 4], 
+             padChecksum((const char *)header, PAD_INDEXED_HEADER - 4), 4);
+    fwrite(header, 1, sizeof(header), fptr);
+}
+
+/*******************************************************************************
+*      Function: padWriteIndex()
+*   Description: Writes the block index that ends an indexed pad.
+*    Parameters: FILE *fptr - The output stream.
+*                const uint32_t *sums - The checksum of each block.
+*                long long blocks - The number of blocks.
+* Preconditions: The header and all symbols have been written.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int padWriteIndex(FILE *fptr, const uint32_t *sums, long long blocks) {
+    unsigned char entry[PAD_INDEX_ENTRY];
+    long long i;
+
+    for (i = 0; i < blocks; i++) {
+        padPutBE(entry, sums[i], PAD_INDEX_ENTRY);
+        if (fwrite(entry, 1, sizeof(entry), fptr) != sizeof(entry)) {
+            return -1;
+        }
+    }
+    return 0;
+}
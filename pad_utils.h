@@ -0,0 +1,66 @@
+/*******************************************************************************
+*      Filename: pad_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for pad_utils.c. Please see pad_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef PAD_UTILS_H
+#define PAD_UTILS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pack_utils.h"
+
+#define PAD_FORMAT_TEXT     0           /* One byte per symbol */
+#define PAD_FORMAT_PACKED   1           /* Packed groups of 24 symbols */
+#define PAD_FORMAT_INDEXED  2           /* Text with a block checksum index */
+#define PAD_MAGIC_BYTES     8           /* The pad header magic length */
+#define PAD_PACKED_MAGIC    "OTPPAD5\n" /* The packed pad header magic */
+#define PAD_PACKED_HEADER  16           /* Magic plus 64 bit symbol count */
+#define PAD_READ_GROUPS  1024           /* Groups decoded per read */
+#define PAD_INDEXED_MAGIC   "OTPPADI\n" /* The indexed pad header magic */
+#define PAD_INDEXED_HEADER 36           /* The indexed pad header size */
+#define PAD_INDEX_BLOCK  4096           /* Symbols per indexed block */
+#define PAD_INDEX_BLOCK_MAX 65536       /* The largest block size read */
+#define PAD_INDEX_ENTRY     4           /* Bytes per block checksum */
+#define PAD_FLAG_VALIDATED 0x01         /* Every symbol is a cipher char */
+
+/* Indexed pad header layout, big endian:
+ *   [0..7] PAD_INDEXED_MAGIC  [8..15] symbol count  [16..23] index offset
+ *   [24..27] block size  [28..31] flags  [32..35] checksum of bytes 0..31
+ * The symbols follow the header. The index holds one checksum per block. */
+
+/* A key pad opened for sequential reading */
+struct otpPad {
+    FILE *fptr;                          /* The underlying file */
+    int format;                          /* PAD_FORMAT_TEXT, _PACKED or 
+                                          * _INDEXED */
+    long long length;                    /* Symbols in a packed or indexed 
+                                          * pad */
+    long long remaining;                 /* Unread symbols in a packed or 
+                                          * indexed pad */
+    char spare[PACK_GROUP_SYMBOLS];      /* Decoded symbols not yet read */
+    int spareLen;                        /* The number of spare symbols */
+    int sparePos;                        /* The next spare symbol */
+    long long indexOffset;               /* The index offset in the file */
+    int blockSize;                       /* Symbols per indexed block */
+    long long blockLoaded;               /* The block in blockBuf, or -1 */
+    char *blockBuf;                      /* The last partly read block */
+};
+
+int padOpen(struct otpPad *, FILE *, int);
+int padRead(struct otpPad *, char *, int);
+int padSeek(struct otpPad *, long long);
+void padClose(struct otpPad *);
+void padWriteHeader(FILE *, long long);
+uint32_t padChecksum(const char *, int);
+void padWriteIndexedHeader(FILE *, long long, int);
+int padWriteIndex(FILE *, const uint32_t *, long long);
+
+#endif
@@ -0,0 +1,223 @@
+/*******************************************************************************
+*      Filename: parallel_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Splits the work on a large frame across helper threads. The
+*                work is cut into cache sized chunks, which the calling thread
+*                and the helpers claim in order from a shared counter, so that
+*                a single connection's frame is no longer bound to one core.
+*                Below PARALLEL_THRESHOLD symbols, or when the process may run
+*                on only one core, as a pinned shard does, the work stays on
+*                the calling thread.
+*
+*                Helpers are started the first time a process splits a frame,
+*                one per core the process may run on, less the caller's. They
+*                block every signal, so that signals still reach the thread
+*                that serves connections. One task runs at a time; a thread
+*                that finds another task running does its work alone.
+*******************************************************************************/
+
+#include "parallel_utils.h"
+
+/* A task being run */
+struct parallelJob {
+    const struct parallelTask *task; /* The task */
+    int len;                         /* The symbol count */
+    int chunk;                       /* Symbols per chunk */
+    int chunks;                      /* The number of chunks */
+    int next;                        /* The next chunk to claim */
+    int committed;                   /* Chunks committed, in order */
+    int status;                      /* -1 once a chunk fails */
+    int active;                      /* Helpers working on the job */
+};
+
+static pthread_mutex_t parallelRunLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t parallelLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t parallelWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t parallelIdle = PTHREAD_COND_INITIALIZER;
+static struct parallelJob *parallelJob;  /* The job on offer, or NULL */
+static unsigned parallelGeneration;      /* Bumped as each job is offered */
+static int parallelHelpers = -1;         /* Helpers running, -1 until started */
+static pid_t parallelPid;                /* The process the helpers belong to */
+
+/* Scratch buffers for ordered tasks, one per participant, the caller first.
+ * Pages that are never touched take no memory. */
+static char parallelScratch[PARALLEL_HELPERS_MAX + 1][PARALLEL_CHUNK];
+
+/*******************************************************************************
+*      Function: parallelWork()
+*   Description: Claims and processes chunks of a job until none remain.
+*    Parameters: struct parallelJob *job - The job.
+*                char *scratch - The participant's scratch buffer.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void parallelWork(struct parallelJob *job, char *scratch) {
+    const struct parallelTask *task = job->task;
+    int i, start, len, status;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) <
+           job->chunks) {
+        start = i * job->chunk;
+        len = job->len - start < job->chunk ? job->len - start : job->chunk;
+        if (!task->commit) {
+            if (task->work(task->arg, NULL, start, len) < 0) {
+                __atomic_store_n(&job->status, -1, __ATOMIC_RELAXED);
+            }
+            continue;
+        }
+
+        /* Wait for the chunks before this one to be committed. They were
+         * claimed first, so each is already being processed. */
+        status = task->work(task->arg, scratch, start, len);
+        while (__atomic_load_n(&job->committed, __ATOMIC_ACQUIRE) != i) {
+            sched_yield();
+        }
+        if (status < 0) {
+            __atomic_store_n(&job->status, -1, __ATOMIC_RELAXED);
+        } else {
+            task->commit(task->arg, scratch, start, len);
+        }
+        __atomic_store_n(&job->committed, i + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/*******************************************************************************
+*      Function: parallelHelperMain()
+*   Description: The helper thread procedure. Joins each job offered.
+*    Parameters: void *arg - The helper's scratch buffer.
+* Preconditions: None.
+*       Returns: Never returns.
+*******************************************************************************/
+
+void *parallelHelperMain(void *arg) {
+    struct parallelJob *job;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&parallelLock);
+    while (1) {
+        while (!parallelJob || parallelGeneration == seen) {
+            pthread_cond_wait(&parallelWake, &parallelLock);
+        }
+        seen = parallelGeneration;
+        job = parallelJob;
+        job->active++;
+        pthread_mutex_unlock(&parallelLock);
+
+        parallelWork(job, arg);
+
+        pthread_mutex_lock(&parallelLock);
+        if (--job->active == 0) {
+            pthread_cond_signal(&parallelIdle);
+        }
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+*      Function: parallelStart()
+*   Description: Starts a helper for every core the process may run on, beyond
+*                the caller's.
+*    Parameters: None.
+* Preconditions: The run lock is held.
+*       Returns: None.
+*******************************************************************************/
+
+void parallelStart() {
+    cpu_set_t allowed;
+    sigset_t all, old;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int i, wanted;
+
+    parallelHelpers = 0;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return;
+    }
+    wanted = CPU_COUNT(&allowed) - 1;
+    if (wanted > PARALLEL_HELPERS_MAX) {
+        wanted = PARALLEL_HELPERS_MAX;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 0; i < wanted; i++) {
+        if (pthread_create(&thread, &attr, parallelHelperMain,
+                           parallelScratch[i + 1]) != 0) {
+            fprintf(stderr, "parallelStart: pthread_create failed\n");
+            break;
+        }
+        parallelHelpers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+}
+
+/*******************************************************************************
+*      Function: parallelRun()
+*   Description: Runs a task over a number of symbols, splitting it across the
+*                helpers if it is large enough.
+*    Parameters: const struct parallelTask *task - The task.
+*                int len - The number of symbols.
+* Preconditions: A process forked from one with helpers runs its first task
+*                before starting threads of its own.
+*       Returns: 0 on success, -1 if any chunk failed.
+*******************************************************************************/
+
+int parallelRun(const struct parallelTask *task, int len) {
+    struct parallelJob job = {0};
+    pid_t pid;
+
+    if (len < PARALLEL_THRESHOLD) {
+        return task->work(task->arg, NULL, 0, len);
+    }
+    /* Only the forking thread exists in a child. Start afresh. */
+    pid = getpid();
+    if (pid != parallelPid) {
+        pthread_mutex_init(&parallelRunLock, NULL);
+        pthread_mutex_init(&parallelLock, NULL);
+        pthread_cond_init(&parallelWake, NULL);
+        pthread_cond_init(&parallelIdle, NULL);
+        parallelJob = NULL;
+        parallelHelpers = -1;
+        parallelPid = pid;
+    }
+    if (pthread_mutex_trylock(&parallelRunLock) != 0) {
+        return task->work(task->arg, NULL, 0, len);
+    }
+    if (parallelHelpers < 0) {
+        parallelStart();
+    }
+    if (parallelHelpers == 0) {
+        pthread_mutex_unlock(&parallelRunLock);
+        return task->work(task->arg, NULL, 0, len);
+    }
+
+    job.task = task;
+    job.len = len;
+    job.chunk = PARALLEL_CHUNK / task->align * task->align;
+    job.chunks = (len + job.chunk - 1) / job.chunk;
+
+    /* Offer the job, take a share of it, then wait for the helpers to leave
+     * it before it goes out of scope */
+    pthread_mutex_lock(&parallelLock);
+    parallelJob = &job;
+    parallelGeneration++;
+    pthread_cond_broadcast(&parallelWake);
+    pthread_mutex_unlock(&parallelLock);
+
+    parallelWork(&job, parallelScratch[0]);
+
+    pthread_mutex_lock(&parallelLock);
+    parallelJob = NULL;
+    while (job.active > 0) {
+        pthread_cond_wait(&parallelIdle, &parallelLock);
+    }
+    pthread_mutex_unlock(&parallelLock);
+
+    pthread_mutex_unlock(&parallelRunLock);
+    return job.status;
+}
@@ -0,0 +1,50 @@
+/*******************************************************************************
+*      Filename: parallel_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for parallel_utils.c. Please see
+*                parallel_utils.c for more details.
+*******************************************************************************/
+
+#ifndef PARALLEL_UTILS_H
+#define PARALLEL_UTILS_H
+
+/* sched_getaffinity() and the CPU_SET macros are Linux extensions */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PARALLEL_CHUNK      65536  /* Symbols per chunk, so that a chunk's text
+                                    * and key stay in a core's L2 cache */
+#define PARALLEL_THRESHOLD 262144  /* The fewest symbols split across threads */
+#define PARALLEL_HELPERS_MAX    7  /* The most helper threads per process */
+
+/* Work split into chunks of symbols. Without a commit function, each chunk is
+ * processed in place and the chunks are independent. With one, each chunk is
+ * processed into a scratch buffer and committed in chunk order, so that work
+ * whose output overlaps its input, such as packing in place, sees the same
+ * buffer states as a single pass from the first symbol to the last. */
+struct parallelTask {
+    int (*work)(void *, char *, int, int); /* Processes a chunk: the argument,
+                                            * the scratch buffer or NULL for
+                                            * in place, the first symbol and
+                                            * the symbol count. Returns -1 on
+                                            * error. */
+    void (*commit)(void *, const char *, int, int); /* Moves a chunk from the
+                                                     * scratch buffer into
+                                                     * place, or NULL */
+    void *arg;                             /* The work's argument */
+    int align;                             /* Chunk lengths are a multiple of
+                                            * this many symbols */
+};
+
+int parallelRun(const struct parallelTask *, int);
+
+#endif
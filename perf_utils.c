@@ -0,0 +1,135 @@
+/*******************************************************************************
+*      Filename: perf_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Reads hardware performance counters around a measured region
+*                with perf_event_open(). Each counter is opened on its own, for
+*                the calling thread in user mode, so a machine or container
+*                that lacks one counter, or forbids them all, still reports the
+*                rest. When the kernel multiplexes more counters than the core
+*                holds, each count is scaled by the share of time it ran.
+*******************************************************************************/
+
+#include "perf_utils.h"
+
+/* The event of each counter, in PERF order */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} perfEvents[PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+/*******************************************************************************
+*      Function: perfOpen()
+*   Description: Opens every counter the kernel allows.
+*    Parameters: struct perfCounters *p - The counters.
+* Preconditions: None.
+*       Returns: The number of counters opened. The errno of the first failure
+*                is kept if none were.
+*******************************************************************************/
+
+int perfOpen(struct perfCounters *p) {
+    struct perf_event_attr attr;
+    int i, firstErrno = 0;
+
+    p->opened = 0;
+    for (i = 0; i < PERF_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perfEvents[i].type;
+        attr.config = perfEvents[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        p->fd[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (p->fd[i] >= 0) {
+            p->opened++;
+        } else if (!firstErrno) {
+            firstErrno = errno;
+        }
+    }
+    if (!p->opened) {
+        errno = firstErrno;
+    }
+    return p->opened;
+}
+
+/*******************************************************************************
+*      Function: perfStart()
+*   Description: Zeroes and starts the counters.
+*    Parameters: struct perfCounters *p - The counters.
+* Preconditions: The counters have been opened.
+*       Returns: None.
+*******************************************************************************/
+
+void perfStart(struct perfCounters *p) {
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if (p->fd[i] >= 0) {
+            ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: perfStop()
+*   Description: Stops the counters and reads them.
+*    Parameters: struct perfCounters *p - The counters.
+*                uint64_t *counts - PERF_EVENTS counts to fill in, each
+*                                   PERF_UNAVAILABLE if it was not counted.
+* Preconditions: The counters have been started.
+*       Returns: None.
+*******************************************************************************/
+
+void perfStop(struct perfCounters *p, uint64_t *counts) {
+    uint64_t value[3];  /* The count, time enabled and time running */
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if (p->fd[i] >= 0) {
+            ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (i = 0; i < PERF_EVENTS; i++) {
+        counts[i] = PERF_UNAVAILABLE;
+        if (p->fd[i] < 0 ||
+            read(p->fd[i], value, sizeof(value)) != sizeof(value) ||
+            value[2] == 0) {
+            continue;
+        }
+        counts[i] = value[2] < value[1] ?
+                    (uint64_t)((double)value[0] * value[1] / value[2]) :
+                    value[0];
+    }
+}
+
+/*******************************************************************************
+*      Function: perfClose()
+*   Description: Closes the counters.
+*    Parameters: struct perfCounters *p - The counters.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void perfClose(struct perfCounters *p) {
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if (p->fd[i] >= 0) {
+            close(p->fd[i]);
+            p->fd[i] = -1;
+        }
+    }
+    p->opened = 0;
+}
@@ -0,0 +1,41 @@
+/*******************************************************************************
+*      Filename: perf_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for perf_utils.c. Please see perf_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef PERF_UTILS_H
+#define PERF_UTILS_H
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define PERF_CYCLES          0  /* Core cycles */
+#define PERF_INSTRUCTIONS    1  /* Instructions retired */
+#define PERF_L1D_MISSES      2  /* L1 data cache read misses */
+#define PERF_LLC_MISSES      3  /* Last level cache misses */
+#define PERF_BRANCH_MISSES   4  /* Mispredicted branches */
+#define PERF_EVENTS          5  /* The number of counters */
+
+#define PERF_UNAVAILABLE UINT64_MAX  /* A counter that could not be read */
+
+/* The counters measuring the calling thread */
+struct perfCounters {
+    int fd[PERF_EVENTS];    /* Each counter, -1 if it could not be opened */
+    int opened;             /* The number of counters opened */
+};
+
+int perfOpen(struct perfCounters *);
+void perfStart(struct perfCounters *);
+void perfStop(struct perfCounters *, uint64_t *);
+void perfClose(struct perfCounters *);
+
+#endif
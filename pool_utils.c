@@ -0,0 +1,257 @@
+/*******************************************************************************
+*      Filename: pool_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: A size-classed buffer pool for the daemons. Buffers come in
+*                power of two classes from 2^POOL_CLASS_MIN_SHIFT to
+*                2^POOL_CLASS_MAX_SHIFT bytes. Each thread keeps a small cache
+*                of free buffers per class, backed by shared free lists. All
+*                memory taken from the system counts against a global budget.
+*                Once the budget is spent, poolAlloc() first gives back the
+*                caller's own cached buffers and the free buffers of other
+*                classes, then fails rather than growing, and the caller is
+*                expected to wait for buffers to be freed.
+*******************************************************************************/
+
+#include "pool_utils.h"
+#include "stats_utils.h"
+
+/* A free buffer. The link lives in the buffer itself. */
+struct poolFreeBuf {
+    struct poolFreeBuf *next;
+};
+
+/* The per-thread cache of free buffers */
+struct poolCache {
+    void *bufs[POOL_CLASSES][POOL_CACHE_MAX];
+    int count[POOL_CLASSES];
+};
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static struct poolFreeBuf *poolFreeLists[POOL_CLASSES];
+static size_t poolBudget = POOL_BUDGET_DEFAULT;
+static size_t poolBytes;
+static __thread struct poolCache poolCache;
+
+/*******************************************************************************
+*      Function: poolInit()
+*   Description: Sets the memory budget.
+*    Parameters: size_t budget - The budget in bytes. Raised to POOL_BUDGET_MIN
+*                                if smaller.
+* Preconditions: Called before the first allocation.
+*       Returns: None.
+*******************************************************************************/
+
+void poolInit(size_t budget) {
+    poolBudget = budget < POOL_BUDGET_MIN ? POOL_BUDGET_MIN : budget;
+}
+
+/*******************************************************************************
+*      Function: poolClass()
+*   Description: Finds the smallest class holding a buffer length.
+*    Parameters: int len - The buffer length.
+* Preconditions: None.
+*       Returns: The class index, or -1 if the length is too large.
+*******************************************************************************/
+
+int poolClass(int len) {
+    int cls = 0;
+
+    while (cls < POOL_CLASSES && (1 << (cls + POOL_CLASS_MIN_SHIFT)) < len) {
+        cls++;
+    }
+    return cls < POOL_CLASSES ? cls : -1;
+}
+
+/*******************************************************************************
+*      Function: poolDrainCache()
+*   Description: Moves a thread's cached buffers to the shared free lists.
+*    Parameters: struct poolCache *cache - The calling thread's cache.
+* Preconditions: The pool lock is held.
+*       Returns: None.
+*******************************************************************************/
+
+void poolDrainCache(struct poolCache *cache) {
+    struct poolFreeBuf *buf;
+    int cls;
+
+    for (cls = 0; cls < POOL_CLASSES; cls++) {
+        while (cache->count[cls] > 0) {
+            buf = cache->bufs[cls][--cache->count[cls]];
+            buf->next = poolFreeLists[cls];
+            poolFreeLists[cls] = buf;
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: poolRelease()
+*   Description: Returns free buffers to the system until a number of bytes is
+*                released, starting with the classes other than the one in
+*                demand.
+*    Parameters: size_t want - The number of bytes to release.
+*                int keep - The class in demand.
+* Preconditions: The pool lock is held.
+*       Returns: None.
+*******************************************************************************/
+
+void poolRelease(size_t want, int keep) {
+    struct poolFreeBuf *buf;
+    size_t released = 0;
+    size_t size;
+    int cls;
+
+    for (cls = 0; cls < POOL_CLASSES && released < want; cls++) {
+        if (cls == keep) {
+            continue;
+        }
+        size = (size_t)1 << (cls + POOL_CLASS_MIN_SHIFT);
+        while (poolFreeLists[cls] && released < want) {
+            buf = poolFreeLists[cls];
+            poolFreeLists[cls] = buf->next;
+            free((char *)buf - POOL_HEADER_BYTES);
+            released += size;
+        }
+    }
+    poolBytes -= released;
+    STATS_ADD(poolBytes, -(int64_t)released);
+}
+
+/*******************************************************************************
+*      Function: poolAlloc()
+*   Description: Allocates a buffer from the pool.
+*    Parameters: int len - The number of bytes needed.
+* Preconditions: None.
+*       Returns: A buffer of at least len bytes, or NULL if the length is too
+*                large or the memory budget is spent.
+*******************************************************************************/
+
+void *poolAlloc(int len) {
+    struct poolCache *cache = &poolCache;
+    struct poolFreeBuf *buf;
+    size_t size;
+    char *mem;
+    int cls = poolClass(len);
+
+    if (cls < 0) {
+        return NULL;
+    }
+    if (cache->count[cls] > 0) {
+        return cache->bufs[cls][--cache->count[cls]];
+    }
+
+    size = (size_t)1 << (cls + POOL_CLASS_MIN_SHIFT);
+    pthread_mutex_lock(&poolLock);
+    buf = poolFreeLists[cls];
+    if (buf) {
+        poolFreeLists[cls] = buf->next;
+        pthread_mutex_unlock(&poolLock);
+        return buf;
+    }
+    /* Free buffers of other classes, including those in this thread's
+     * cache, are given back before giving up. A single-threaded engine frees
+     * every buffer into its own cache, where nothing else would reach it. */
+    if (poolBytes + size > poolBudget) {
+        poolDrainCache(cache);
+        poolRelease(poolBytes + size - poolBudget, cls);
+    }
+    if (poolBytes + size > poolBudget) {
+        pthread_mutex_unlock(&poolLock);
+        return NULL;
+    }
+    poolBytes += size;
+    pthread_mutex_unlock(&poolLock);
+    STATS_ADD(poolBytes, size);
+
+    mem = malloc(POOL_HEADER_BYTES + size);
+    if (!mem) {
+        perror("poolAlloc: malloc");
+        pthread_mutex_lock(&poolLock);
+        poolBytes -= size;
+        pthread_mutex_unlock(&poolLock);
+        STATS_ADD(poolBytes, -(int64_t)size);
+        return NULL;
+    }
+    *(int *)mem = cls;
+    return mem + POOL_HEADER_BYTES;
+}
+
+/*******************************************************************************
+*      Function: poolFree()
+*   Description: Returns a buffer to the pool. A full thread cache moves half of
+*                its buffers of that class to the shared free list.
+*    Parameters: void *ptr - The buffer, or NULL.
+* Preconditions: The buffer came from poolAlloc().
+*       Returns: None.
+*******************************************************************************/
+
+void poolFree(void *ptr) {
+    struct poolCache *cache = &poolCache;
+    struct poolFreeBuf *buf;
+    int cls;
+
+    if (!ptr) {
+        return;
+    }
+    cls = *(int *)((char *)ptr - POOL_HEADER_BYTES);
+    if (cache->count[cls] < POOL_CACHE_MAX) {
+        cache->bufs[cls][cache->count[cls]++] = ptr;
+        return;
+    }
+
+    pthread_mutex_lock(&poolLock);
+    while (cache->count[cls] > POOL_CACHE_MAX / 2) {
+        buf = cache->bufs[cls][--cache->count[cls]];
+        buf->next = poolFreeLists[cls];
+        poolFreeLists[cls] = buf;
+    }
+    buf = ptr;
+    buf->next = poolFreeLists[cls];
+    poolFreeLists[cls] = buf;
+    pthread_mutex_unlock(&poolLock);
+}
+
+/*******************************************************************************
+*      Function: poolBufSize()
+*   Description: Determines the usable size of a pool buffer.
+*    Parameters: const void *ptr - The buffer.
+* Preconditions: The buffer came from poolAlloc().
+*       Returns: The buffer size in bytes.
+*******************************************************************************/
+
+int poolBufSize(const void *ptr) {
+    return 1 << (*(const int *)((const char *)ptr - POOL_HEADER_BYTES) +
+                 POOL_CLASS_MIN_SHIFT);
+}
+
+/*******************************************************************************
+*      Function: poolUsed()
+*   Description: Reports the memory taken from the system.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The number of bytes counted against the budget.
+*******************************************************************************/
+
+size_t poolUsed() {
+    size_t used;
+
+    pthread_mutex_lock(&poolLock);
+    used = poolBytes;
+    pthread_mutex_unlock(&poolLock);
+    return used;
+}
+
+/*******************************************************************************
+*      Function: poolFlushCache()
+*   Description: Moves the calling thread's cached buffers to the shared free
+*                lists, so that other threads can use them.
+*    Parameters: None.
+* Preconditions: Called before a thread using the pool exits.
+*       Returns: None.
+*******************************************************************************/
+
+void poolFlushCache() {
+    pthread_mutex_lock(&poolLock);
+    poolDrainCache(&poolCache);
+    pthread_mutex_unlock(&poolLock);
+}
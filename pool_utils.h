@@ -0,0 +1,38 @@
+/*******************************************************************************
+*      Filename: pool_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for pool_utils.c. Please see pool_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef POOL_UTILS_H
+#define POOL_UTILS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define POOL_CLASS_MIN_SHIFT  11          /* The smallest class, 2 KiB */
+#define POOL_CLASS_MAX_SHIFT  21          /* The largest class, 2 MiB, which
+                                           * holds the largest frame */
+#define POOL_CLASSES  (POOL_CLASS_MAX_SHIFT - POOL_CLASS_MIN_SHIFT + 1)
+#define POOL_CACHE_MAX         8          /* Buffers cached per thread and
+                                           * class */
+#define POOL_HEADER_BYTES     16          /* The class tag ahead of a buffer */
+#define POOL_BUDGET_MIN  (2 << POOL_CLASS_MAX_SHIFT) /* The smallest memory
+                                                      * budget, which fits the
+                                                      * largest buffer beside
+                                                      * smaller ones */
+#define POOL_BUDGET_DEFAULT (64 << 20)    /* The default memory budget */
+
+void poolInit(size_t);
+void *poolAlloc(int);
+void poolFree(void *);
+int poolBufSize(const void *);
+size_t poolUsed();
+void poolFlushCache();
+
+#endif
@@ -0,0 +1,192 @@
+/*******************************************************************************
+*      Filename: reuse_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Detects reused pad material. Keys arrive inline, so the
+*                daemons sample a window of key symbols at every REUSE_STRIDE
+*                pad position a segment covers and look its fingerprint up in
+*                an index shared by every process serving the port. A client
+*                that reuses a pad sends the same key symbols at the same pad
+*                positions, whatever its segment sizes and encoding, and hits
+*                the index. Each slot also holds a tag of the text sent with
+*                the window, so a retransmitted segment, which pairs the key
+*                with the same text and reveals nothing, is not flagged.
+*
+*                The index is a fixed array of cache line buckets updated with
+*                atomic operations, so no lock is taken and memory never grows.
+*                A full bucket forgets one of its windows.
+*******************************************************************************/
+
+#include "pack_utils.h"
+#include "reuse_utils.h"
+#include "stats_utils.h"
+
+static uint64_t *reuseSlots = NULL;  /* The shared index, NULL if disabled */
+static uint64_t reuseMask;           /* The number of buckets less one */
+static int reusePolicy = REUSE_OFF;  /* REUSE_FLAG or REUSE_REJECT */
+
+/*******************************************************************************
+*      Function: reuseInit()
+*   Description: Maps the shared index.
+*    Parameters: size_t bytes - The index size, rounded down to a power of two
+*                               number of buckets.
+*                int policy - REUSE_FLAG or REUSE_REJECT.
+* Preconditions: No child process has been forked yet.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int reuseInit(size_t bytes, int policy) {
+    size_t bucketBytes = REUSE_BUCKET_SLOTS * sizeof(uint64_t);
+    uint64_t buckets = 1;
+    void *region;
+
+    while (buckets * 2 * bucketBytes <= bytes) {
+        buckets *= 2;
+    }
+    region = mmap(NULL, buckets * bucketBytes, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("reuseInit: mmap");
+        return -1;
+    }
+    /* Anonymous mappings are zero filled, and zero marks an empty slot */
+    reuseSlots = region;
+    reuseMask = buckets - 1;
+    reusePolicy = policy;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: reuseMix()
+*   Description: Mixes the bits of a word.
+*    Parameters: uint64_t h - The word.
+* Preconditions: None.
+*       Returns: The mixed word.
+*******************************************************************************/
+
+uint64_t reuseMix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*******************************************************************************
+*      Function: reuseHash()
+*   Description: Hashes a window of symbols.
+*    Parameters: const char *window - REUSE_WINDOW symbols.
+*                uint64_t seed - The hash seed.
+* Preconditions: None.
+*       Returns: The hash.
+*******************************************************************************/
+
+uint64_t reuseHash(const char *window, uint64_t seed) {
+    uint64_t h = seed;
+    uint64_t w;
+    int i;
+
+    for (i = 0; i < REUSE_WINDOW; i += sizeof(w)) {
+        memcpy(&w, &window[i], sizeof(w));
+        h = reuseMix(h ^ w);
+    }
+    return h;
+}
+
+/*******************************************************************************
+*      Function: reuseRecord()
+*   Description: Looks a key window up in the index, adding it if absent.
+*    Parameters: uint64_t fingerprint - The key window's hash.
+*                uint64_t tag - The text window's hash.
+* Preconditions: The index is mapped.
+*       Returns: 1 if the window was seen with different text, 0 otherwise.
+*******************************************************************************/
+
+int reuseRecord(uint64_t fingerprint, uint64_t tag) {
+    uint64_t tagMask = (1ULL << REUSE_TAG_BITS) - 1;
+    uint64_t *bucket;
+    uint64_t entry, slot;
+    int i;
+
+    bucket = &reuseSlots[((fingerprint >> REUSE_TAG_BITS) & reuseMask) *
+                         REUSE_BUCKET_SLOTS];
+    entry = (fingerprint & ~tagMask) | (tag & tagMask);
+    if (!(entry & ~tagMask)) {
+        entry |= tagMask + 1;
+    }
+
+    for (i = 0; i < REUSE_BUCKET_SLOTS; i++) {
+        slot = __atomic_load_n(&bucket[i], __ATOMIC_RELAXED);
+        if (!slot) {
+            /* Claim the empty slot, or compare against whoever did */
+            if (__atomic_compare_exchange_n(&bucket[i], &slot, entry, 0,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                return 0;
+            }
+        }
+        if ((slot & ~tagMask) == (entry & ~tagMask)) {
+            return (slot & tagMask) != (entry & tagMask);
+        }
+    }
+    __atomic_store_n(&bucket[fingerprint % REUSE_BUCKET_SLOTS], entry,
+                     __ATOMIC_RELAXED);
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: reuseCheck()
+*   Description: Checks a segment's sampled key windows against the index and
+*                adds them to it.
+*    Parameters: const char *text - The text segment.
+*                const char *key - The key segment.
+*                int len - The segment length in symbols.
+*                uint64_t offset - The pad position of the segment's first
+*                                  symbol.
+*                int packed - Nonzero if both segments are packed.
+* Preconditions: Both segments hold len symbols.
+*       Returns: -1 if reused material is rejected, 0 otherwise.
+*******************************************************************************/
+
+int reuseCheck(const char *text, const char *key, int len, uint64_t offset,
+               int packed) {
+    char keyWindow[2 * REUSE_WINDOW], textWindow[2 * REUSE_WINDOW];
+    const char *keyPtr, *textPtr;
+    uint64_t pos;
+    int i, skip, hits = 0;
+
+    if (!reuseSlots) {
+        return 0;
+    }
+
+    /* Visit the sampled pad positions whose window lies in the segment */
+    pos = (offset + REUSE_STRIDE - 1) / REUSE_STRIDE * REUSE_STRIDE;
+    for (; pos + REUSE_WINDOW <= offset + len; pos += REUSE_STRIDE) {
+        i = (int)(pos - offset);
+        keyPtr = &key[i];
+        textPtr = &text[i];
+        if (packed) {
+            /* Unpack from the group holding the window's first symbol */
+            skip = i % PACK_GROUP_SYMBOLS;
+            i = i / PACK_GROUP_SYMBOLS * PACK_GROUP_BYTES;
+            if (unpackSymbols((const unsigned char *)&key[i],
+                              skip + REUSE_WINDOW, keyWindow) < 0 ||
+                unpackSymbols((const unsigned char *)&text[i],
+                              skip + REUSE_WINDOW, textWindow) < 0) {
+                continue;
+            }
+            keyPtr = &keyWindow[skip];
+            textPtr = &textWindow[skip];
+        }
+        hits += reuseRecord(reuseHash(keyPtr, 0), reuseHash(textPtr, 1));
+    }
+
+    if (!hits) {
+        return 0;
+    }
+    STATS_ADD(padReuse, hits);
+    fprintf(stderr, "reuseCheck: Pad material at offset %llu was used before\n",
+            (unsigned long long)offset);
+    return reusePolicy == REUSE_REJECT ? -1 : 0;
+}
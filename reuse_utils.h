@@ -0,0 +1,32 @@
+/*******************************************************************************
+*      Filename: reuse_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for reuse_utils.c. Please see reuse_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef REUSE_UTILS_H
+#define REUSE_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define REUSE_OFF            0     /* No reuse detection */
+#define REUSE_FLAG           1     /* Count and report reused pad material */
+#define REUSE_REJECT         2     /* Also reject the frame */
+
+#define REUSE_STRIDE      3072     /* Pad symbols between sampled windows, a
+                                    * whole number of packed groups */
+#define REUSE_WINDOW        24     /* Symbols in a sampled window */
+#define REUSE_BUCKET_SLOTS   8     /* Slots per bucket, one cache line */
+#define REUSE_TAG_BITS      16     /* Slot bits holding the text tag */
+#define REUSE_INDEX_MB_DEFAULT 16  /* The default index size in megabytes */
+
+int reuseInit(size_t, int);
+int reuseCheck(const char *, const char *, int, uint64_t, int);
+
+#endif
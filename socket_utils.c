@@ -1,13 +1,23 @@
 /*******************************************************************************
 *      Filename: socket_utils.c
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: Provides socket utilities for opening client and server sockets
 *                as well as sending and receiving messages.
 *******************************************************************************/
 
+#include "admit_utils.h"
+#include "capture_utils.h"
+#include "cipher_utils.h"
+#include "file_utils.h"
 #include "msg_utils.h"
+#include "pack_utils.h"
+#include "pad_utils.h"
+#include "pool_utils.h"
 #include "socket_utils.h"
+#include "stats_utils.h"
+#include "time_utils.h"
+#include "trace_utils.h"
 
 /*******************************************************************************
 *      Function: convertPort()
@@ -39,64 +49,211 @@ int convertPort(const char *port) {
     return val;
 }
 
+/* clientConnect() resolves each port once, for every thread of the process */
+static pthread_mutex_t clientCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static char clientCachePort[CLIENT_CACHE_PORT_MAX];
+static struct clientAddrs clientCacheAddrs;
+
 /*******************************************************************************
-*      Function: clientConnect()
-*   Description: Attempts to create a socket at the specified port.
-*    Parameters: const char *port - The port string.
+*      Function: parseProfile()
+*   Description: Parses a socket profile name.
+*    Parameters: const char *name - system, latency or throughput.
 * Preconditions: None.
-*       Returns: -1 on error, the socket file descriptor on success.
+*       Returns: The OTP_PROFILE value, -1 on an unknown name.
 *******************************************************************************/
 
-int clientConnect(const char *port) {
-    struct sockaddr_in serverAddress = {0};
-    struct hostent *he;
+int parseProfile(const char *name) {
+    if (strcmp(name, "system") == 0) {
+        return OTP_PROFILE_SYSTEM;
+    }
+    if (strcmp(name, "latency") == 0) {
+        return OTP_PROFILE_LATENCY;
+    }
+    if (strcmp(name, "throughput") == 0) {
+        return OTP_PROFILE_THROUGHPUT;
+    }
+    return -1;
+}
+
+/*******************************************************************************
+*      Function: clientResolveHost()
+*   Description: Resolves the addresses of the server on a host at the
+*                specified port, IPv6 and IPv4, in the order the system prefers
+*                them.
+*    Parameters: const char *host - The host name, or NULL for this host.
+*                const char *port - The port string.
+*                struct clientAddrs *addrs - The addresses to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int clientResolveHost(const char *host, const char *port, 
+                      struct clientAddrs *addrs) {
+    struct addrinfo hints = {0};
+    struct addrinfo *result, *ai;
     char buffer[HOST_NAME_MAX+1];
-    int portNum, sockfd;
+    int status;
 
     buffer[HOST_NAME_MAX] = '\0';
    
-    /* Convert the port string to integer */
-    portNum = convertPort(port);
-    if (portNum < 0) {
+    /* Validate the port string */
+    if (convertPort(port) < 0) {
         return -1;
     }
 
     /* Get the hostname */
-    if (gethostname(buffer, sizeof(buffer)-1) != 0) {
-        perror("clientConnect: gethostname");
+    if (!host) {
+        if (gethostname(buffer, sizeof(buffer)-1) != 0) {
+            perror("clientResolveHost: gethostname");
+            return -1;
+        }
+        host = buffer;
+    }
+
+    /* Resolve the host. Unlike gethostbyname(), getaddrinfo() is reentrant,
+     * so threads may resolve at once. */
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+    status = getaddrinfo(host, port, &hints, &result);
+    if (status != 0) {
+        fprintf(stderr, "clientResolveHost: getaddrinfo: %s\n",
+                gai_strerror(status));
         return -1;
     }
 
-    /* Inform the struct hostent */
-    he = gethostbyname(buffer);
-    if (!he) {
-        herror("clientConnect: gethostbyname");
+    /* Keep the first addresses of each family the client can use */
+    addrs->count = 0;
+    for (ai = result; ai && addrs->count < CLIENT_ADDRS_MAX; ai = ai->ai_next) {
+        if ((ai->ai_family != AF_INET && ai->ai_family != AF_INET6) ||
+            ai->ai_addrlen > sizeof(addrs->addr[0])) {
+            continue;
+        }
+        memcpy(&addrs->addr[addrs->count], ai->ai_addr, ai->ai_addrlen);
+        addrs->len[addrs->count] = ai->ai_addrlen;
+        addrs->count++;
+    }
+    freeaddrinfo(result);
+    if (addrs->count == 0) {
+        fprintf(stderr, "clientResolveHost: no address for %s\n", host);
         return -1;
-    } 
+    }
+    return 0;
+}
 
-    /* Create a TCP socket */
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd == -1) {
-        perror("clientConnect: socket");
+/*******************************************************************************
+*      Function: clientResolve()
+*   Description: Resolves the addresses of the server on this host at the 
+*                specified port.
+*    Parameters: const char *port - The port string.
+*                struct clientAddrs *addrs - The addresses to fill in.
+* Preconditions: None.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int clientResolve(const char *port, struct clientAddrs *addrs) {
+    return clientResolveHost(NULL, port, addrs);
+}
+
+/*******************************************************************************
+*      Function: clientTune()
+*   Description: Applies a socket profile to a connected socket. The latency
+*                profile sends each segment at once rather than waiting to
+*                coalesce it, and acknowledges the reply at once rather than
+*                delaying the ACK. Quick acknowledgement lapses as the
+*                connection runs, so a reused connection is tuned again.
+*    Parameters: int sockfd - The socket.
+*                int profile - The OTP_PROFILE value.
+* Preconditions: The socket is connected.
+*       Returns: None.
+*******************************************************************************/
+
+void clientTune(int sockfd, int profile) {
+    int on = 1;
+
+    if (profile != OTP_PROFILE_LATENCY) {
+        return;
+    }
+    if (setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0 ||
+        setsockopt(sockfd, IPPROTO_TCP, TCP_QUICKACK, &on, sizeof(on)) < 0) {
+        perror("clientTune: setsockopt");
+    }
+}
+
+/*******************************************************************************
+*      Function: clientConnect()
+*   Description: Attempts to connect a socket to the server on this host at the
+*                specified port. The port's addresses are resolved by the first
+*                call and reused by later ones.
+*    Parameters: const char *port - The port string.
+* Preconditions: None.
+*       Returns: -1 on error, the socket file descriptor on success.
+*******************************************************************************/
+
+int clientConnect(const char *port) {
+    struct clientAddrs addrs;
+    int cached = strlen(port) < sizeof(clientCachePort);
+
+    pthread_mutex_lock(&clientCacheLock);
+    if (cached && strcmp(clientCachePort, port) == 0) {
+        addrs = clientCacheAddrs;
+    } else if (clientResolve(port, &addrs) < 0) {
+        pthread_mutex_unlock(&clientCacheLock);
         return -1;
+    } else if (cached) {
+        strcpy(clientCachePort, port);
+        clientCacheAddrs = addrs;
     }
+    pthread_mutex_unlock(&clientCacheLock);
+
+    return clientConnectAddrs(&addrs, OTP_PROFILE_SYSTEM);
+}
+
+/*******************************************************************************
+*      Function: clientConnectAddrs()
+*   Description: Attempts to connect a socket to a server, trying each of its
+*                addresses in turn.
+*    Parameters: const struct clientAddrs *addrs - The addresses.
+*                int profile - The OTP_PROFILE value applied to the socket.
+* Preconditions: None.
+*       Returns: -1 on error, the socket file descriptor on success.
+*******************************************************************************/
 
-    /* Fill in the server information */
-    serverAddress.sin_family = AF_INET;
-    serverAddress.sin_port = htons(portNum);
+int clientConnectAddrs(const struct clientAddrs *addrs, int profile) {
+    int size = OTP_PROFILE_BUF_BYTES;
+    int i, sockfd, error = 0;
 
-    memcpy((char *)&serverAddress.sin_addr.s_addr, (char *)he->h_addr, 
-           he->h_length);
+    for (i = 0; i < addrs->count; i++) {
+        /* Create a TCP socket */
+        sockfd = socket(addrs->addr[i].ss_family, SOCK_STREAM, 0);
+        if (sockfd == -1) {
+            error = errno;
+            continue;
+        }
 
-    /* Attempt to connect the socket to the server */
-    if (connect(sockfd, (struct sockaddr *)&serverAddress, 
-                sizeof(serverAddress))) {
-        perror("clientConnect: connect");
+        /* The receive buffer must be sized before the connection's window
+         * scale is negotiated */
+        if (profile == OTP_PROFILE_THROUGHPUT &&
+            (setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &size, 
+                        sizeof(size)) < 0 ||
+             setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size,
+                        sizeof(size)) < 0)) {
+            perror("clientConnect: setsockopt");
+        }
+
+        /* Attempt to connect the socket to the server */
+        if (connect(sockfd, (const struct sockaddr *)&addrs->addr[i], 
+                    addrs->len[i]) == 0) {
+            clientTune(sockfd, profile);
+            return sockfd;
+        }
+        error = errno;
         close(sockfd);
-        return -1;
     }
 
-    return sockfd; 
+    errno = error;
+    perror("clientConnect: connect");
+    return -1; 
 }
 
 /*******************************************************************************
@@ -104,13 +261,19 @@ int clientConnect(const char *port) {
 *   Description: Creates a listening socket and binds it to the server at a 
 *                system-specified port.
 *    Parameters: const char *port - The port string.
+*                int shared - Nonzero to let other sockets bind the same port
+*                             and share its connections.
 * Preconditions: None.
 *       Returns: The socket file descriptor on succes, -1 on error.
 *******************************************************************************/
 
-int serverBind(const char *port) {
+int serverBind(const char *port, int shared) {
+    struct sockaddr_in6 serverAddress6 = {0};
     struct sockaddr_in serverAddress = {0};
+    struct sockaddr *address;
+    socklen_t addressLen;
     int portNum, sockfd;
+    int on = 1, off = 0;
 
     /* Convert the port string to integer */
     portNum = convertPort(port);
@@ -118,21 +281,52 @@ int serverBind(const char *port) {
         return -1;
     } 
    
-    /* Set the address struct */ 
-    serverAddress.sin_family = AF_INET;         /* Internet address family */
-    serverAddress.sin_port = htons(portNum);    /* The specified port */
-    serverAddress.sin_addr.s_addr = INADDR_ANY; /* All machine IPs */
+    /* Set the address structs */ 
+    serverAddress6.sin6_family = AF_INET6;        /* IPv6 address family */
+    serverAddress6.sin6_port = htons(portNum);    /* The specified port */
+    serverAddress6.sin6_addr = in6addr_any;       /* All machine IPs */
+    serverAddress.sin_family = AF_INET;           /* Internet address family */
+    serverAddress.sin_port = htons(portNum);      /* The specified port */
+    serverAddress.sin_addr.s_addr = INADDR_ANY;   /* All machine IPs */
 
-    /* Create a TCP socket */
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    /* Create a TCP socket accepting both IPv6 and IPv4 clients, or an IPv4
+     * one on hosts without IPv6 */
+    sockfd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (sockfd != -1 && setsockopt(sockfd, IPPROTO_IPV6, IPV6_V6ONLY, &off,
+                                   sizeof(off)) == 0) {
+        address = (struct sockaddr *)&serverAddress6;
+        addressLen = sizeof(serverAddress6);
+    } else {
+        if (sockfd != -1) {
+            close(sockfd);
+        }
+        sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        address = (struct sockaddr *)&serverAddress;
+        addressLen = sizeof(serverAddress);
+    }
     if (sockfd == -1) {
         perror("serverBind: socket");
         return -1;
     } 
 
+    /* A dual-stack socket, unlike an IPv4 one, cannot otherwise bind a port
+     * with connections of an earlier daemon in TIME_WAIT */
+    if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+        perror("serverBind: setsockopt");
+        close(sockfd);
+        return -1;
+    }
+
+    /* Sharded servers bind one socket per shard to the same port */
+    if (shared && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &on, 
+                             sizeof(on)) < 0) {
+        perror("serverBind: setsockopt");
+        close(sockfd);
+        return -1;
+    }
+
     /* Bind the socket */
-    if (bind(sockfd, (struct sockaddr *)&serverAddress,
-        sizeof(serverAddress))  < 0) {
+    if (bind(sockfd, address, addressLen) < 0) {
         perror("serverBind: bind");
         return -1;
     }
@@ -156,7 +350,8 @@ int sendPacket(int sockfd, char *packet, int packetLen) {
 
     /* While data remains to be sent, call send() */
     while (totalSent < packetLen) {
-        currSent = send(sockfd, &packet[totalSent], packetLen - totalSent, 0);
+        currSent = send(sockfd, &packet[totalSent], packetLen - totalSent,
+                        MSG_NOSIGNAL);
         if (currSent == -1) {
             perror("sendPacket: send");
             return -1;
@@ -201,43 +396,180 @@ int recvPacket(int sockfd, char *packet) {
     return status;
 }
 
+/*******************************************************************************
+*      Function: recvArmDeadline()
+*   Description: Limits the next receive to the time left before a deadline,
+*                so that a deadline bounds a whole packet or frame however its
+*                bytes trickle in.
+*    Parameters: int sockfd - The socket file descriptor.
+*                uint64_t deadline - The deadline in nanoseconds, 0 for none.
+* Preconditions: None.
+*       Returns: 0 on success, -1 with errno set to EAGAIN if the deadline has
+*                passed.
+*******************************************************************************/
+
+int recvArmDeadline(int sockfd, uint64_t deadline) {
+    struct timeval tv;
+    uint64_t now, left;
+
+    if (!deadline) {
+        return 0;
+    }
+    now = timeNowNs();
+    if (now >= deadline) {
+        errno = EAGAIN;
+        return -1;
+    }
+    /* Round up, since a zero timeout would never expire */
+    left = (deadline - now + 999) / 1000;
+    tv.tv_sec = left / 1000000;
+    tv.tv_usec = left % 1000000;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+        perror("recvArmDeadline: setsockopt");
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: recvDelimited()
+*   Description: Receives a delimited packet directly into a buffer. Only the
+*                last byte received is checked for a final delimiter, since the
+*                segments never contain one.
+*    Parameters: int sockfd - The socket file descriptor.
+*                char *buf - The destination buffer.
+*                int bufLen - The buffer length.
+*                uint64_t deadline - The deadline for the whole packet in
+*                                    nanoseconds, 0 for none.
+* Preconditions: None.
+*       Returns: 0 on remote socket closure, -1 on error or if the buffer fills
+*                first, the packet length otherwise.
+*******************************************************************************/
+
+int recvDelimited(int sockfd, char *buf, int bufLen, uint64_t deadline) {
+    int total = 0;
+    int status;
+
+    while (total < bufLen) {
+        if (recvArmDeadline(sockfd, deadline) < 0) {
+            return -1;
+        }
+        status = recv(sockfd, &buf[total], bufLen - total, 0);
+        if (status == 0) {
+            return 0;
+        }
+        if (status == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += status;
+        if (buf[total - 1] == OTP_CONT_DELIM || 
+            buf[total - 1] == OTP_END_DELIM) {
+            return total;
+        }
+    }
+    return -1;
+}
+
+/*******************************************************************************
+*      Function: recvAll()
+*   Description: Receives exactly the requested number of bytes.
+*    Parameters: int sockfd - The socket file descriptor.
+*                char *buf - The destination buffer.
+*                int len - The number of bytes to receive.
+*                uint64_t deadline - The deadline for all of them in 
+*                                    nanoseconds, 0 for none.
+* Preconditions: The buffer holds at least len bytes.
+*       Returns: 0 on remote socket closure, -1 on error, len otherwise.
+*******************************************************************************/
+
+int recvAll(int sockfd, char *buf, int len, uint64_t deadline) {
+    int total = 0;
+    int status;
+
+    while (total < len) {
+        if (recvArmDeadline(sockfd, deadline) < 0) {
+            return -1;
+        }
+        status = recv(sockfd, &buf[total], len - total, 0);
+        if (status == 0) {
+            return 0;
+        }
+        if (status == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        total += status;
+    }
+    return total;
+}
+
 /*******************************************************************************
 *      Function: clientProcessMessage()
 *   Description: Sends an entire message to the server, packet by packet.
 *    Parameters: int sockfd - The socket file descriptor.
 *                FILE *ptextPtr - The text file pointer.
-*                FILE *keyPtr - The key file pointer.
+*                struct otpPad *keyPad - The key pad.
 *                int ptextLen - The text length.
 *                int mode - The cipher mode. 
+*                FILE *outPtr - The stream the processed text is written to.
 * Preconditions: The file pointers have been validated, the socket is connected,
 *                the mode is accurate, and the text length is accurate.
-*       Returns: 0 on success, -1 on error.
+*       Returns: 0 on success, OTP_BUSY if the daemon was busy, -1 on error.
 *******************************************************************************/
 
-int clientProcessMessage(int sockfd, FILE *ptextPtr, FILE *keyPtr, 
-                         int ptextLen, int mode) {
+int clientProcessMessage(int sockfd, FILE *ptextPtr, struct otpPad *keyPad, 
+                         int ptextLen, int mode, FILE *outPtr) {
     char packet[OTP_PAYLOAD_MAX+1];
+    struct otpFrameHeader header;
+    uint64_t traceStart;
     int totalSent = 0;
-    int cur, status;
+    int cur, status, sendStatus;
+    char first;
     /* While text remains to be sent... */
     while (totalSent < ptextLen) {
         /* Form a packet */
-        cur = formPacket(ptextPtr, keyPtr, ptextLen - totalSent, packet,
+        traceStart = traceBegin();
+        cur = formPacket(ptextPtr, keyPad, ptextLen - totalSent, packet,
                          OTP_PAYLOAD_MAX, mode); 
+        traceEnd("formPacket", traceStart);
         if (cur < 0) {
             return -1;
         }
 
-        /* Send the packet */
-        status = sendPacket(sockfd, packet, segmentToPacketLen(cur));
-        if (status < 0) {
+        /* Send the packet. A busy daemon may close the connection before
+         * the packet is sent, but its busy frame can still be received. */
+        traceStart = traceBegin();
+        sendStatus = sendPacket(sockfd, packet, segmentToPacketLen(cur));
+        traceEnd("send", traceStart);
+        totalSent += cur; 
+
+        /* Peek at the first byte of the response. A busy frame starts with
+         * the frame magic, which never starts a packet, and is received as a
+         * binary header rather than as text. */
+        traceStart = traceBegin();
+        do {
+            status = recv(sockfd, &first, 1, MSG_PEEK);
+        } while (status < 0 && errno == EINTR);
+        if (status > 0 && first == OTP_FRAME_MAGIC) {
+            status = recvAll(sockfd, packet, OTP_FRAME_HEADER_BYTES, 0);
+            traceEnd("response_wait", traceStart);
+            if (status > 0 && frameHeaderUnpack(packet, &header) == 0 &&
+                (header.flags & OTP_FRAME_BUSY)) {
+                return OTP_BUSY;
+            }
             return -1;
         }
-        totalSent += cur; 
 
         /* Receive the server response */
-        status = recvPacket(sockfd, packet);
-        if (status <= 0) {
+        if (status > 0) {
+            status = recvPacket(sockfd, packet);
+        }
+        traceEnd("response_wait", traceStart);
+        if (sendStatus < 0 || status <= 0) {
             return -1;
         }
 
@@ -247,62 +579,592 @@ int clientProcessMessage(int sockfd, FILE *ptextPtr, FILE *keyPtr,
             return -1;
         }
         /* Output the response */
-        printf("%s", packet);
-        fflush(stdout); 
+        fprintf(outPtr, "%s", packet);
+        fflush(outPtr); 
     }   
-    printf("\n");
+    fprintf(outPtr, "\n");
  
     return 0;
 }
 
 /*******************************************************************************
-*      Function: serverProcessMessage()
-*   Description: Processes all client packets for a single message.
-*    Parameters: int inboundfd - The socket file descriptor.
-*                int mode - The cipher mode.
-* Preconditions: The socket is connected and the cipher mode is accurate.
-*       Returns: -1 on error, 0 on success.
+*      Function: clientExchangeFrame()
+*   Description: Sends a formed binary header frame and receives the reply,
+*                checking that it acknowledges the frame. The processed segment
+*                is left, unpacked, at the start of the frame buffer.
+*    Parameters: int sockfd - The socket file descriptor.
+*                char *frame - The frame buffer.
+*                int frameLen - The frame buffer length.
+*                const struct otpFrameHeader *sent - The header of the frame.
+* Preconditions: The socket is connected and the frame has been formed.
+*       Returns: 0 on success, OTP_BUSY if the daemon was busy, -1 on error.
 *******************************************************************************/
 
-int serverProcessMessage(int inboundfd, int mode) {
-    char packet[OTP_PAYLOAD_MAX+1];
-    char text[(OTP_PAYLOAD_MAX/2)+1];  
-    char key[(OTP_PAYLOAD_MAX/2)+1];  
-    int status;
-    int continuation = 1;
+int clientExchangeFrame(int sockfd, char *frame, int frameLen,
+                        const struct otpFrameHeader *sent) {
+    struct otpFrameHeader header;
+    int replyLen = frameSegmentBytes(sent->len, sent->flags);
+    char *reply = &frame[frameLen - replyLen];
+    uint64_t traceStart;
+    int status, sendStatus;
 
-    /* While the packet continuation delimiter is set... */ 
-    while (continuation) {
-        memset(packet, '\0', sizeof(packet));
-        memset(text, '\0', sizeof(text));
-        memset(key, '\0', sizeof(key));
-   
-        /* Receive a packet */
-        status = recvPacket(inboundfd, packet);
-        if (status <= 0) {
+    /* A busy daemon may close the connection before the frame is sent, but
+     * its busy frame can still be received */
+    traceStart = traceBegin();
+    sendStatus = sendPacket(sockfd, frame, segmentToFrameLen(sent->len, 
+                                                             sent->flags));
+    traceEnd("send", traceStart);
+
+    /* Receive the reply header and the processed segment. A packed segment
+     * lands at the end of the buffer so that it can be unpacked to the 
+     * front. */
+    traceStart = traceBegin();
+    status = recvAll(sockfd, frame, OTP_FRAME_HEADER_BYTES, 0);
+    if (status > 0 && frameHeaderUnpack(frame, &header) < 0) {
+        status = -1;
+    }
+    if (status > 0 && (header.flags & OTP_FRAME_BUSY)) {
+        traceEnd("response_wait", traceStart);
+        return OTP_BUSY;
+    }
+    if (sendStatus < 0) {
+        status = -1;
+    }
+    if (status > 0 && (header.len != sent->len || header.seq != sent->seq ||
+                       header.offset != sent->offset || 
+                       (header.flags & OTP_FRAME_PACKED) != 
+                       (sent->flags & OTP_FRAME_PACKED))) {
+        fprintf(stderr, "clientExchangeFrame: Unexpected reply\n");
+        status = -1;
+    }
+    if (status > 0 && replyLen > 0) {
+        status = recvAll(sockfd, reply, replyLen, 0);
+    }
+    traceEnd("response_wait", traceStart);
+    if (status <= 0) {
+        return -1;
+    }
+    if (sent->flags & OTP_FRAME_PACKED) {
+        if (frameUnpackSymbols((unsigned char *)reply, sent->len, frame) < 0) {
+            fprintf(stderr, "clientExchangeFrame: Invalid reply\n");
             return -1;
         }
+    } else {
+        memmove(frame, reply, sent->len);
+    }
+    return 0;
+}
 
-        /* Extract the text and key segments. Determine the continuation
-         * state */
-        continuation = extractPacket(packet, sizeof(packet), text, sizeof(text), 
-                                 key, sizeof(key), mode);
-        if (continuation < 0) {
-            return -1;
+/*******************************************************************************
+*      Function: clientProcessFrames()
+*   Description: Sends an entire message to the server as binary header frames,
+*                writing each processed segment to the output stream.
+*    Parameters: int sockfd - The socket file descriptor.
+*                FILE *ptextPtr - The text file pointer.
+*                struct otpPad *keyPad - The key pad.
+*                int ptextLen - The text length.
+*                int mode - The cipher mode.
+*                int cipher - The cipher applied by the server.
+*                int flags - OTP_FRAME_PACKED for packed text cipher segments,
+*                            OTP_FRAME_KEEPALIVE to keep the connection open.
+*                int segmentMax - The longest segment to send.
+*                FILE *outPtr - The stream the processed text is written to.
+*                struct otpCheckpoint *ckpt - The checkpoint to start from and
+*                                             update as segments are written,
+*                                             or NULL.
+* Preconditions: The file pointers have been validated, the socket is connected,
+*                and the text length is accurate. With a checkpoint, the files
+*                are positioned at its offset.
+*       Returns: 0 on success, OTP_BUSY if the daemon was busy, -1 on error.
+*******************************************************************************/
+
+int clientProcessFrames(int sockfd, FILE *ptextPtr, struct otpPad *keyPad, 
+                        int ptextLen, int mode, int cipher, int flags, 
+                        int segmentMax, FILE *outPtr, 
+                        struct otpCheckpoint *ckpt) {
+    struct otpFrameHeader sent = {0};
+    int frameLen = segmentToFrameLen(segmentMax, flags);
+    char *frame;
+    uint64_t traceStart;
+    int totalSent = ckpt ? (int)ckpt->offset : 0;
+    int cur, status = 0;
+
+    frame = malloc(frameLen);
+    if (!frame) {
+        perror("clientProcessFrames: malloc");
+        return -1;
+    }
+
+    sent.mode = mode;
+    sent.cipher = cipher;
+    sent.seq = ckpt ? ckpt->seq : 0;
+    while (totalSent < ptextLen) {
+        /* Form a frame */
+        traceStart = traceBegin();
+        sent.flags = flags;
+        sent.offset = totalSent;
+        cur = formFrame(ptextPtr, keyPad, ptextLen - totalSent, frame, 
+                        frameLen, &sent);
+        traceEnd("formFrame", traceStart);
+        if (cur < 0) {
+            status = -1;
+            break;
         }
 
-        /* Produce the ciphertext */
-        status = processMessage(text, key, mode);
+        /* Send the frame and receive the processed segment */
+        status = clientExchangeFrame(sockfd, frame, frameLen, &sent);
         if (status < 0) {
-            return -1;
+            break;
+        }
+        totalSent += cur;
+
+        /* Output the processed segment */
+        if (fwrite(frame, 1, cur, outPtr) != (size_t)cur) {
+            perror("clientProcessFrames: fwrite");
+            status = -1;
+            break;
         }
+        status = 0;
+        sent.seq++;
+
+        /* The checkpoint only moves past output that has been flushed */
+        if (ckpt) {
+            if (fflush(outPtr) == EOF) {
+                perror("clientProcessFrames: fflush");
+                status = -1;
+                break;
+            }
+            ckpt->seq = sent.seq;
+            ckpt->offset = totalSent;
+            if (checkpointSave(ckpt) < 0) {
+                status = -1;
+                break;
+            }
+        }
+    }
+    /* Text output ends with a newline, as in the delimited packet format */
+    if (status == 0 && cipher != OTP_CIPHER_XOR) {
+        fprintf(outPtr, "\n");
+    }
+    fflush(outPtr);
 
-        /* Send the ciphertext back to the client */
-        status = sendPacket(inboundfd, text, strlen(text));
+    free(frame);
+    return status;
+}
+
+/*******************************************************************************
+*      Function: clientProcessStream()
+*   Description: Sends text of unknown length, such as a pipe, to the server as
+*                it arrives. Each read becomes one binary header frame, whose
+*                key is read from the pad only then, and each processed segment
+*                is written and flushed before the next read. An empty final
+*                frame marks the end of the stream. Memory use does not depend
+*                on the stream length.
+*    Parameters: int sockfd - The socket file descriptor.
+*                int textfd - The text stream.
+*                struct otpPad *keyPad - The key pad.
+*                long long keySize - The number of key symbols available.
+*                int mode - The cipher mode.
+*                int cipher - The cipher applied by the server.
+*                int flags - OTP_FRAME_PACKED for packed text cipher segments.
+*                int segmentMax - The longest segment to send.
+*                FILE *outPtr - The stream the processed text is written to.
+* Preconditions: The key pad has been validated and the socket is connected.
+*       Returns: 0 on success, -1 on a connection error, -2 on invalid input or
+*                a short key, OTP_BUSY if the daemon was busy.
+*******************************************************************************/
+
+int clientProcessStream(int sockfd, int textfd, struct otpPad *keyPad, 
+                        long long keySize, int mode, int cipher, int flags,
+                        int segmentMax, FILE *outPtr) {
+    struct otpFrameHeader sent = {0};
+    int frameLen = segmentToFrameLen(segmentMax, flags);
+    int chunkLen = (frameLen - OTP_FRAME_HEADER_BYTES) / 2;
+    char *frame, *text, *key;
+    long long total = 0;
+    int newlineFound = 0;
+    int n, len, status = 0;
+
+    frame = malloc(frameLen);
+    if (!frame) {
+        perror("clientProcessStream: malloc");
+        return -1;
+    }
+    text = &frame[OTP_FRAME_HEADER_BYTES];
+    sent.mode = mode;
+    sent.cipher = cipher;
+
+    while (1) {
+        /* Take whatever the stream holds, up to one segment */
+        n = read(textfd, text, chunkLen);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("clientProcessStream: read");
+            status = -2;
+            break;
+        }
+        len = n;
+        if (cipher != OTP_CIPHER_XOR) {
+            len = validateChunk(text, n, &newlineFound,
+                                alphabetByCipher(cipher));
+            if (len < 0) {
+                status = -2;
+                break;
+            }
+        }
+        /* Nothing to send until the next read, unless the stream ended */
+        if (n > 0 && len == 0) {
+            continue;
+        }
+        if (total + len > keySize) {
+            fprintf(stderr, "Error: key is too short\n");
+            status = -2;
+            break;
+        }
+
+        /* Pack the text in place, then read its key behind it */
+        key = &text[frameSegmentBytes(len, flags)];
+        if (flags & OTP_FRAME_PACKED) {
+            framePackSymbols(text, len, (unsigned char *)text);
+        }
+        if (padRead(keyPad, key, len) < 0) {
+            status = -2;
+            break;
+        }
+        if (flags & OTP_FRAME_PACKED) {
+            framePackSymbols(key, len, (unsigned char *)key);
+        }
+        sent.flags = (flags & OTP_FRAME_PACKED) | (n > 0 ? OTP_FRAME_CONT : 0);
+        sent.len = len;
+        sent.offset = total;
+        frameHeaderPack(&sent, frame);
+
+        status = clientExchangeFrame(sockfd, frame, frameLen, &sent);
         if (status < 0) {
+            break;
+        }
+        if (fwrite(frame, 1, len, outPtr) != (size_t)len || 
+            fflush(outPtr) == EOF) {
+            perror("clientProcessStream: fwrite");
+            status = -2;
+            break;
+        }
+        total += len;
+        sent.seq++;
+        if (n == 0) {
+            break;
+        }
+    }
+    /* Text output ends with a newline, as in the delimited packet format */
+    if (status == 0 && cipher != OTP_CIPHER_XOR) {
+        fprintf(outPtr, "\n");
+    }
+    fflush(outPtr);
+
+    free(frame);
+    return status;
+}
+
+/*******************************************************************************
+*      Function: serverCountFailure()
+*   Description: Counts a failed receive or send, as a deadline expiring if the
+*                socket timed out and as an error otherwise.
+*    Parameters: int status - The failed call's result.
+*                int error - The STATS_ERR type of an error.
+*                int timeout - The STATS_TIMEOUT type of a deadline.
+* Preconditions: errno is that of the failed call if the status is negative.
+*       Returns: None.
+*******************************************************************************/
+
+void serverCountFailure(int status, int error, int timeout) {
+    if (status < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        STATS_ADD(timeouts[timeout], 1);
+    } else {
+        STATS_ADD(errors[error], 1);
+    }
+}
+
+/*******************************************************************************
+*      Function: serverProcessPacket()
+*   Description: Receives, processes and answers a single delimited packet. The
+*                packet is processed in place and the reply is sent straight
+*                from the receive buffer.
+*    Parameters: int inboundfd - The socket file descriptor.
+*                int mode - The cipher mode.
+*                char *packet - A buffer of OTP_PAYLOAD_MAX bytes.
+*                uint64_t *offset - The pad position of the packet's segment.
+*                uint64_t capture - The connection's capture number, 0 if it
+*                                   is not recorded.
+*                uint64_t deadline - The read deadline in nanoseconds, 0 for
+*                                    none.
+* Preconditions: The socket is connected and the cipher mode is accurate.
+*       Returns: 1 if more packets follow, 0 after the final packet, -1 on
+*                error.
+*******************************************************************************/
+
+int serverProcessPacket(int inboundfd, int mode, char *packet, 
+                        uint64_t *offset, uint64_t capture, 
+                        uint64_t deadline) {
+    uint64_t frameStart, cipherStart, traceStart;
+    int status, packetLen, replyLen, continuation;
+
+    /* Receive a packet */
+    traceStart = traceBegin();
+    packetLen = recvDelimited(inboundfd, packet, OTP_PAYLOAD_MAX, deadline);
+    traceEnd("recvPacket", traceStart);
+    if (packetLen <= 0) {
+        serverCountFailure(packetLen, STATS_ERR_RECV, STATS_TIMEOUT_READ);
+        return -1;
+    }
+    frameStart = timeNowNs();
+    STATS_ADD(framesIn, 1);
+    STATS_ADD(bytesIn, packetLen);
+    captureMessage(capture, frameStart, packet, packetLen);
+
+    /* Produce the ciphertext over the text segment */
+    cipherStart = timeNowNs();
+    traceStart = traceBegin();
+    continuation = processPacket(packet, packetLen, mode, &replyLen, offset);
+    traceEnd("processPacket", traceStart);
+    STATS_ADD(cipherNs, timeNowNs() - cipherStart);
+    if (continuation < 0) {
+        STATS_ADD(errors[STATS_ERR_FRAME], 1);
+        return -1;
+    }
+
+    /* Send the reply from the receive buffer */
+    traceStart = traceBegin();
+    status = sendPacket(inboundfd, &packet[OTP_HEADER_BYTES], replyLen);
+    traceEnd("sendPacket", traceStart);
+    if (status < 0) {
+        serverCountFailure(status, STATS_ERR_SEND, STATS_TIMEOUT_WRITE);
+        return -1;
+    } 
+    STATS_ADD(framesOut, 1);
+    STATS_ADD(bytesOut, replyLen);
+    STATS_RECORD(frameLatency, timeNowNs() - frameStart);
+
+    return continuation;
+}
+
+/*******************************************************************************
+*      Function: serverProcessFrame()
+*   Description: Receives, processes and answers a single binary header frame.
+*                The segment is processed in place and the reply header is
+*                written over the request header, so the reply is sent
+*                straight from the receive buffer. Packed segments stay packed
+*                throughout.
+*    Parameters: int inboundfd - The socket file descriptor.
+*                int mode - The cipher mode.
+*                char **bufPtr - The pool buffer, replaced by a larger one if
+*                                the frame does not fit.
+*                struct otpFrameCursor *cursor - The connection's frame cursor.
+*                uint64_t capture - The connection's capture number, 0 if it
+*                                   is not recorded.
+*                uint64_t deadline - The read deadline in nanoseconds, 0 for
+*                                    none.
+* Preconditions: The socket is connected and the cipher mode is accurate.
+*       Returns: 1 if more frames follow, 0 after the final frame, -1 on error.
+*                More frames may follow the final frame of a kept-alive
+*                message.
+*******************************************************************************/
+
+int serverProcessFrame(int inboundfd, int mode, char **bufPtr, 
+                       struct otpFrameCursor *cursor, uint64_t capture,
+                       uint64_t deadline) {
+    struct otpFrameHeader header;
+    char *frame = *bufPtr;
+    char *text;
+    uint64_t frameStart, cipherStart, traceStart;
+    int status, continuation, frameLen, segmentBytes = 0;
+
+    /* Receive the header and both segments */
+    traceStart = traceBegin();
+    status = recvAll(inboundfd, frame, OTP_FRAME_HEADER_BYTES, deadline);
+    if (status > 0) {
+        if (frameHeaderUnpack(frame, &header) < 0 || header.mode != mode ||
+            frameCursorAdvance(cursor, &header) < 0) {
+            STATS_ADD(errors[STATS_ERR_FRAME], 1);
             return -1;
-        } 
+        }
+        segmentBytes = frameSegmentBytes(header.len, header.flags);
+        frameLen = segmentToFrameLen(header.len, header.flags);
+        /* Only a connection's own buffers count against a forked child's 
+         * budget, so a larger buffer is always available */
+        if (frameLen > poolBufSize(frame)) {
+            frame = poolAlloc(frameLen);
+            if (!frame) {
+                STATS_ADD(errors[STATS_ERR_RECV], 1);
+                return -1;
+            }
+            memcpy(frame, *bufPtr, OTP_FRAME_HEADER_BYTES);
+            poolFree(*bufPtr);
+            *bufPtr = frame;
+        }
+        /* A stream may end with an empty frame */
+        if (segmentBytes > 0) {
+            status = recvAll(inboundfd, &frame[OTP_FRAME_HEADER_BYTES], 
+                             segmentBytes * 2, deadline);
+        }
     }
+    traceEnd("recvFrame", traceStart);
+    if (status <= 0) {
+        serverCountFailure(status, STATS_ERR_RECV, STATS_TIMEOUT_READ);
+        return -1;
+    }
+    frameStart = timeNowNs();
+    STATS_ADD(framesIn, 1);
+    STATS_ADD(bytesIn, frameLen);
+    captureMessage(capture, frameStart, frame, frameLen);
+    text = &frame[OTP_FRAME_HEADER_BYTES];
 
-    return 0;
+    /* Apply the cipher in place */
+    cipherStart = timeNowNs();
+    traceStart = traceBegin();
+    status = processFrame(text, &header);
+    traceEnd("cipherFrame", traceStart);
+    STATS_ADD(cipherNs, timeNowNs() - cipherStart);
+    if (status < 0) {
+        STATS_ADD(errors[STATS_ERR_CIPHER], 1);
+        return -1;
+    }
+
+    /* Reply with the same header, less the continuation flag. The echoed
+     * sequence number and offset acknowledge the segment. A kept-alive
+     * connection goes on to its next message. */
+    continuation = header.flags & (OTP_FRAME_CONT | OTP_FRAME_KEEPALIVE) ? 
+                   1 : 0;
+    header.flags &= ~OTP_FRAME_CONT;
+    frameHeaderPack(&header, frame);
+    traceStart = traceBegin();
+    status = sendPacket(inboundfd, frame,
+                        OTP_FRAME_HEADER_BYTES + segmentBytes);
+    traceEnd("sendFrame", traceStart);
+    if (status < 0) {
+        serverCountFailure(status, STATS_ERR_SEND, STATS_TIMEOUT_WRITE);
+        return -1;
+    }
+    STATS_ADD(framesOut, 1);
+    STATS_ADD(bytesOut, OTP_FRAME_HEADER_BYTES + segmentBytes);
+    STATS_RECORD(frameLatency, timeNowNs() - frameStart);
+
+    return continuation;
+}
+
+/*******************************************************************************
+*      Function: serverSetTimeout()
+*   Description: Sets a socket's receive or send timeout.
+*    Parameters: int sockfd - The socket file descriptor.
+*                int option - SO_RCVTIMEO or SO_SNDTIMEO.
+*                int ms - The timeout in milliseconds, 0 for none.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void serverSetTimeout(int sockfd, int option, int ms) {
+    struct timeval tv;
+
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    if (setsockopt(sockfd, SOL_SOCKET, option, &tv, sizeof(tv)) < 0) {
+        perror("serverSetTimeout: setsockopt");
+    }
+}
+
+/*******************************************************************************
+*      Function: serverProcessMessage()
+*   Description: Processes all client packets for a single message. The first
+*                byte of each packet selects between the delimited packet format
+*                and the binary header frame format. Packets are received into a
+*                pool buffer, which grows to fit larger frames. The socket
+*                timeouts enforce the deadlines: the idle deadline while waiting
+*                for a packet or frame to begin, the read deadline from its
+*                first byte to its last, with each receive limited to the time
+*                left, and the write deadline for each send. A
+*                forked child serves a single connection, so it needs no timer
+*                wheel. A kept-alive connection is served until the client
+*                closes it between messages. It gives back its admission slot
+*                at the end of each message, and takes one again when the next
+*                message begins, waiting up to queueMs before the client is
+*                turned away busy.
+*    Parameters: int inboundfd - The socket file descriptor.
+*                int mode - The cipher mode.
+*                const struct otpTimeouts *timeouts - The deadlines.
+*                int queueMs - How long a kept-alive connection may wait for a
+*                              slot.
+*                int *slot - The connection's admission slot, set to
+*                            ADMIT_FULL while it holds none.
+* Preconditions: The socket is connected and the cipher mode is accurate. The
+*                slot is assigned to this process.
+*       Returns: -1 on error, 0 on success.
+*******************************************************************************/
+
+int serverProcessMessage(int inboundfd, int mode,
+                         const struct otpTimeouts *timeouts, int queueMs,
+                         int *slot) {
+    struct otpFrameCursor cursor = {0};
+    uint64_t packetOffset = 0;
+    uint64_t capture = captureConnection();
+    uint64_t deadline;
+    uint32_t kept;
+    char *buf;
+    char first;
+    int status, continuation = 1;
+
+    buf = poolAlloc(OTP_PAYLOAD_MAX);
+    if (!buf) {
+        fprintf(stderr, "serverProcessMessage: Buffer pool exhausted\n");
+        return -1;
+    }
+
+    serverSetTimeout(inboundfd, SO_SNDTIMEO, timeouts->writeMs);
+
+    /* While the packet continuation delimiter is set... */ 
+    while (continuation > 0) {
+        /* Peek at the first byte without consuming it */
+        serverSetTimeout(inboundfd, SO_RCVTIMEO, timeouts->idleMs);
+        status = recv(inboundfd, &first, 1, MSG_PEEK);
+        if (status == 0 && cursor.kept && !cursor.started) {
+            continuation = 0;
+            break;
+        }
+        if (status <= 0) {
+            serverCountFailure(status, STATS_ERR_RECV, STATS_TIMEOUT_IDLE);
+            continuation = -1;
+            break;
+        }
+        if (*slot == ADMIT_FULL) {
+            *slot = admitWait(queueMs);
+            if (*slot == ADMIT_FULL) {
+                admitBusy(inboundfd, mode);
+                continuation = 0;
+                break;
+            }
+            admitAssign(*slot, getpid());
+        }
+        deadline = timeouts->readMs ? 
+                   timeNowNs() + timeouts->readMs * TIME_NS_PER_MS : 0;
+        if (!deadline) {
+            serverSetTimeout(inboundfd, SO_RCVTIMEO, 0);
+        }
+
+        if (first != OTP_FRAME_MAGIC) {
+            continuation = serverProcessPacket(inboundfd, mode, buf, 
+                                               &packetOffset, capture,
+                                               deadline);
+        } else {
+            kept = cursor.kept;
+            continuation = serverProcessFrame(inboundfd, mode, &buf, 
+                                              &cursor, capture, deadline);
+            if (continuation > 0 && cursor.kept != kept) {
+                admitRelease(*slot, getpid());
+                *slot = ADMIT_FULL;
+            }
+        }
+    }
+
+    poolFree(buf);
+    return continuation < 0 ? -1 : 0;
 }
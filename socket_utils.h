@@ -1,7 +1,7 @@
 /*******************************************************************************
 *      Filename: socket_utils.h
 *        Author: Maxwell Goldberg
-* Last Modified: 03.17.17
+* Last Modified: 10.19.26
 *   Description: The header file for socket_utils.c. Please see socket_utils.c 
 *                for more details.
 *******************************************************************************/
@@ -13,25 +13,77 @@
 #include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #define PORT_MIN            1 /* Minimum port number */
 #define PORT_MAX        65535 /* Maximum port number */
-#define OTP_CONN_MAX        5 /* Maximum number of queued client conns */
+#define OTP_CONN_MAX SOMAXCONN /* Maximum number of queued client conns */
 
+#define OTP_READ_TIMEOUT_MS  30000 /* The default read deadline */
+#define OTP_WRITE_TIMEOUT_MS 30000 /* The default write deadline */
+#define OTP_IDLE_TIMEOUT_MS  60000 /* The default idle deadline */
+
+#define OTP_BUSY -3  /* The daemon turned the connection away at capacity */
+
+#define CLIENT_ADDRS_MAX        8  /* Addresses kept for an endpoint */
+#define CLIENT_CACHE_PORT_MAX  16  /* The longest port string cached */
+
+#define OTP_PROFILE_SYSTEM      0  /* The system's socket settings */
+#define OTP_PROFILE_LATENCY     1  /* Small segments sent and acknowledged at
+                                    * once */
+#define OTP_PROFILE_THROUGHPUT  2  /* Large socket buffers */
+#define OTP_PROFILE_BUF_BYTES (4 << 20) /* The throughput profile's socket
+                                         * buffer size */
+
+/* The resolved addresses of an endpoint, in the order they are tried */
+struct clientAddrs {
+    int count;                                  /* The number of addresses */
+    socklen_t len[CLIENT_ADDRS_MAX];            /* Each address's length */
+    struct sockaddr_storage addr[CLIENT_ADDRS_MAX]; /* The addresses */
+};
+
+/* The deadlines of a daemon connection in milliseconds, 0 if disabled */
+struct otpTimeouts {
+    int readMs;             /* Receiving a packet or frame once it began */
+    int writeMs;            /* Sending a reply */
+    int idleMs;             /* Waiting for the next packet or frame */
+};
+
+int convertPort(const char *);
+int parseProfile(const char *);
+int clientResolveHost(const char *, const char *, struct clientAddrs *);
+int clientResolve(const char *, struct clientAddrs *);
+void clientTune(int, int);
 int clientConnect(const char *);
-int clientProcessMessage(int, FILE *, FILE *, int, int);
+int clientConnectAddrs(const struct clientAddrs *, int);
+struct otpPad;
+struct otpCheckpoint;
+struct otpFrameHeader;
+
+int clientProcessMessage(int, FILE *, struct otpPad *, int, int, FILE *);
+int clientExchangeFrame(int, char *, int, const struct otpFrameHeader *);
+int clientProcessFrames(int, FILE *, struct otpPad *, int, int, int, int, int,
+                        FILE *, struct otpCheckpoint *);
+int clientProcessStream(int, int, struct otpPad *, long long, int, int, int,
+                        int, FILE *);
 
-int serverBind(const char *);
-int serverProcessMessage(int, int);
+int serverBind(const char *, int);
+int serverProcessMessage(int, int, const struct otpTimeouts *, int, int *);
 
 int sendPacket(int, char *, int);
 int recvPacket(int, char *);  
+int recvArmDeadline(int, uint64_t);
+int recvDelimited(int, char *, int, uint64_t);
+int recvAll(int, char *, int, uint64_t);
 
 
 #endif
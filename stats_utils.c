@@ -0,0 +1,354 @@
+/*******************************************************************************
+*      Filename: stats_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Provides daemon counters and latency histograms kept in memory
+*                shared by the listening process and its forked children, and a
+*                local endpoint that exposes them in the Prometheus text format.
+*                The endpoint is served by a thread of its own, so a slow or
+*                silent scraper never holds up the daemon's connections.
+*******************************************************************************/
+
+#include "msg_utils.h"
+#include "socket_utils.h"
+#include "stats_utils.h"
+
+struct otpStats *otpStats = NULL;
+
+/* Names of the error types, indexed by the STATS_ERR constants */
+static const char *statsErrNames[STATS_ERR_COUNT] = {
+    "accept", "fork", "recv", "frame", "cipher", "send"
+};
+
+/* Names of the deadline types, indexed by the STATS_TIMEOUT constants */
+static const char *statsTimeoutNames[STATS_TIMEOUT_COUNT] = {
+    "read", "write", "idle"
+};
+
+/* Names of the connection classes, indexed by the STATS_CLASS constants */
+static const char *statsClassNames[STATS_CLASS_COUNT] = {
+    "interactive", "bulk"
+};
+
+/*******************************************************************************
+*      Function: statsInit()
+*   Description: Maps the shared stats region.
+*    Parameters: None.
+* Preconditions: No child process has been forked yet.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int statsInit() {
+    void *region;
+
+    region = mmap(NULL, sizeof(struct otpStats), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        perror("statsInit: mmap");
+        return -1;
+    }
+    /* Anonymous mappings are zero filled */
+    otpStats = region;
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: statsBind()
+*   Description: Creates the stats listening socket on the loopback interface.
+*    Parameters: const char *port - The port string.
+* Preconditions: None.
+*       Returns: The listening socket file descriptor, -1 on error.
+*******************************************************************************/
+
+int statsBind(const char *port) {
+    struct sockaddr_in address = {0};
+    int portNum, sockfd;
+    int on = 1;
+
+    portNum = convertPort(port);
+    if (portNum < 0) {
+        return -1;
+    }
+
+    address.sin_family = AF_INET;
+    address.sin_port = htons(portNum);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd == -1) {
+        perror("statsBind: socket");
+        return -1;
+    }
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(sockfd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("statsBind: bind");
+        close(sockfd);
+        return -1;
+    }
+    if (listen(sockfd, OTP_CONN_MAX) < 0) {
+        perror("statsBind: listen");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/*******************************************************************************
+*      Function: statsLoad()
+*   Description: Reads a single counter.
+*    Parameters: uint64_t *counter - The counter.
+* Preconditions: None.
+*       Returns: The counter value.
+*******************************************************************************/
+
+unsigned long long statsLoad(uint64_t *counter) {
+    return (unsigned long long)__atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+*      Function: statsWriteCounter()
+*   Description: Writes a single labelled metric with its metadata.
+*    Parameters: FILE *out - The output stream.
+*                const char *name - The metric name.
+*                const char *type - The Prometheus metric type.
+*                const char *help - The metric description.
+*                const char *daemon - The daemon label.
+*                uint64_t *counter - The counter.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void statsWriteCounter(FILE *out, const char *name, const char *type,
+                       const char *help, const char *daemon, 
+                       uint64_t *counter) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    fprintf(out, "%s{daemon=\"%s\"} %llu\n", name, daemon, statsLoad(counter));
+}
+
+/*******************************************************************************
+*      Function: statsWriteSeries()
+*   Description: Writes the samples of one histogram series with power of two
+*                bucket boundaries in seconds.
+*    Parameters: FILE *out - The output stream.
+*                const char *name - The metric name.
+*                const char *labels - The series labels, without braces.
+*                struct hist *h - The histogram, in nanoseconds.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void statsWriteSeries(FILE *out, const char *name, const char *labels,
+                      struct hist *h) {
+    unsigned long long cumulative = 0;
+    uint64_t le;
+    int i = 0;
+    int shift;
+
+    /* Histogram buckets end exactly on each power of two, so the cumulative
+     * counts at these boundaries are exact */
+    for (shift = STATS_LE_MIN_SHIFT; shift <= STATS_LE_MAX_SHIFT; shift++) {
+        le = (1ULL << shift) - 1;
+        while (i < HIST_BUCKETS && histBucketLimit(i) <= le) {
+            cumulative += statsLoad(&h->buckets[i]);
+            i++;
+        }
+        fprintf(out, "%s_bucket{%s,le=\"%.9f\"} %llu\n", name, labels,
+                (double)(le + 1) / 1e9, cumulative);
+    }
+    fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels,
+            statsLoad(&h->count));
+    fprintf(out, "%s_sum{%s} %.9f\n", name, labels, 
+            statsLoad(&h->sum) / 1e9);
+    fprintf(out, "%s_count{%s} %llu\n", name, labels, statsLoad(&h->count));
+}
+
+/*******************************************************************************
+*      Function: statsWriteHist()
+*   Description: Writes a histogram with its metadata.
+*    Parameters: FILE *out - The output stream.
+*                const char *name - The metric name.
+*                const char *help - The metric description.
+*                const char *daemon - The daemon label.
+*                struct hist *h - The histogram, in nanoseconds.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void statsWriteHist(FILE *out, const char *name, const char *help,
+                    const char *daemon, struct hist *h) {
+    char labels[STATS_LABELS_MAX];
+
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    snprintf(labels, sizeof(labels), "daemon=\"%s\"", daemon);
+    statsWriteSeries(out, name, labels, h);
+}
+
+/*******************************************************************************
+*      Function: statsWrite()
+*   Description: Writes every metric in the Prometheus text exposition format.
+*    Parameters: FILE *out - The output stream.
+*                const char *daemon - The daemon label.
+* Preconditions: statsInit() has succeeded.
+*       Returns: None.
+*******************************************************************************/
+
+void statsWrite(FILE *out, const char *daemon) {
+    struct otpStats *s = otpStats;
+    char labels[STATS_LABELS_MAX];
+    int i;
+
+    statsWriteCounter(out, "otp_connections_accepted_total", "counter",
+                      "Connections accepted.", daemon, &s->connAccepted);
+    statsWriteCounter(out, "otp_connections_active", "gauge",
+                      "Connections currently being served.", daemon, 
+                      &s->connActive);
+    statsWriteCounter(out, "otp_connections_queued", "gauge",
+                      "Connections waiting for admission.", daemon,
+                      &s->connQueued);
+    statsWriteCounter(out, "otp_connections_rejected_total", "counter",
+                      "Connections turned away because the daemon was busy.",
+                      daemon, &s->connRejected);
+    statsWriteCounter(out, "otp_bytes_received_total", "counter",
+                      "Frame bytes received.", daemon, &s->bytesIn);
+    statsWriteCounter(out, "otp_bytes_sent_total", "counter",
+                      "Reply bytes sent.", daemon, &s->bytesOut);
+    statsWriteCounter(out, "otp_frames_received_total", "counter",
+                      "Frames received.", daemon, &s->framesIn);
+    statsWriteCounter(out, "otp_frames_sent_total", "counter",
+                      "Replies sent.", daemon, &s->framesOut);
+    fprintf(out, "# HELP otp_cipher_seconds_total Time spent in the cipher.\n"
+            "# TYPE otp_cipher_seconds_total counter\n"
+            "otp_cipher_seconds_total{daemon=\"%s\"} %.9f\n", daemon,
+            statsLoad(&s->cipherNs) / 1e9);
+    statsWriteCounter(out, "otp_pool_bytes", "gauge",
+                      "Buffer pool memory in use.", daemon, &s->poolBytes);
+    statsWriteCounter(out, "otp_read_pauses_total", "counter",
+                      "Reads paused until buffer memory was freed.", daemon,
+                      &s->readPauses);
+    statsWriteCounter(out, "otp_pad_reuse_total", "counter",
+                      "Sampled key windows seen before with different text.",
+                      daemon, &s->padReuse);
+
+    fprintf(out, "# HELP otp_errors_total Errors by type.\n"
+            "# TYPE otp_errors_total counter\n");
+    for (i = 0; i < STATS_ERR_COUNT; i++) {
+        fprintf(out, "otp_errors_total{daemon=\"%s\",type=\"%s\"} %llu\n",
+                daemon, statsErrNames[i], statsLoad(&s->errors[i]));
+    }
+    fprintf(out, "# HELP otp_timeouts_total Connections closed by a deadline, "
+            "by type.\n# TYPE otp_timeouts_total counter\n");
+    for (i = 0; i < STATS_TIMEOUT_COUNT; i++) {
+        fprintf(out, "otp_timeouts_total{daemon=\"%s\",type=\"%s\"} %llu\n",
+                daemon, statsTimeoutNames[i], statsLoad(&s->timeouts[i]));
+    }
+
+    statsWriteHist(out, "otp_frame_latency_seconds", 
+                   "Time from frame receipt to reply sent.", daemon,
+                   &s->frameLatency);
+    statsWriteHist(out, "otp_connection_duration_seconds",
+                   "Connection lifetime.", daemon, &s->connDuration);
+
+    fprintf(out, "# HELP otp_queue_wait_seconds Time a received frame waited "
+            "for the scheduler, by connection class.\n"
+            "# TYPE otp_queue_wait_seconds histogram\n");
+    for (i = 0; i < STATS_CLASS_COUNT; i++) {
+        snprintf(labels, sizeof(labels), "daemon=\"%s\",class=\"%s\"", daemon,
+                 statsClassNames[i]);
+        statsWriteSeries(out, "otp_queue_wait_seconds", labels, 
+                         &s->queueWait[i]);
+    }
+}
+
+/*******************************************************************************
+*      Function: statsServe()
+*   Description: Accepts a single scrape on the stats socket and answers it with
+*                an HTTP response carrying the current metrics.
+*    Parameters: int statsfd - The stats listening socket.
+*                const char *daemon - The daemon label.
+* Preconditions: The stats socket is readable. statsInit() has succeeded.
+*       Returns: None.
+*******************************************************************************/
+
+void statsServe(int statsfd, const char *daemon) {
+    struct timeval timeout = {0, STATS_RECV_TIMEOUT_MS * 1000};
+    struct timeval sendTimeout = {STATS_SEND_TIMEOUT_MS / 1000, 0};
+    char request[OTP_PAYLOAD_MAX];
+    FILE *out;
+    int fd;
+
+    fd = accept(statsfd, NULL, NULL);
+    if (fd < 0) {
+        if (errno != EINTR) {
+            perror("statsServe: accept");
+        }
+        return;
+    }
+    /* Consume the request, if any, without letting a silent peer stall the
+     * next scrape, and give up on a peer that does not read the reply */
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &sendTimeout, 
+               sizeof(sendTimeout));
+    recv(fd, request, sizeof(request), 0);
+
+    out = fdopen(fd, "w");
+    if (!out) {
+        perror("statsServe: fdopen");
+        close(fd);
+        return;
+    }
+    fprintf(out, "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n\r\n");
+    statsWrite(out, daemon);
+    fclose(out);
+}
+
+/*******************************************************************************
+*      Function: statsMain()
+*   Description: The stats thread body. Answers scrapes one at a time for as
+*                long as the process runs.
+*    Parameters: void *arg - The stats server.
+* Preconditions: None.
+*       Returns: Does not return.
+*******************************************************************************/
+
+void *statsMain(void *arg) {
+    struct statsServer *server = arg;
+
+    while (1) {
+        statsServe(server->fd, server->daemon);
+    }
+    return NULL;
+}
+
+/*******************************************************************************
+*      Function: statsStart()
+*   Description: Starts the thread that serves the stats socket. Signals are
+*                blocked in the thread, so that they reach the daemon loop.
+*    Parameters: int statsfd - The stats listening socket.
+*                const char *daemon - The daemon label.
+* Preconditions: statsInit() has succeeded.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int statsStart(int statsfd, const char *daemon) {
+    static struct statsServer server;
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t all, old;
+    int status;
+
+    server.fd = statsfd;
+    server.daemon = daemon;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    status = pthread_create(&thread, &attr, statsMain, &server);
+    pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (status != 0) {
+        fprintf(stderr, "statsStart: pthread_create failed\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+/*******************************************************************************
+*      Filename: stats_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for stats_utils.c. Please see stats_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef STATS_UTILS_H
+#define STATS_UTILS_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "hist_utils.h"
+
+#define STATS_ERR_ACCEPT    0  /* accept() failures */
+#define STATS_ERR_FORK      1  /* fork() failures */
+#define STATS_ERR_RECV      2  /* Receive failures and early closures */
+#define STATS_ERR_FRAME     3  /* Malformed or unexpected frames */
+#define STATS_ERR_CIPHER    4  /* Cipher failures */
+#define STATS_ERR_SEND      5  /* Send failures */
+#define STATS_ERR_COUNT     6  /* The number of error types */
+
+#define STATS_TIMEOUT_READ  0  /* A packet or frame arrived too slowly */
+#define STATS_TIMEOUT_WRITE 1  /* A reply was taken too slowly */
+#define STATS_TIMEOUT_IDLE  2  /* No packet or frame began in time */
+#define STATS_TIMEOUT_COUNT 3  /* The number of deadline types */
+
+#define STATS_CLASS_INTERACTIVE 0  /* Connections whose frames fit a quantum */
+#define STATS_CLASS_BULK        1  /* Connections that sent a larger frame */
+#define STATS_CLASS_COUNT       2  /* The number of connection classes */
+
+#define STATS_LABELS_MAX      128  /* The longest label set of a series */
+#define STATS_RECV_TIMEOUT_MS 100  /* Time allowed to read a scrape request */
+#define STATS_SEND_TIMEOUT_MS 1000 /* Time allowed to send a scrape reply */
+#define STATS_LE_MIN_SHIFT     10  /* Smallest exported bucket, 2^10 ns */
+#define STATS_LE_MAX_SHIFT     34  /* Largest exported bucket, 2^34 ns */
+
+/* Daemon counters. The region is mapped shared before any child is forked, so
+ * every child updates the same counters with relaxed atomics. */
+struct otpStats {
+    uint64_t connAccepted;            /* Connections accepted */
+    uint64_t connActive;              /* Connections currently being served */
+    uint64_t connQueued;              /* Connections waiting for admission */
+    uint64_t connRejected;            /* Connections turned away busy */
+    uint64_t bytesIn;                 /* Frame bytes received */
+    uint64_t bytesOut;                /* Reply bytes sent */
+    uint64_t framesIn;                /* Frames received */
+    uint64_t framesOut;               /* Replies sent */
+    uint64_t cipherNs;                /* Time spent in the cipher */
+    uint64_t poolBytes;               /* Buffer pool memory in use */
+    uint64_t readPauses;              /* Reads paused for buffer memory */
+    uint64_t padReuse;                /* Key windows seen before */
+    uint64_t errors[STATS_ERR_COUNT]; /* Errors by type */
+    uint64_t timeouts[STATS_TIMEOUT_COUNT]; /* Connections closed by a
+                                             * deadline, by type */
+    struct hist frameLatency;         /* Frame receipt to reply sent, in ns */
+    struct hist connDuration;         /* Connection lifetime, in ns */
+    struct hist queueWait[STATS_CLASS_COUNT]; /* Frame receipt to processing
+                                               * by class, in ns */
+};
+
+/* The stats endpoint, as handed to the stats thread */
+struct statsServer {
+    int fd;                           /* The stats listening socket */
+    const char *daemon;               /* The daemon label */
+};
+
+/* The shared stats region, NULL until statsInit() succeeds */
+extern struct otpStats *otpStats;
+
+/* Lock-free counter update. A no-op if stats are not initialized. */
+#define STATS_ADD(field, n) \
+    do { \
+        if (otpStats) { \
+            __atomic_fetch_add(&otpStats->field, (n), __ATOMIC_RELAXED); \
+        } \
+    } while (0)
+
+/* Lock-free histogram update. A no-op if stats are not initialized. */
+#define STATS_RECORD(field, v) \
+    do { \
+        if (otpStats) { \
+            histRecord(&otpStats->field, (v)); \
+        } \
+    } while (0)
+
+int statsInit();
+int statsBind(const char *);
+void statsServe(int, const char *);
+void *statsMain(void *);
+int statsStart(int, const char *);
+
+#endif
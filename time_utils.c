@@ -0,0 +1,78 @@
+/*******************************************************************************
+*      Filename: time_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Provides monotonic clock and cycle counter utilities used for
+*                benchmarking and latency measurement.
+*******************************************************************************/
+
+#include "time_utils.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*******************************************************************************
+*      Function: timeNowNs()
+*   Description: Reads the monotonic clock.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The current CLOCK_MONOTONIC time in nanoseconds.
+*******************************************************************************/
+
+uint64_t timeNowNs() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * TIME_NS_PER_SEC + ts.tv_nsec;
+}
+
+/*******************************************************************************
+*      Function: timeCycles()
+*   Description: Reads the CPU timestamp counter. On architectures without an
+*                accessible counter, the monotonic clock is used instead so that
+*                cycle figures degrade to nanosecond figures.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The current cycle count.
+*******************************************************************************/
+
+uint64_t timeCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return timeNowNs();
+#endif
+}
+
+/*******************************************************************************
+*      Function: timeCyclesPerNs()
+*   Description: Determines the cycle counter frequency by sampling it over a
+*                short sleep. The result is computed once and cached.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The number of counter cycles per nanosecond.
+*******************************************************************************/
+
+double timeCyclesPerNs() {
+    static double cyclesPerNs = 0.0;
+    struct timespec span = {0, TIME_CALIBRATE_NS};
+    uint64_t startNs, startCycles, endNs, endCycles;
+
+    if (cyclesPerNs > 0.0) {
+        return cyclesPerNs;
+    }
+
+    /* Sample both clocks across the calibration span */
+    startNs = timeNowNs();
+    startCycles = timeCycles();
+    nanosleep(&span, NULL);
+    endCycles = timeCycles();
+    endNs = timeNowNs();
+
+    cyclesPerNs = (double)(endCycles - startCycles) / (double)(endNs - startNs);
+    if (cyclesPerNs <= 0.0) {
+        cyclesPerNs = 1.0;
+    }
+    return cyclesPerNs;
+}
@@ -0,0 +1,24 @@
+/*******************************************************************************
+*      Filename: time_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for time_utils.c. Please see time_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef TIME_UTILS_H
+#define TIME_UTILS_H
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TIME_NS_PER_SEC    1000000000ULL  /* Nanoseconds per second */
+#define TIME_NS_PER_MS        1000000ULL  /* Nanoseconds per millisecond */
+#define TIME_CALIBRATE_NS    20000000ULL  /* Cycle counter calibration span */
+
+uint64_t timeNowNs();
+uint64_t timeCycles();
+double timeCyclesPerNs();
+
+#endif
@@ -0,0 +1,231 @@
+/*******************************************************************************
+*      Filename: timer_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: A hierarchical timer wheel for the deadlines of many
+*                connections. A timer is a list node embedded in its owner, so
+*                arming one is an insertion into the slot of its expiry tick,
+*                cancelling one is an unlink, and neither allocates or depends
+*                on the number of timers. Timers due within TIMER_SLOTS ticks
+*                sit in level 0, one slot per tick; later ones sit in coarser
+*                levels and move down a level each time the level below wraps,
+*                so each timer is touched at most TIMER_LEVELS times before it
+*                expires.
+*******************************************************************************/
+
+#include "timer_utils.h"
+
+/*******************************************************************************
+*      Function: timerWheelInit()
+*   Description: Initializes an empty wheel.
+*    Parameters: struct timerWheel *w - The wheel.
+*                uint64_t nowMs - The current time in milliseconds.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void timerWheelInit(struct timerWheel *w, uint64_t nowMs) {
+    int level, i;
+
+    w->tick = nowMs / TIMER_TICK_MS;
+    w->armed = 0;
+    for (level = 0; level < TIMER_LEVELS; level++) {
+        for (i = 0; i < TIMER_SLOTS; i++) {
+            w->slot[level][i].next = &w->slot[level][i];
+            w->slot[level][i].prev = &w->slot[level][i];
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: timerPlace()
+*   Description: Links a timer into the slot for its expiry tick, in the finest
+*                level that reaches it.
+*    Parameters: struct timerWheel *w - The wheel.
+*                struct timerEntry *e - The timer.
+* Preconditions: The timer is not linked.
+*       Returns: None.
+*******************************************************************************/
+
+void timerPlace(struct timerWheel *w, struct timerEntry *e) {
+    struct timerEntry *head;
+    uint64_t delta;
+    int level = 0;
+
+    /* Overdue timers run at the next tick, distant ones at the furthest */
+    if (e->expires < w->tick) {
+        e->expires = w->tick;
+    }
+    delta = e->expires - w->tick;
+    if (delta >= TIMER_SPAN_TICKS) {
+        e->expires = w->tick + TIMER_SPAN_TICKS - 1;
+        delta = TIMER_SPAN_TICKS - 1;
+    }
+    while (level < TIMER_LEVELS - 1 &&
+           delta >= 1ULL << (TIMER_SLOT_BITS * (level + 1))) {
+        level++;
+    }
+
+    head = &w->slot[level][(e->expires >> (TIMER_SLOT_BITS * level)) &
+                           (TIMER_SLOTS - 1)];
+    e->next = head;
+    e->prev = head->prev;
+    head->prev->next = e;
+    head->prev = e;
+}
+
+/*******************************************************************************
+*      Function: timerArm()
+*   Description: Arms a timer, or moves an armed one to a new deadline.
+*    Parameters: struct timerWheel *w - The wheel.
+*                struct timerEntry *e - The timer.
+*                uint64_t expiresMs - The deadline in milliseconds. The timer
+*                                     never expires before it.
+* Preconditions: The timer was zeroed or cancelled before its first use.
+*       Returns: None.
+*******************************************************************************/
+
+void timerArm(struct timerWheel *w, struct timerEntry *e, uint64_t expiresMs) {
+    timerCancel(w, e);
+    e->expires = (expiresMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    timerPlace(w, e);
+    w->armed++;
+}
+
+/*******************************************************************************
+*      Function: timerCancel()
+*   Description: Disarms a timer. Disarming an unarmed timer does nothing.
+*    Parameters: struct timerWheel *w - The wheel.
+*                struct timerEntry *e - The timer.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void timerCancel(struct timerWheel *w, struct timerEntry *e) {
+    if (!e->next) {
+        return;
+    }
+    e->prev->next = e->next;
+    e->next->prev = e->prev;
+    e->next = NULL;
+    e->prev = NULL;
+    w->armed--;
+}
+
+/*******************************************************************************
+*      Function: timerCascade()
+*   Description: Moves the timers of a coarse slot down to finer levels.
+*    Parameters: struct timerWheel *w - The wheel.
+*                int level - The slot's level.
+*                int index - The slot's index.
+* Preconditions: The wheel's tick is the first tick the slot covers.
+*       Returns: The index, so that a caller knows whether the level wrapped.
+*******************************************************************************/
+
+int timerCascade(struct timerWheel *w, int level, int index) {
+    struct timerEntry *head = &w->slot[level][index];
+    struct timerEntry *e = head->next;
+    struct timerEntry *next;
+
+    head->next = head;
+    head->prev = head;
+    while (e != head) {
+        next = e->next;
+        timerPlace(w, e);
+        e = next;
+    }
+    return index;
+}
+
+/*******************************************************************************
+*      Function: timerAdvance()
+*   Description: Runs the wheel up to the current time, calling the expiry
+*                function for each timer that has expired. A timer is disarmed
+*                before its expiry function runs, which may arm or cancel any
+*                timer, including the one that expired.
+*    Parameters: struct timerWheel *w - The wheel.
+*                uint64_t nowMs - The current time in milliseconds.
+*                void (*expire)(struct timerEntry *, void *) - The expiry
+*                                                              function.
+*                void *arg - Passed to the expiry function.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void timerAdvance(struct timerWheel *w, uint64_t nowMs,
+                  void (*expire)(struct timerEntry *, void *), void *arg) {
+    struct timerEntry due, *e;
+    uint64_t now = nowMs / TIMER_TICK_MS;
+    int index, level;
+
+    while (w->tick <= now) {
+        /* An empty wheel skips straight to the present */
+        if (!w->armed) {
+            w->tick = now + 1;
+            return;
+        }
+        index = w->tick & (TIMER_SLOTS - 1);
+        for (level = 1; index == 0 && level < TIMER_LEVELS; level++) {
+            index = timerCascade(w, level,
+                                 (w->tick >> (TIMER_SLOT_BITS * level)) &
+                                 (TIMER_SLOTS - 1));
+        }
+
+        /* Detach the tick's slot, so that timers armed by the expiry
+         * functions are never run in the same pass */
+        index = w->tick & (TIMER_SLOTS - 1);
+        if (w->slot[0][index].next == &w->slot[0][index]) {
+            w->tick++;
+            continue;
+        }
+        due.next = w->slot[0][index].next;
+        due.prev = w->slot[0][index].prev;
+        due.next->prev = &due;
+        due.prev->next = &due;
+        w->slot[0][index].next = &w->slot[0][index];
+        w->slot[0][index].prev = &w->slot[0][index];
+        w->tick++;
+
+        while (due.next != &due) {
+            e = due.next;
+            timerCancel(w, e);
+            expire(e, arg);
+        }
+    }
+}
+
+/*******************************************************************************
+*      Function: timerWaitMs()
+*   Description: Finds how long a caller may sleep before the wheel needs to
+*                run: until the next timer in level 0, or until level 0 wraps
+*                and the next coarse slot is redistributed.
+*    Parameters: struct timerWheel *w - The wheel.
+*                uint64_t nowMs - The current time in milliseconds.
+* Preconditions: None.
+*       Returns: The time in milliseconds, or -1 if no timer is armed.
+*******************************************************************************/
+
+int timerWaitMs(struct timerWheel *w, uint64_t nowMs) {
+    uint64_t next = (w->tick | (TIMER_SLOTS - 1)) + 1;
+    int i;
+
+    if (!w->armed) {
+        return -1;
+    }
+    /* At the start of a cycle, level 0 is not filled until the coarse slot
+     * is redistributed at that tick */
+    if ((w->tick & (TIMER_SLOTS - 1)) == 0) {
+        next = w->tick;
+    }
+    for (i = w->tick & (TIMER_SLOTS - 1); next != w->tick && i < TIMER_SLOTS;
+         i++) {
+        if (w->slot[0][i].next != &w->slot[0][i]) {
+            next = (w->tick & ~(uint64_t)(TIMER_SLOTS - 1)) + i;
+            break;
+        }
+    }
+    if (next * TIMER_TICK_MS <= nowMs) {
+        return 0;
+    }
+    return (int)(next * TIMER_TICK_MS - nowMs);
+}
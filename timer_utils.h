@@ -0,0 +1,50 @@
+/*******************************************************************************
+*      Filename: timer_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for timer_utils.c. Please see timer_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef TIMER_UTILS_H
+#define TIMER_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMER_TICK_MS     10   /* The wheel resolution */
+#define TIMER_SLOT_BITS    6
+#define TIMER_SLOTS       (1 << TIMER_SLOT_BITS) /* Slots per level */
+#define TIMER_LEVELS       4   /* Levels, each TIMER_SLOTS times coarser */
+#define TIMER_SPAN_TICKS  (1ULL << (TIMER_SLOT_BITS * TIMER_LEVELS))
+                               /* The furthest deadline, about 46 hours */
+
+/* A timer, embedded in the structure it times */
+struct timerEntry {
+    struct timerEntry *next;      /* The slot's list, NULL if not armed */
+    struct timerEntry *prev;
+    uint64_t expires;             /* The tick it expires at */
+};
+
+/* A hierarchical timer wheel. Level 0 holds the timers due within
+ * TIMER_SLOTS ticks, one slot per tick; each higher level holds timers due
+ * further out, one slot per TIMER_SLOTS slots of the level below, and is
+ * redistributed downward as level 0 wraps. */
+struct timerWheel {
+    uint64_t tick;                /* The next tick to run */
+    int armed;                    /* The number of armed timers */
+    struct timerEntry slot[TIMER_LEVELS][TIMER_SLOTS]; /* List heads */
+};
+
+/* The structure a timer is embedded in */
+#define TIMER_OWNER(entry, type, member) \
+    ((type *)((char *)(entry) - offsetof(type, member)))
+
+void timerWheelInit(struct timerWheel *, uint64_t);
+void timerArm(struct timerWheel *, struct timerEntry *, uint64_t);
+void timerCancel(struct timerWheel *, struct timerEntry *);
+void timerAdvance(struct timerWheel *, uint64_t,
+                  void (*)(struct timerEntry *, void *), void *);
+int timerWaitMs(struct timerWheel *, uint64_t);
+
+#endif
@@ -0,0 +1,354 @@
+/*******************************************************************************
+*      Filename: trace_utils.c
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: Provides opt-in, low overhead per-request tracing. Setting the
+*                OTP_TRACE environment variable to a path prefix enables it.
+*                Each phase is timestamped with the cycle counter into a ring
+*                owned by the calling thread. When a ring fills, and again at
+*                exit, its events are appended to <prefix>.<pid>.json in the
+*                Chrome trace JSON array format, which can be opened directly
+*                in chrome://tracing or Perfetto. Daemons run until a signal
+*                stops them, so their loops also write out their events every
+*                TRACE_FLUSH_MS, and finish the file when SIGTERM or SIGINT
+*                arrives.
+*******************************************************************************/
+
+#include "time_utils.h"
+#include "trace_utils.h"
+
+int traceEnabled = 0;
+
+/* The trace file path prefix and the process label */
+static const char *tracePrefix;
+static const char *traceProcess;
+
+/* Clock bases used to convert cycle counts to monotonic microseconds */
+static uint64_t traceBaseCycles;
+static uint64_t traceBaseNs;
+static double traceCyclesPerNs;
+
+/* Every ring created in this process, guarded by traceLock */
+static struct traceRing *traceRings = NULL;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The trace file of this process, opened on the first flush */
+static int traceFd = -1;
+
+/* The ring owned by the calling thread */
+static __thread struct traceRing *traceRingLocal = NULL;
+
+/* The stop signal caught by a daemon, 0 if none */
+static volatile sig_atomic_t traceStopSignal = 0;
+
+/* When the calling daemon loop last wrote out its events, in milliseconds */
+static uint64_t traceLastFlush = 0;
+
+void traceAtExit();
+
+/*******************************************************************************
+*      Function: traceInit()
+*   Description: Enables tracing if OTP_TRACE is set.
+*    Parameters: const char *process - The process label shown in the trace.
+* Preconditions: Called once, before any thread is created.
+*       Returns: None.
+*******************************************************************************/
+
+void traceInit(const char *process) {
+    tracePrefix = getenv(TRACE_ENV);
+    if (!tracePrefix || !*tracePrefix) {
+        return;
+    }
+    traceProcess = process;
+    traceCyclesPerNs = timeCyclesPerNs();
+    traceBaseNs = timeNowNs();
+    traceBaseCycles = timeCycles();
+    atexit(traceAtExit);
+    traceEnabled = 1;
+}
+
+/*******************************************************************************
+*      Function: traceFork()
+*   Description: Resets the tracing state in a freshly forked child so that it
+*                neither duplicates nor appends to the events of its parent.
+*    Parameters: None.
+* Preconditions: Called in the child immediately after fork().
+*       Returns: None.
+*******************************************************************************/
+
+void traceFork() {
+    struct traceRing *ring;
+
+    if (!traceEnabled) {
+        return;
+    }
+    /* Only the forking thread exists in the child. Keep its ring. */
+    pthread_mutex_init(&traceLock, NULL);
+    for (ring = traceRings; ring; ring = ring->next) {
+        ring->len = 0;
+    }
+    if (traceRingLocal) {
+        traceRingLocal->tid = (int)syscall(SYS_gettid);
+    }
+    traceFd = -1;
+
+    /* A forked child runs no daemon loop, so it stops as it would untraced
+     * and writes out its events when it exits */
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    traceStopSignal = 0;
+}
+
+/*******************************************************************************
+*      Function: traceStop()
+*   Description: Records a stop signal for the daemon loop to act on.
+*    Parameters: int sig - The signal.
+* Preconditions: Installed by traceHandleStop().
+*       Returns: None.
+*******************************************************************************/
+
+void traceStop(int sig) {
+    traceStopSignal = sig;
+}
+
+/*******************************************************************************
+*      Function: traceHandleStop()
+*   Description: Catches SIGTERM and SIGINT in a traced daemon, so that its
+*                loop can finish the trace file before it stops. The handler
+*                does not restart system calls, so a loop waiting for events
+*                wakes at once.
+*    Parameters: None.
+* Preconditions: traceInit() has been called.
+*       Returns: None.
+*******************************************************************************/
+
+void traceHandleStop() {
+    struct sigaction action = {0};
+
+    if (!traceEnabled) {
+        return;
+    }
+    action.sa_handler = traceStop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+}
+
+/*******************************************************************************
+*      Function: traceBegin()
+*   Description: Marks the start of a phase.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: The start timestamp, 0 if tracing is disabled.
+*******************************************************************************/
+
+uint64_t traceBegin() {
+    return traceEnabled ? timeCycles() : 0;
+}
+
+/*******************************************************************************
+*      Function: traceOpen()
+*   Description: Opens the trace file of this process and writes its header.
+*    Parameters: None.
+* Preconditions: traceLock is held.
+*       Returns: 0 on success, -1 on error.
+*******************************************************************************/
+
+int traceOpen() {
+    char path[TRACE_PATH_MAX];
+    char line[TRACE_LINE_MAX];
+    int len;
+
+    snprintf(path, sizeof(path), "%s.%d.json", tracePrefix, (int)getpid());
+    traceFd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (traceFd < 0) {
+        perror("traceOpen: open");
+        traceEnabled = 0;
+        return -1;
+    }
+    /* The closing bracket of the array format is optional, which lets events
+     * be appended for as long as the process runs */
+    len = snprintf(line, sizeof(line), "[{\"name\":\"process_name\",\"ph\":\"M\","
+                   "\"pid\":%d,\"args\":{\"name\":\"%s\"}}", (int)getpid(),
+                   traceProcess);
+    if (write(traceFd, line, len) != len) {
+        perror("traceOpen: write");
+    }
+    return 0;
+}
+
+/*******************************************************************************
+*      Function: traceWriteRing()
+*   Description: Appends the buffered events of a ring to the trace file and
+*                empties the ring.
+*    Parameters: struct traceRing *ring - The ring.
+* Preconditions: traceLock is held.
+*       Returns: None.
+*******************************************************************************/
+
+void traceWriteRing(struct traceRing *ring) {
+    char buffer[TRACE_LINE_MAX * 64];
+    struct traceEvent *ev;
+    double ts, dur;
+    int i, len = 0;
+    int pid = (int)getpid();
+
+    if (ring->len == 0 || (traceFd < 0 && traceOpen() < 0)) {
+        ring->len = 0;
+        return;
+    }
+
+    for (i = 0; i < ring->len; i++) {
+        ev = &ring->events[i];
+        ts = (traceBaseNs + (double)(int64_t)(ev->start - traceBaseCycles) / 
+              traceCyclesPerNs) / 1000.0;
+        dur = (double)(ev->end - ev->start) / traceCyclesPerNs / 1000.0;
+        len += snprintf(&buffer[len], sizeof(buffer) - len,
+                        ",\n{\"name\":\"%s\",\"cat\":\"otp\",\"ph\":\"X\","
+                        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d}",
+                        ev->name, ts, dur, pid, ring->tid);
+        /* Write out the batch once the buffer cannot hold another event */
+        if (len > (int)sizeof(buffer) - TRACE_LINE_MAX || i == ring->len - 1) {
+            if (write(traceFd, buffer, len) != len) {
+                perror("traceWriteRing: write");
+            }
+            len = 0;
+        }
+    }
+    ring->len = 0;
+}
+
+/*******************************************************************************
+*      Function: traceEnd()
+*   Description: Records a completed phase in the calling thread's ring. The
+*                ring is flushed to the trace file when it fills.
+*    Parameters: const char *name - The phase name. Must outlive the process.
+*                uint64_t start - The value returned by traceBegin().
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void traceEnd(const char *name, uint64_t start) {
+    struct traceRing *ring = traceRingLocal;
+    struct traceEvent *ev;
+
+    if (!traceEnabled || start == 0) {
+        return;
+    }
+    /* Create and register the ring on the first event of the thread */
+    if (!ring) {
+        ring = calloc(1, sizeof(*ring));
+        if (!ring) {
+            return;
+        }
+        ring->tid = (int)syscall(SYS_gettid);
+        pthread_mutex_lock(&traceLock);
+        ring->next = traceRings;
+        traceRings = ring;
+        pthread_mutex_unlock(&traceLock);
+        traceRingLocal = ring;
+    }
+
+    ev = &ring->events[ring->len++];
+    ev->name = name;
+    ev->start = start;
+    ev->end = timeCycles();
+
+    if (ring->len == TRACE_RING_EVENTS) {
+        pthread_mutex_lock(&traceLock);
+        traceWriteRing(ring);
+        pthread_mutex_unlock(&traceLock);
+    }
+}
+
+/*******************************************************************************
+*      Function: traceFlush()
+*   Description: Writes the buffered events of every ring to the trace file.
+*    Parameters: None.
+* Preconditions: No other thread is recording events.
+*       Returns: None.
+*******************************************************************************/
+
+void traceFlush() {
+    struct traceRing *ring;
+
+    if (!traceEnabled) {
+        return;
+    }
+    pthread_mutex_lock(&traceLock);
+    for (ring = traceRings; ring; ring = ring->next) {
+        traceWriteRing(ring);
+    }
+    pthread_mutex_unlock(&traceLock);
+}
+
+/*******************************************************************************
+*      Function: traceTick()
+*   Description: Called on each pass of a daemon loop. Writes out the calling
+*                thread's events every TRACE_FLUSH_MS, and once a stop signal
+*                has been caught, finishes the trace file and stops the process
+*                with that signal.
+*    Parameters: None.
+* Preconditions: None.
+*       Returns: None.
+*******************************************************************************/
+
+void traceTick() {
+    uint64_t now;
+    int sig = traceStopSignal;
+
+    if (!traceEnabled) {
+        return;
+    }
+    if (sig) {
+        traceAtExit();
+        signal(sig, SIG_DFL);
+        raise(sig);
+        return;
+    }
+    now = timeNowNs() / TIME_NS_PER_MS;
+    if (now - traceLastFlush < TRACE_FLUSH_MS) {
+        return;
+    }
+    traceLastFlush = now;
+    if (traceRingLocal) {
+        pthread_mutex_lock(&traceLock);
+        traceWriteRing(traceRingLocal);
+        pthread_mutex_unlock(&traceLock);
+    }
+}
+
+/*******************************************************************************
+*      Function: traceWaitMs()
+*   Description: Shortens a daemon loop's wait so that traceTick() runs at
+*                least every TRACE_FLUSH_MS.
+*    Parameters: int wait - The wait in milliseconds, -1 for no limit.
+* Preconditions: None.
+*       Returns: The wait to use.
+*******************************************************************************/
+
+int traceWaitMs(int wait) {
+    if (traceEnabled && (wait < 0 || wait > TRACE_FLUSH_MS)) {
+        return TRACE_FLUSH_MS;
+    }
+    return wait;
+}
+
+/*******************************************************************************
+*      Function: traceAtExit()
+*   Description: Flushes the remaining events and terminates the JSON array.
+*    Parameters: None.
+* Preconditions: Registered with atexit() by traceInit().
+*       Returns: None.
+*******************************************************************************/
+
+void traceAtExit() {
+    traceFlush();
+    if (traceFd >= 0) {
+        if (write(traceFd, "]\n", 2) != 2) {
+            perror("traceAtExit: write");
+        }
+        close(traceFd);
+        traceFd = -1;
+    }
+}
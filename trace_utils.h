@@ -0,0 +1,57 @@
+/*******************************************************************************
+*      Filename: trace_utils.h
+*        Author: Maxwell Goldberg
+* Last Modified: 10.19.26
+*   Description: The header file for trace_utils.c. Please see trace_utils.c for
+*                more details.
+*******************************************************************************/
+
+#ifndef TRACE_UTILS_H
+#define TRACE_UTILS_H
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define TRACE_ENV          "OTP_TRACE"  /* Trace file prefix variable */
+#define TRACE_RING_EVENTS  4096         /* Events buffered per thread */
+#define TRACE_PATH_MAX     4096         /* Maximum trace file path length */
+#define TRACE_LINE_MAX      256         /* Maximum formatted event length */
+#define TRACE_FLUSH_MS     1000         /* How often a daemon loop writes out
+                                         * its events */
+
+/* A single completed phase */
+struct traceEvent {
+    const char *name;   /* The phase name, a string literal */
+    uint64_t start;     /* The start time in counter cycles */
+    uint64_t end;       /* The end time in counter cycles */
+};
+
+/* The events recorded by a single thread */
+struct traceRing {
+    struct traceEvent events[TRACE_RING_EVENTS];
+    int len;                  /* Buffered events */
+    int tid;                  /* The owning thread id */
+    struct traceRing *next;   /* The next registered ring */
+};
+
+/* Nonzero when tracing is enabled. Checked before any other tracing work. */
+extern int traceEnabled;
+
+void traceInit(const char *);
+void traceFork();
+void traceHandleStop();
+void traceTick();
+int traceWaitMs(int);
+uint64_t traceBegin();
+void traceEnd(const char *, uint64_t);
+void traceFlush();
+
+#endif